@@ -0,0 +1,6 @@
+(= fib (@ (n) (
+	(? (< n 2) ((<- (+ n 0))))
+	(<- (+ (@@ fib ((- n 1))) (@@ fib ((- n 2)))))
+)
+))
+(= res (@@ fib ((+ 26 1))))
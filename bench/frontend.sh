@@ -0,0 +1,14 @@
+#!/bin/sh
+# Front end throughput and peak RSS per phase on generated 1, 10 and 100 MiB programs:
+#   bench/frontend.sh build/src/pisp
+set -e
+pisp=${1:?usage: frontend.sh <path to pisp>}
+dir=$(dirname "$0")
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+for mib in 1 10 100; do
+	python3 "$dir/gen_large.py" "$mib" > "$tmp/large.lisp"
+	echo "== $mib MiB"
+	"$pisp" --time --parse-only "$tmp/large.lisp"
+done
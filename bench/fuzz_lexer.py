@@ -0,0 +1,66 @@
+#!/usr/bin/env python3
+# Feeds random input to `pisp --lex-diff`, which tokenizes it with every scanner the CPU
+# has and compares them with the scalar one. Runs of blanks, digits and identifier
+# characters get random lengths so they end at every offset within a 16 and 32 byte chunk:
+#   python3 bench/fuzz_lexer.py build/src/pisp 500
+import os
+import random
+import subprocess
+import sys
+import tempfile
+
+if len(sys.argv) < 2 or len(sys.argv) > 4:
+	sys.exit("usage: fuzz_lexer.py <path to pisp> [runs] [seed]")
+
+pisp = sys.argv[1]
+runs = int(sys.argv[2]) if len(sys.argv) > 2 else 200
+rng = random.Random(int(sys.argv[3]) if len(sys.argv) > 3 else 1)
+
+LETTERS = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ"
+DIGITS = "0123456789"
+OPERATORS = ["(", ")", "=", "==", "+", "-", "*", "/", ">", ">=", "<", "<=", "<-", "&", "&&", "|", "||",
+	"?", "!", "::", "@ ", "@@ ", "@$"] # '@' would take the '$' of a following "@$"
+
+def run_of(chars, lo, hi):
+	return "".join(rng.choice(chars) for _ in range(rng.randint(lo, hi)))
+
+# a number is closed by something other than a digit or '.', so two never merge into
+# one that is out of range or has two dots, and a float is opened by one too, so its
+# integer part doesn't continue an identifier and leave the '.' on its own
+def number(text):
+	return text + rng.choice(" \t()+<")
+
+def lexeme():
+	kind = rng.random()
+	if kind < 0.3:
+		return rng.choice(LETTERS) + run_of(LETTERS + DIGITS, 0, 70)
+	if kind < 0.45:
+		return number(rng.choice(DIGITS) + run_of(DIGITS, 0, 13)) # stays in the 48 bits of an integer Value
+	if kind < 0.55:
+		return rng.choice(" \t(") + number(run_of(DIGITS, 1, 70) + "." + run_of(DIGITS, 0, 70))
+	if kind < 0.7:
+		return run_of(" \t", 1, 80)
+	return rng.choice(OPERATORS)
+
+def source():
+	parts = [lexeme() for _ in range(rng.randint(1, 400))]
+	if rng.random() < 0.1:
+		parts.append("//" + run_of(LETTERS + " ()", 0, 40))
+	return "".join(parts)
+
+failures = 0
+with tempfile.TemporaryDirectory() as tmp:
+	for run in range(runs):
+		path = os.path.join(tmp, "input.lisp")
+		with open(path, "w") as file:
+			file.write(source())
+
+		result = subprocess.run([pisp, "--lex-diff", path], capture_output=True, text=True)
+		if result.returncode != 0:
+			failures += 1
+			kept = "lex_diff_%d.lisp" % run
+			os.replace(path, kept)
+			print("run %d failed, input kept in %s:\n%s" % (run, kept, result.stderr), end="")
+
+print("%d runs, %d failed" % (runs, failures))
+sys.exit(1 if failures else 0)
@@ -0,0 +1,48 @@
+#!/usr/bin/env python3
+# Writes a generated program of about <MiB> mebibytes to stdout, for timing the front end:
+#   python3 bench/gen_large.py 10 > /tmp/large.lisp
+#   ./pisp --time --parse-only /tmp/large.lisp
+import random
+import sys
+
+if len(sys.argv) != 2:
+	sys.exit("usage: gen_large.py <MiB>")
+
+target = int(float(sys.argv[1]) * 1024 * 1024)
+rng = random.Random(1)
+out = sys.stdout
+size = 0
+
+def emit(text):
+	global size
+	out.write(text)
+	out.write("\n")
+	size += len(text) + 1
+
+def expr(depth):
+	if depth == 0 or rng.random() < 0.3:
+		return rng.choice([str(rng.randint(0, 99999)), "%d.%d" % (rng.randint(0, 999), rng.randint(0, 99)), "v%d" % rng.randint(0, 63)])
+	op = rng.choice(["+", "-", "*", "<", ">", "<=", ">="]) # no bitwise ops, operands may be doubles
+	return "(%s %s %s)" % (op, expr(depth - 1), expr(depth - 1))
+
+for k in range(64):
+	emit("(= v%d %d)" % (k, k))
+
+block = 0
+while size < target:
+	kind = block % 4
+	if kind == 0:
+		emit("(= f%d (@ (a b) (" % block)
+		emit("\t(? (< a b) ((<- %s)))" % expr(3))
+		emit("\t(<- (+ a %s))" % expr(2))
+		emit(")))")
+	elif kind == 1:
+		emit("(:: (= i 0) (< i 3) (= i (+ i 1)) (")
+		emit("\t(= v%d %s)" % (rng.randint(0, 63), expr(4)))
+		emit("))")
+	elif kind == 2:
+		emit("(? (< v%d %s) ((= v%d %s)))" % (rng.randint(0, 63), expr(2), rng.randint(0, 63), expr(3)))
+		emit("(! ((= v%d %s)))" % (rng.randint(0, 63), expr(3)))
+	else:
+		emit("(= v%d (@@ f%d (%s %s)))" % (rng.randint(0, 63), block - 3, expr(2), expr(2)))
+	block += 1
@@ -0,0 +1,8 @@
+(= acc 0)
+(= i 0)
+(= j 0)
+(:: (= i 0) (< i 2000) (= i (+ i 1)) (
+	(:: (= j 0) (< j 1000) (= j (+ j 1)) (
+		(= acc (+ acc (& (* i j) 7)))
+	))
+))
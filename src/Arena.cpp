@@ -0,0 +1,53 @@
+#include "Arena.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <sys/mman.h>
+
+Arena::~Arena()
+{
+	release();
+}
+
+void Arena::release()
+{
+	// children may be destroyed before their parents, destructors never follow the pointers
+	for (auto it = m_dtors.rbegin(); it != m_dtors.rend(); ++it)
+		it->destroy(it->obj);
+
+	m_dtors.clear();
+	m_chunks.clear();
+	m_ptr = m_end = nullptr;
+	m_bytes = 0;
+}
+
+size_t Arena::bytes() const
+{
+	return m_bytes;
+}
+
+void* Arena::allocate(size_t size, size_t align)
+{
+	auto addr = reinterpret_cast<uintptr_t>(m_ptr);
+	size_t pad = (align - addr % align) % align;
+	if (!m_ptr || pad + size > static_cast<size_t>(m_end - m_ptr))
+	{
+		size_t chunk = (std::max(CHUNK_SIZE, size + align) + CHUNK_SIZE - 1) / CHUNK_SIZE * CHUNK_SIZE;
+		auto* mem = static_cast<std::byte*>(std::aligned_alloc(CHUNK_SIZE, chunk));
+		if (!mem)
+			throw std::bad_alloc();
+#ifdef MADV_HUGEPAGE // only a hint, the chunk works the same without it
+		madvise(mem, chunk, MADV_HUGEPAGE);
+#endif
+		m_chunks.emplace_back(mem);
+		m_ptr = m_chunks.back().get();
+		m_end = m_ptr + chunk;
+		addr = reinterpret_cast<uintptr_t>(m_ptr);
+		pad = (align - addr % align) % align;
+	}
+
+	std::byte* res = m_ptr + pad;
+	m_ptr = res + size;
+	m_bytes += size;
+	return res;
+}
\ No newline at end of file
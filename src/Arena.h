@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <span>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Bump-pointer allocator owning the AST. Nodes are carved out of large chunks one after
+// the other and point at their children directly; nothing is freed on its own, the
+// whole tree goes at once when the arena is released. Objects with a destructor (the
+// ones holding vectors) are remembered so release() can still run it.
+class Arena
+{
+public:
+	// bytes, one huge page so a large tree takes far fewer page faults; larger objects
+	// get a chunk of their own, rounded up to a whole number of them
+	static constexpr size_t CHUNK_SIZE = 2 * 1024 * 1024;
+
+	Arena() = default;
+	~Arena();
+
+	Arena(const Arena&) = delete;
+	Arena& operator=(const Arena&) = delete;
+
+	template<typename T, typename... Args>
+	T* make(Args&&... args)
+	{
+		T* obj = new (allocate(sizeof(T), alignof(T))) T{ std::forward<Args>(args)... };
+		if constexpr (!std::is_trivially_destructible_v<T>)
+			m_dtors.push_back({ obj, [](void* ptr) { static_cast<T*>(ptr)->~T(); } });
+		return obj;
+	}
+
+	// a copy of items living in the arena, for elements that need no destructor
+	template<typename T>
+	std::span<const T> copy(std::span<const T> items)
+	{
+		static_assert(std::is_trivially_destructible_v<T>);
+		if (items.empty())
+			return {};
+		T* res = static_cast<T*>(allocate(sizeof(T) * items.size(), alignof(T)));
+		std::uninitialized_copy(items.begin(), items.end(), res);
+		return { res, items.size() };
+	}
+
+	template<typename T>
+	std::span<const T> copy(const std::vector<T>& items)
+	{
+		return copy(std::span<const T>(items));
+	}
+
+	void release(); // destroys everything made so far
+	size_t bytes() const; // reserved for the objects made so far
+
+private:
+	void* allocate(size_t size, size_t align);
+
+private:
+	struct Dtor
+	{
+		void* obj;
+		void (*destroy)(void*);
+	};
+
+	struct Free
+	{
+		void operator()(std::byte* ptr) const { std::free(ptr); }
+	};
+
+	std::vector<std::unique_ptr<std::byte, Free>> m_chunks;
+	std::byte* m_ptr = nullptr;
+	std::byte* m_end = nullptr;
+	size_t m_bytes = 0;
+	std::vector<Dtor> m_dtors;
+};
\ No newline at end of file
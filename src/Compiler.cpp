@@ -25,10 +25,12 @@ std::string opcode_to_string(OpCode code)
 	switch (code)
 	{
 		case OpCode::MOV: return "MOV";
-		case OpCode::PUSH_SF: return "PUSH_SF";
-		case OpCode::POP_SF: return "POP_SF";
 		case OpCode::PUSH: return "PUSH";
 		case OpCode::POP: return "POP";
+		case OpCode::RESERVE: return "RESERVE";
+		case OpCode::LOAD_LOCAL: return "LOAD_LOCAL";
+		case OpCode::LOAD_GLOBAL: return "LOAD_GLOBAL";
+		case OpCode::LOAD_CONST: return "LOAD_CONST";
 		case OpCode::ADD: return "ADD";
 		case OpCode::SUB: return "SUB";
 		case OpCode::MUL: return "MUL";
@@ -44,12 +46,54 @@ std::string opcode_to_string(OpCode code)
 		case OpCode::EQL: return "EQL";
 		case OpCode::JMP: return "JMP";
 		case OpCode::JMP_ZERO: return "JMP_ZERO";
+		case OpCode::JMP_NONZERO: return "JMP_NONZERO";
+		case OpCode::CALL: return "CALL";
+		case OpCode::RET: return "RET";
+		case OpCode::MEMO: return "MEMO";
+		case OpCode::MEMO_RET: return "MEMO_RET";
+		case OpCode::TAILCALL: return "TAILCALL";
+		case OpCode::ADD_IMM: return "ADD_IMM";
+		case OpCode::ADD_LOCAL_IMM: return "ADD_LOCAL_IMM";
+		case OpCode::INC_LOCAL: return "INC_LOCAL";
+		case OpCode::JLT: return "JLT";
+		case OpCode::JGT: return "JGT";
+		case OpCode::JLTE: return "JLTE";
+		case OpCode::JGTE: return "JGTE";
+		case OpCode::JEQ: return "JEQ";
+		case OpCode::JNE: return "JNE";
+		case OpCode::JNLT: return "JNLT";
+		case OpCode::JNGT: return "JNGT";
+		case OpCode::JNLTE: return "JNLTE";
+		case OpCode::JNGTE: return "JNGTE";
+		case OpCode::ADD_DBL: return "ADD_DBL";
+		case OpCode::SUB_DBL: return "SUB_DBL";
+		case OpCode::MUL_DBL: return "MUL_DBL";
+		case OpCode::DIV_DBL: return "DIV_DBL";
 		case OpCode::HLT: return "HLT";
 		default: return "UNKNOWN";
 	}
 }
 
-Compiler::Compiler(std::vector<Node::Node>& nodes) : m_nodes(std::move(nodes)), m_curr_env(new Env{ 0, 0, {}, nullptr }) {}
+const ScopeTable::Entry* ScopeTable::find(Symbol sym) const
+{
+	if (sym >= m_entries.size() || m_entries[sym].empty())
+		return nullptr;
+	return &m_entries[sym].back();
+}
+
+void ScopeTable::bind(Symbol sym, const Env* env, size_t slot)
+{
+	if (sym >= m_entries.size())
+		m_entries.resize(std::max<size_t>(sym + 1, Symbols::count()));
+	m_entries[sym].push_back({ env, slot });
+}
+
+void ScopeTable::unbind(Symbol sym)
+{
+	m_entries[sym].pop_back();
+}
+
+Compiler::Compiler(const std::vector<Node::Node>& nodes) : m_nodes(nodes), m_envs{ Env{ 0, 0, {}, nullptr } }, m_curr_env(&m_envs.back()) {}
 
 std::vector<Instr> Compiler::compile_prog()
 {
@@ -60,6 +104,14 @@ std::vector<Instr> Compiler::compile_prog()
 	return m_bytecode;
 }
 
+std::unordered_map<std::string, size_t> Compiler::globals() const
+{
+	std::unordered_map<std::string, size_t> res;
+	for (const Binding& var : m_envs.front().locals.vars)
+		res[Symbols::name(var.sym)] = var.slot;
+	return res;
+}
+
 void Compiler::compile_node(const Node::Node& node)
 {
 	struct Visitor
@@ -94,16 +146,16 @@ void Compiler::compile_asgn(const Node::StmtAsgn& node)
 	struct Visitor
 	{
 		Compiler& compiler;
-		const std::string& id;
+		Symbol id;
 		void operator()(const Node::Expr& expr)
 		{
 			compiler.compile_expr(expr);
-			if (auto it = compiler.m_curr_env->locals.vars.find(id); it == compiler.m_curr_env->locals.vars.end())
-				compiler.m_curr_env->locals.vars[id] = compiler.m_curr_env->locals.size();
+			if (const auto* entry = compiler.m_vars.find(id); !entry || entry->env != compiler.m_curr_env)
+				compiler.declare(compiler.m_vars, compiler.m_curr_env->locals.vars, id);
 
 			else
 			{
-				int var_loc = static_cast<int>(compiler.m_curr_env->locals.vars[id]);
+				int var_loc = static_cast<int>(entry->slot);
 				compiler.push_instr(OpCode::MOV, { ValueType::VAR, var_loc });
 			}
 			
@@ -112,15 +164,15 @@ void Compiler::compile_asgn(const Node::StmtAsgn& node)
 		void operator()(const Node::Struct& strct)
 		{
 			int func_start_loc = static_cast<int>(compiler.m_bytecode.size() + 2);
-			compiler.push_instr(OpCode::PUSH, { ValueType::LIT, func_start_loc });
-			if (auto it = compiler.m_curr_env->locals.funcs.find(id); it == compiler.m_curr_env->locals.funcs.end())
+			compiler.push_instr(OpCode::PUSH, { ValueType::ADDR, func_start_loc });
+			if (const auto* entry = compiler.m_funcs.find(id); !entry || entry->env != compiler.m_curr_env)
 			{
-				compiler.m_curr_env->locals.funcs[id] = compiler.m_curr_env->locals.size();
+				compiler.declare(compiler.m_funcs, compiler.m_curr_env->locals.funcs, id);
 			}
 
 			else
 			{
-				int func_loc = static_cast<int>(compiler.m_curr_env->locals.funcs[id]);
+				int func_loc = static_cast<int>(entry->slot);
 				compiler.push_instr(OpCode::MOV, { ValueType::VAR, func_loc });
 			}
 
@@ -132,64 +184,116 @@ void Compiler::compile_asgn(const Node::StmtAsgn& node)
 
 void Compiler::compile_if(const Node::StmtIf& node)
 {
-	compile_expr(node.cond);
-
-	size_t false_idx = m_bytecode.size();
-	push_instr(OpCode::JMP_ZERO, { ValueType::LIT, -1 });
+	std::vector<size_t> false_jumps;
+	compile_cond(node.cond, false, false_jumps);
 
 	compile_scope(*node.scope);
 
-	size_t end_idx = m_bytecode.size();
-	push_instr(OpCode::JMP, { ValueType::LIT, -1 });
-
-	if (node.elif.has_value())
+	if (node.elif)
 	{
-		m_bytecode[false_idx].val.operand = m_bytecode.size();
-		compile_if(*node.elif.value());
-		m_bytecode[end_idx].val.operand = m_bytecode.size();
+		size_t end_idx = m_bytecode.size();
+		push_instr(OpCode::JMP, { ValueType::LIT, -1 });
+
+		patch_jumps(false_jumps, m_bytecode.size());
+		compile_if(*node.elif);
+		m_bytecode[end_idx].val.set_operand(m_bytecode.size());
 	}
 	else
-	{
-		m_bytecode[false_idx].val.operand = m_bytecode.size() - 1;
-		m_bytecode.pop_back();
-	}
-
-	
+		patch_jumps(false_jumps, m_bytecode.size());
 }
 
+// The condition is tested at the bottom, so an iteration ends in a single branch back to
+// the body, and the loop is entered by jumping to the condition. It's still compiled
+// before the body, names in it resolve as they always did, and its code is moved after.
 void Compiler::compile_loop(const Node::StmtLoop& node)
 {
-	if (node.init.has_value())
-		compile_asgn(node.init.value());
+	if (node.init)
+		compile_asgn(*node.init);
 
-	size_t cond_start = m_bytecode.size();
-	compile_expr(node.cond);
+	size_t enter_idx = m_bytecode.size();
+	push_instr(OpCode::JMP, { ValueType::LIT, -1 });
 
-	size_t idx = m_bytecode.size();
-	push_instr(OpCode::JMP_ZERO, Value{ ValueType::LIT, -1 });
+	size_t body_start = m_bytecode.size();
+	std::vector<size_t> body_jumps;
+	compile_cond(node.cond, true, body_jumps);
+	std::vector<Instr> cond(m_bytecode.begin() + body_start, m_bytecode.end());
+	m_bytecode.resize(body_start);
 
 	compile_scope(*node.scope);
 
-	if (node.adv.has_value())
-		compile_asgn(node.adv.value());
+	if (node.adv)
+		compile_asgn(*node.adv);
+
+	// jumps and function addresses inside the condition move along with it
+	size_t cond_start = m_bytecode.size();
+	size_t delta = cond_start - body_start;
+	for (Instr& instr : cond)
+	{
+		bool is_jump = instr.code == OpCode::JMP || instr.code == OpCode::JMP_ZERO || instr.code == OpCode::JMP_NONZERO;
+		size_t target = instr.val.operand();
+		if ((is_jump || instr.val.is(ValueType::ADDR)) && target >= body_start && target <= body_start + cond.size())
+			instr.val.set_operand(target + delta);
+		m_bytecode.push_back(instr);
+	}
+	for (size_t& idx : body_jumps)
+		idx += delta;
+
+	m_bytecode[enter_idx].val.set_operand(cond_start);
+	patch_jumps(body_jumps, body_start);
+}
+
+// Leaves nothing on the stack: jumps when the condition's truthiness is jump_if and
+// falls through otherwise. The jumps are appended to jumps for the caller to patch.
+void Compiler::compile_cond(const Node::Expr& node, bool jump_if, std::vector<size_t>& jumps)
+{
+	const auto* bin_expr = std::get_if<Node::BinExpr>(&node.expr);
+	if (bin_expr && (bin_expr->op == TokenTypes::Operator::AND || bin_expr->op == TokenTypes::Operator::OR))
+	{
+		compile_short_circuit(*bin_expr, jump_if, jumps);
+		return;
+	}
+
+	compile_expr(node);
+	jumps.push_back(m_bytecode.size());
+	push_instr(jump_if ? OpCode::JMP_NONZERO : OpCode::JMP_ZERO, { ValueType::LIT, -1 });
+}
+
+// && and || only evaluate their right operand when the left one doesn't decide
+void Compiler::compile_short_circuit(const Node::BinExpr& node, bool jump_if, std::vector<size_t>& jumps)
+{
+	bool is_and = node.op == TokenTypes::Operator::AND;
+	if (is_and != jump_if)
+	{
+		// && jumping when false, || jumping when true: either operand alone decides
+		compile_cond(*node.lhs, jump_if, jumps);
+		compile_cond(*node.rhs, jump_if, jumps);
+		return;
+	}
 
-	push_instr(OpCode::JMP, { ValueType::LIT, static_cast<int>(cond_start) });
+	std::vector<size_t> decided;
+	compile_cond(*node.lhs, !jump_if, decided);
+	compile_cond(*node.rhs, jump_if, jumps);
+	patch_jumps(decided, m_bytecode.size());
+}
 
-	m_bytecode[idx].val.operand = m_bytecode.size();
+void Compiler::patch_jumps(const std::vector<size_t>& jumps, size_t target)
+{
+	for (size_t idx : jumps)
+		m_bytecode[idx].val.set_operand(target);
 }
 
 void Compiler::compile_ret(const Node::StmtRet& node)
 {
+	if (node.ret_val.has_value() && compile_tail_call(node.ret_val.value()))
+		return;
+
 	if (node.ret_val.has_value())
 		compile_expr(node.ret_val.value());
 
-	push_instr(OpCode::MOV, { ValueType::VAR, -3 }); // bp - 3 [return_val, return_addr, prev_bp, args..]
-													 //           bp - 3 <------------------------ bp
-
-	for (int i = 0; i < m_curr_env->locals.size(); i++)
-		push_instr(OpCode::POP, { ValueType::NOT_REQUIRED, -1 });
+	else
+		push_instr(OpCode::PUSH, { ValueType::NIL, -1 });
 
-	push_instr(OpCode::POP_SF, { ValueType::NOT_REQUIRED, -1 });
+	push_instr(OpCode::RET, { ValueType::NOT_REQUIRED, -1 }); // drops the whole frame
 }
 
 void Compiler::compile_stmt(const Node::Stmt& node)
@@ -236,35 +340,33 @@ void Compiler::compile_struct(const Node::Struct& node)
 		Compiler& compiler;
 		void operator()(const Node::StructFuncDecl& fn_decl)
 		{
-			// now called before evaluating arguments of every call so the bp is in the appropriate slot
-			// compiler.push_instr(OpCode::PUSH_SF, { ValueType::NOT_REQUIRED, -1 });
-			Env* new_env = new Env();
+			// the bp points at the first argument, the frame header lives outside the value stack
+			Env* new_env = &compiler.m_envs.emplace_back();
 			
 			new_env->parent = compiler.m_curr_env;
 			new_env->start = compiler.m_bytecode.size();
-			new_env->stack_idx = new_env->parent->stack_idx + new_env->parent->locals.size() + 3;
-
-			for (int i = 0; i < fn_decl.params.size(); i++)
-			{
-				const auto& param = fn_decl.params[i];
-				new_env->locals.vars[param.id] = i;
-			}
+			new_env->stack_idx = new_env->parent->stack_idx + new_env->parent->locals.size();
 
 			compiler.m_curr_env = new_env;
+			for (const Node::LitIdent& param : fn_decl.params)
+				compiler.declare(compiler.m_vars, new_env->locals.vars, param.id);
 
 			compiler.compile_scope(fn_decl.scope);
-			for (int i = 0; i < new_env->locals.size(); i++)
-				compiler.push_instr(OpCode::POP, { ValueType::NOT_REQUIRED, -1 });
+			compiler.push_instr(OpCode::PUSH, { ValueType::NIL, -1 }); // falling off the end returns NIL
+			compiler.push_instr(OpCode::RET, { ValueType::NOT_REQUIRED, -1 });
+
+			for (const Binding& var : new_env->locals.vars)
+				compiler.m_vars.unbind(var.sym);
+			for (const Binding& func : new_env->locals.funcs)
+				compiler.m_funcs.unbind(func.sym);
 
-			auto parent = new_env->parent;
-			delete new_env;
-			compiler.m_curr_env = parent;
-			compiler.push_instr(OpCode::POP_SF, { ValueType::NOT_REQUIRED, -1 });
+			compiler.m_curr_env = new_env->parent;
+			compiler.m_envs.pop_back();
 		}
 	};
 	std::visit(Visitor{ *this }, node.strct);
 
-	m_bytecode[jmp_idx].val.operand = m_bytecode.size();
+	m_bytecode[jmp_idx].val.set_operand(m_bytecode.size());
 }
 
 void Compiler::compile_expr(const Node::Expr& node)
@@ -274,8 +376,23 @@ void Compiler::compile_expr(const Node::Expr& node)
 		Compiler& compiler;
 		void operator()(const Node::BinExpr& bin_expr)
 		{
-			compiler.compile_expr(*bin_expr.lhs.value());
-			compiler.compile_expr(*bin_expr.rhs.value());
+			// a plain value on the right is as cheap to evaluate as to skip, and can't fail
+			bool logical = bin_expr.op == TokenTypes::Operator::AND || bin_expr.op == TokenTypes::Operator::OR;
+			if (logical && !std::holds_alternative<Node::Lit>(bin_expr.rhs->expr))
+			{
+				std::vector<size_t> false_jumps;
+				compiler.compile_short_circuit(bin_expr, false, false_jumps);
+				compiler.push_instr(OpCode::LOAD_CONST, Value::from_bool(true));
+				size_t end_idx = compiler.m_bytecode.size();
+				compiler.push_instr(OpCode::JMP, { ValueType::LIT, -1 });
+				compiler.patch_jumps(false_jumps, compiler.m_bytecode.size());
+				compiler.push_instr(OpCode::LOAD_CONST, Value::from_bool(false));
+				compiler.m_bytecode[end_idx].val.set_operand(compiler.m_bytecode.size());
+				return;
+			}
+
+			compiler.compile_expr(*bin_expr.lhs);
+			compiler.compile_expr(*bin_expr.rhs);
 
 			switch (bin_expr.op.value())
 			{
@@ -348,20 +465,24 @@ void Compiler::compile_expr(const Node::Expr& node)
 					{
 						// int var_loc = loc - static_cast<int>(compiler.m_curr_env->stack_idx);
 						// Value val = { ValueType::VAR, var_loc };
-						compiler.push_instr(OpCode::PUSH, loc);
+						compiler.push_instr(load_op(loc), loc);
 					}
 
 					else
 					{
-						ERR_EXIT("Undefined variable: \"", ident.id, "\"");
+						ERR_EXIT("Undefined variable: \"", Symbols::name(ident.id), "\"");
 					}
 
 				}
 
 				void operator()(const Node::LitInt& integer)
 				{
-					Value val = { ValueType::LIT, integer.val };
-					compiler.push_instr(OpCode::PUSH, val);
+					compiler.push_instr(OpCode::LOAD_CONST, Value::from_int(integer.val));
+				}
+
+				void operator()(const Node::LitFloat& number)
+				{
+					compiler.push_instr(OpCode::LOAD_CONST, Value::from_double(number.val));
 				}
 			};
 			std::visit(LitVisitor{ compiler }, lit.lit);
@@ -379,40 +500,27 @@ void Compiler::compile_call(const Node::Call& node)
 	struct Visitor
 	{
 		Compiler& compiler;
-		const std::vector<Node::Expr>& args;
+		std::span<const Node::Expr> args;
 		void operator()(const Node::LitIdent& ident)
 		{
 			auto loc = compiler.find_func(ident.id);
 			if (true)
 			{
-				compiler.push_instr(OpCode::PUSH, { ValueType::NIL, -1 }); // return value
-
-				size_t push_idx = compiler.m_bytecode.size();
-				compiler.push_instr(OpCode::PUSH, { ValueType::LIT, -1 }); // return address
-
-				size_t h = compiler.m_bytecode.size();
-				compiler.push_instr(OpCode::PUSH_SF, { ValueType::NOT_REQUIRED, -1 }); // push bp before args
-
 				for (const Node::Expr& arg : args)
 					compiler.compile_expr(arg);
 
 				compiler.print_env(compiler.m_curr_env);
 
-				// int func_loc = loc - static_cast<int>(compiler.m_curr_env->stack_idx);
-				// LOGGER << "SF LOC: " << compiler.m_curr_env->stack_idx << "\n";
-				// LOGGER << "VAR LOC: " << loc << "\n";
-				// LOGGER << "FUNC LOC: " << func_loc << "\n";
-					
-				compiler.push_instr(OpCode::JMP, loc);
-				compiler.m_bytecode[push_idx].val.operand = compiler.m_bytecode.size(); // return address
+				// the args become the first slots of the callee's frame, the return value replaces them
+				compiler.push_instr(OpCode::CALL, loc, static_cast<int>(args.size()));
 			}
 			else
 			{
-				LOGGER << "Warning: Couldn't find function " << "\"" << ident.id << "\"" << std::endl;
+				LOGGER << "Warning: Couldn't find function " << "\"" << Symbols::name(ident.id) << "\"" << std::endl;
 			}
 		}
 
-		void operator()(const Node::StructFuncDecl& func)
+		void operator()(const Node::StructFuncDecl* func)
 		{
 			// currently this uses the current stack frame since it doesn't need an explicit one
 			// once garbage collection is introduce this will be reworked
@@ -421,55 +529,70 @@ void Compiler::compile_call(const Node::Call& node)
 			for (const Node::Expr& arg : args)
 				compiler.compile_expr(arg);
 
-			compiler.compile_scope(func.scope);
+			compiler.compile_scope(func->scope);
 		}
 
 	};
 	std::visit(Visitor{ *this, node.args }, node.fn);
 }
 
-void Compiler::push_instr(OpCode code, Value val)
+// (<- (@@ f (...))) reuses the current frame, so tail recursion runs in constant space
+bool Compiler::compile_tail_call(const Node::Expr& node)
 {
-	m_bytecode.emplace_back(code, val);
-}
+	const auto* call = std::get_if<Node::Call>(&node.expr);
+	if (!call || m_curr_env->parent == nullptr) // only inside a function
+		return false;
 
+	const auto* ident = std::get_if<Node::LitIdent>(&call->fn);
+	if (!ident)
+		return false;
 
-Value Compiler::find_func(const std::string& name)
-{
-	Env* curr = m_curr_env;
+	auto loc = find_func(ident->id);
+	for (const Node::Expr& arg : call->args)
+		compile_expr(arg);
 
-	while (curr)
-	{
-		auto it = curr->locals.funcs.find(name);
-		if (it != curr->locals.funcs.end())
-		{
-			if (curr == m_curr_env) // comparing pointers
-				return { ValueType::VAR, static_cast<int>(curr->stack_idx + it->second - static_cast<int>(m_curr_env->stack_idx)) }; // relative to the current bp
+	push_instr(OpCode::TAILCALL, loc, static_cast<int>(call->args.size()));
+	return true;
+}
 
-			return { ValueType::ABS_VAR, static_cast<int>(curr->stack_idx + it->second) }; // absolute stack index
-		}
+void Compiler::push_instr(OpCode code, Value val, int imm)
+{
+	m_bytecode.emplace_back(code, val, imm);
+}
 
-		curr = curr->parent;
-	}
-	ERR_EXIT("Fatal: couldn't find func with name: ", name);
+// locations returned by find_var/find_func are either relative to the bp or absolute
+OpCode Compiler::load_op(const Value& loc)
+{
+	return loc.is(ValueType::ABS_VAR) ? OpCode::LOAD_GLOBAL : OpCode::LOAD_LOCAL;
 }
 
-Value Compiler::find_var(const std::string& name)
+Value Compiler::find_func(Symbol name)
 {
-	Env* curr = m_curr_env;
+	if (const auto* entry = m_funcs.find(name))
+		return location(*entry);
+	ERR_EXIT("Fatal: couldn't find func with name: ", Symbols::name(name));
+}
 
-	while (curr)
-	{
-		auto it = curr->locals.vars.find(name);
-		if (it != curr->locals.vars.end())
-		{
-			if (curr == m_curr_env) // comparing pointers
-				return { ValueType::VAR, static_cast<int>(curr->stack_idx + it->second - static_cast<int>(m_curr_env->stack_idx)) }; // relative to the current bp
+Value Compiler::find_var(Symbol name)
+{
+	if (const auto* entry = m_vars.find(name))
+		return location(*entry);
+	ERR_EXIT("Fatal: couldn't find variable with name: ", Symbols::name(name));
+}
 
-			return { ValueType::ABS_VAR, static_cast<int>(curr->stack_idx + it->second) }; // absolute stack index
-		}
+// relative to the current bp for names of the function being compiled, absolute otherwise
+Value Compiler::location(const ScopeTable::Entry& entry) const
+{
+	if (entry.env == m_curr_env) // comparing pointers
+		return { ValueType::VAR, static_cast<int>(entry.slot) };
 
-		curr = curr->parent;
-	}
-	ERR_EXIT("Fatal: couldn't find variable with name: ", name);
+	return { ValueType::ABS_VAR, static_cast<int>(entry.env->stack_idx + entry.slot) };
 }
+
+// the next slot of the current Env, shadowing any outer declaration until the Env is left
+void Compiler::declare(ScopeTable& table, std::vector<Binding>& locals, Symbol name)
+{
+	size_t slot = m_curr_env->locals.size();
+	locals.push_back({ name, slot });
+	table.bind(name, m_curr_env, slot);
+}
\ No newline at end of file
@@ -1,15 +1,21 @@
 #pragma once
 
+#include <deque>
+
 #include "Parser.h"
+#include "Value.h"
 
 enum class OpCode
 {
 	MOV, // pop the top of the stack and put it at <operand> location in the stack
 
-	PUSH_SF,
-	POP_SF,
-	PUSH,
+	PUSH, // push <operand> as is (frame bookkeeping: return slot, addresses)
 	POP,
+	RESERVE, // push <operand> NILs at once: the locals of a frame, read only after they were written
+
+	LOAD_LOCAL, // push the value of slot <operand> relative to the bp
+	LOAD_GLOBAL, // push the value of absolute slot <operand>
+	LOAD_CONST, // push the literal <operand>
 
 	ADD,
 	SUB,
@@ -26,26 +32,52 @@ enum class OpCode
 	EQL,
 
 	JMP,
-	JMP_ZERO,
+	JMP_ZERO, // pop a value and jump to <operand> if it is falsy
+	JMP_NONZERO, // pop a value and jump to <operand> if it is truthy
+
+	CALL, // call the function stored at <operand> with the top imm values as its arguments
+	RET, // pop the return value, drop the frame and push the return value for the caller
+	TAILCALL, // like CALL, but the arguments replace the current frame instead of opening a new one
+	MEMO, // entry of a memoized function: returns right away if cache <operand> knows the result for the imm arguments
+	MEMO_RET, // like RET, also putting the return value in cache <operand> for the imm arguments
+
+	// superinstructions, only produced by Fuser
+	ADD_IMM, // add <operand> to the top of the stack
+	ADD_LOCAL_IMM, // push <operand> + imm
+	INC_LOCAL, // add imm to <operand> in place
+	JLT, // pop two values and jump to <operand> if lhs < rhs
+	JGT,
+	JLTE,
+	JGTE,
+	JEQ,
+	JNE,
+	JNLT, // pop two values and jump to <operand> unless lhs < rhs, so NaN jumps
+	JNGT,
+	JNLTE,
+	JNGTE,
+
+	// quickened forms, only written by VM over ADD / SUB / MUL / DIV while running
+	ADD_DBL, // both operands are doubles, anything else turns it back into ADD
+	SUB_DBL,
+	MUL_DBL,
+	DIV_DBL,
 
 	HLT
 };
 
 std::string opcode_to_string(OpCode code);
 
-enum class ValueType
+struct Binding
 {
-	LIT,
-	VAR,
-	ABS_VAR,
-	NIL,
-	NOT_REQUIRED
+	Symbol sym;
+	size_t slot;
 };
 
+// names declared by one function body (or the top level), in declaration order
 struct Locals
 {
-	std::unordered_map<std::string, size_t> vars{};
-	std::unordered_map<std::string, size_t> funcs{};
+	std::vector<Binding> vars{};
+	std::vector<Binding> funcs{};
 
 	size_t size() const
 	{
@@ -61,22 +93,37 @@ struct Env
 	Env* parent;
 };
 
-struct Value
+// Every name visible from the function being compiled, indexed by symbol: the innermost
+// declaration is the last entry, so a lookup is an array access instead of a walk up the
+// Env chain. Entries are popped again when the Env that declared them is left.
+class ScopeTable
 {
-	ValueType v_type;
-	int operand; // some instructions don't require an operand
+public:
+	struct Entry
+	{
+		const Env* env;
+		size_t slot;
+	};
+
+	const Entry* find(Symbol sym) const;
+	void bind(Symbol sym, const Env* env, size_t slot);
+	void unbind(Symbol sym);
+
+private:
+	std::vector<std::vector<Entry>> m_entries;
 };
 
 struct Instr
 {
 	OpCode code;
-	Value val;
+	Value val; // some instructions don't require an operand
+	int imm = 0; // second operand of fused instructions
 };
 
 class Compiler
 {
 public:
-	Compiler(std::vector<Node::Node>& nodes);
+	Compiler(const std::vector<Node::Node>& nodes);
 	std::vector<Instr> compile_prog();
 	void compile_node(const Node::Node& node);
 	void compile_asgn(const Node::StmtAsgn& node);
@@ -89,16 +136,28 @@ public:
 	void compile_struct(const Node::Struct& node);
 
 	void compile_expr(const Node::Expr& node);
+	void compile_cond(const Node::Expr& node, bool jump_if, std::vector<size_t>& jumps);
+	void compile_short_circuit(const Node::BinExpr& node, bool jump_if, std::vector<size_t>& jumps);
 	void compile_call(const Node::Call& node);
+	bool compile_tail_call(const Node::Expr& node);
+
+	std::unordered_map<std::string, size_t> globals() const; // variable name -> slot
 
 private:
 	void print_env(const Env* env, int depth = 0);
-	void push_instr(OpCode code, Value val);
-	Value find_func(const std::string& name);
-	Value find_var(const std::string& name);
+	void push_instr(OpCode code, Value val, int imm = 0);
+	void patch_jumps(const std::vector<size_t>& jumps, size_t target);
+	static OpCode load_op(const Value& loc);
+	Value find_func(Symbol name);
+	Value find_var(Symbol name);
+	Value location(const ScopeTable::Entry& entry) const;
+	void declare(ScopeTable& table, std::vector<Binding>& locals, Symbol name);
 
 private:
-	const std::vector<Node::Node> m_nodes;
+	const std::vector<Node::Node>& m_nodes;
 	std::vector<Instr> m_bytecode;
+	std::deque<Env> m_envs; // function bodies nest, so Envs come and go in stack order
 	Env* m_curr_env;
-};
+	ScopeTable m_vars;
+	ScopeTable m_funcs;
+};
\ No newline at end of file
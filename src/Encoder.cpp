@@ -0,0 +1,217 @@
+#include "Encoder.h"
+
+static_assert(static_cast<size_t>(OpCode::HLT) < 256, "opcodes must fit in one byte");
+
+static bool has_target(OpCode code)
+{
+	switch (code)
+	{
+		case OpCode::JMP:
+		case OpCode::JMP_ZERO:
+		case OpCode::JMP_NONZERO:
+		case OpCode::JLT:
+		case OpCode::JGT:
+		case OpCode::JLTE:
+		case OpCode::JGTE:
+		case OpCode::JEQ:
+		case OpCode::JNE:
+		case OpCode::JNLT:
+		case OpCode::JNGT:
+		case OpCode::JNLTE:
+		case OpCode::JNGTE:
+			return true;
+
+		default:
+			return false;
+	}
+}
+
+Encoder::Encoder(const std::vector<Instr>& bytecode) : m_bytecode(bytecode) {}
+
+std::vector<uint8_t> Encoder::encode()
+{
+	m_offsets.reserve(m_bytecode.size() + 1);
+	for (const Instr& instr : m_bytecode)
+	{
+		m_offsets.push_back(m_code.size());
+		emit(instr);
+	}
+	m_offsets.push_back(m_code.size());
+	patch();
+
+	LOGGER << "Encoded " << m_bytecode.size() << " instructions into " << m_code.size() << " bytes" << std::endl;
+	return std::move(m_code);
+}
+
+void Encoder::emit(const Instr& instr)
+{
+	// any constant that isn't an integer is pushed as a raw value
+	OpCode code = instr.code == OpCode::LOAD_CONST && !instr.val.is_int() ? OpCode::PUSH : instr.code;
+	m_code.push_back(static_cast<uint8_t>(code));
+
+	if (has_target(code))
+	{
+		m_targets.emplace_back(m_code.size(), instr.val.operand());
+		write_u32(0);
+		return;
+	}
+
+	switch (code)
+	{
+		case OpCode::MOV:
+		case OpCode::LOAD_LOCAL:
+			write_sleb(instr.val.operand());
+			break;
+
+		case OpCode::LOAD_GLOBAL:
+		case OpCode::RESERVE:
+			write_uleb(instr.val.operand());
+			break;
+
+		case OpCode::LOAD_CONST:
+		case OpCode::ADD_IMM:
+			write_sleb(instr.val.operand());
+			break;
+
+		case OpCode::PUSH:
+			if (instr.val.is(ValueType::ADDR))
+				m_addrs.emplace_back(m_code.size(), instr.val.operand());
+			write_value(instr.val);
+			break;
+
+		case OpCode::CALL:
+		case OpCode::TAILCALL:
+			write_sleb(instr.val.operand() * 2 + instr.val.is(ValueType::ABS_VAR));
+			write_uleb(instr.imm);
+			break;
+
+		case OpCode::MEMO:
+		case OpCode::MEMO_RET:
+			write_uleb(instr.val.operand());
+			write_uleb(instr.imm);
+			break;
+
+		case OpCode::ADD_LOCAL_IMM:
+		case OpCode::INC_LOCAL:
+			write_sleb(instr.val.operand());
+			write_sleb(instr.imm);
+			break;
+
+		default:
+			break;
+	}
+}
+
+// jump targets and function addresses were emitted as instruction indices
+void Encoder::patch()
+{
+	for (const auto& [pos, target] : m_targets)
+	{
+		uint32_t offset = static_cast<uint32_t>(m_offsets[target]);
+		std::memcpy(m_code.data() + pos, &offset, sizeof(offset));
+	}
+
+	for (const auto& [pos, target] : m_addrs)
+	{
+		uint64_t bits = Value(ValueType::ADDR, m_offsets[target]).bits();
+		std::memcpy(m_code.data() + pos, &bits, sizeof(bits));
+	}
+}
+
+void Encoder::write_uleb(uint64_t val)
+{
+	do
+	{
+		uint8_t byte = val & 0x7F;
+		val >>= 7;
+		m_code.push_back(val ? byte | 0x80 : byte);
+	} while (val);
+}
+
+void Encoder::write_sleb(int64_t val)
+{
+	bool more = true;
+	while (more)
+	{
+		uint8_t byte = val & 0x7F;
+		val >>= 7;
+		more = !((val == 0 && !(byte & 0x40)) || (val == -1 && (byte & 0x40)));
+		m_code.push_back(more ? byte | 0x80 : byte);
+	}
+}
+
+void Encoder::write_u32(uint32_t val)
+{
+	uint8_t bytes[sizeof(val)];
+	std::memcpy(bytes, &val, sizeof(val));
+	m_code.insert(m_code.end(), bytes, bytes + sizeof(bytes));
+}
+
+void Encoder::write_value(Value val)
+{
+	uint64_t bits = val.bits();
+	uint8_t bytes[sizeof(bits)];
+	std::memcpy(bytes, &bits, sizeof(bits));
+	m_code.insert(m_code.end(), bytes, bytes + sizeof(bytes));
+}
+
+Instr decode_instr(const std::vector<uint8_t>& code, size_t& pos)
+{
+	const uint8_t* ip = code.data() + pos;
+	Instr instr{ static_cast<OpCode>(*ip++), { ValueType::NOT_REQUIRED, -1 } };
+
+	if (has_target(instr.code))
+		instr.val = { ValueType::LIT, read_u32(ip) };
+
+	switch (instr.code)
+	{
+		case OpCode::MOV:
+		case OpCode::LOAD_LOCAL:
+			instr.val = { ValueType::VAR, read_sleb(ip) };
+			break;
+
+		case OpCode::LOAD_GLOBAL:
+			instr.val = { ValueType::ABS_VAR, static_cast<int64_t>(read_uleb(ip)) };
+			break;
+
+		case OpCode::RESERVE:
+			instr.val = { ValueType::LIT, static_cast<int64_t>(read_uleb(ip)) };
+			break;
+
+		case OpCode::LOAD_CONST:
+		case OpCode::ADD_IMM:
+			instr.val = { ValueType::LIT, read_sleb(ip) };
+			break;
+
+		case OpCode::PUSH:
+			instr.val = read_value(ip);
+			break;
+
+		case OpCode::CALL:
+		case OpCode::TAILCALL:
+		{
+			int64_t callee = read_sleb(ip);
+			instr.val = { callee & 1 ? ValueType::ABS_VAR : ValueType::VAR, callee >> 1 };
+			instr.imm = static_cast<int>(read_uleb(ip));
+			break;
+		}
+
+		case OpCode::MEMO:
+		case OpCode::MEMO_RET:
+			instr.val = { ValueType::LIT, static_cast<int64_t>(read_uleb(ip)) };
+			instr.imm = static_cast<int>(read_uleb(ip));
+			break;
+
+		case OpCode::ADD_LOCAL_IMM:
+		case OpCode::INC_LOCAL:
+			instr.val = { ValueType::VAR, read_sleb(ip) };
+			instr.imm = static_cast<int>(read_sleb(ip));
+			break;
+
+		default:
+			break;
+	}
+
+	pos = ip - code.data();
+	return instr;
+}
\ No newline at end of file
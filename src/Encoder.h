@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstring>
+
+#include "Compiler.h"
+
+// Dense byte-stream form of the stack bytecode that VM executes. Every instruction
+// is a one-byte OpCode followed only by the operands it needs:
+//
+//   slot       LEB128, signed for bp-relative slots and unsigned for absolute ones
+//   integer    signed LEB128 (LOAD_CONST, ADD_IMM and the imm of the local superinstructions)
+//   target     4-byte little-endian byte offset, fixed width so jumps can be patched in place
+//   value      8 raw bytes of a Value (PUSH, and LOAD_CONST of anything but an integer)
+//   callee     signed LEB128 of slot * 2 + is_absolute, then the argument count as unsigned LEB128
+//
+// Code addresses (jump targets, ADDR values, return addresses) are byte offsets.
+class Encoder
+{
+public:
+	Encoder(const std::vector<Instr>& bytecode);
+	std::vector<uint8_t> encode();
+
+private:
+	void emit(const Instr& instr);
+	void patch();
+
+	void write_uleb(uint64_t val);
+	void write_sleb(int64_t val);
+	void write_u32(uint32_t val);
+	void write_value(Value val);
+
+private:
+	const std::vector<Instr>& m_bytecode;
+	std::vector<uint8_t> m_code;
+	std::vector<size_t> m_offsets; // instruction index -> byte offset
+	std::vector<std::pair<size_t, size_t>> m_targets; // byte position of a target operand, instruction it refers to
+	std::vector<std::pair<size_t, size_t>> m_addrs; // byte position of an ADDR value, instruction it refers to
+};
+
+// decodes the instruction at pos and advances pos past it, for disassembly
+Instr decode_instr(const std::vector<uint8_t>& code, size_t& pos);
+
+// slots, argument counts and most immediates fit in a single byte, so that case skips the loop
+inline uint64_t read_uleb(const uint8_t*& ip)
+{
+	uint8_t byte = *ip++;
+	if (!(byte & 0x80)) [[likely]]
+		return byte;
+
+	uint64_t res = byte & 0x7F;
+	int shift = 7;
+	do
+	{
+		byte = *ip++;
+		res |= static_cast<uint64_t>(byte & 0x7F) << shift;
+		shift += 7;
+	} while (byte & 0x80);
+	return res;
+}
+
+inline int64_t read_sleb(const uint8_t*& ip)
+{
+	uint8_t byte = *ip++;
+	if (!(byte & 0x80)) [[likely]]
+		return static_cast<int8_t>(byte << 1) >> 1;
+
+	uint64_t res = byte & 0x7F;
+	int shift = 7;
+	do
+	{
+		byte = *ip++;
+		res |= static_cast<uint64_t>(byte & 0x7F) << shift;
+		shift += 7;
+	} while (byte & 0x80);
+
+	if (shift < 64 && (byte & 0x40))
+		res |= ~uint64_t{ 0 } << shift;
+	return static_cast<int64_t>(res);
+}
+
+inline uint32_t read_u32(const uint8_t*& ip)
+{
+	uint32_t res;
+	std::memcpy(&res, ip, sizeof(res));
+	ip += sizeof(res);
+	return res;
+}
+
+inline Value read_value(const uint8_t*& ip)
+{
+	uint64_t bits;
+	std::memcpy(&bits, ip, sizeof(bits));
+	ip += sizeof(bits);
+	return Value::from_bits(bits);
+}
\ No newline at end of file
@@ -0,0 +1,144 @@
+#include "Fuser.h"
+
+#include <climits>
+#include <cstdlib>
+
+static bool is_jump(OpCode code)
+{
+	switch (code)
+	{
+		case OpCode::JMP:
+		case OpCode::JMP_ZERO:
+		case OpCode::JMP_NONZERO:
+		case OpCode::JLT:
+		case OpCode::JGT:
+		case OpCode::JLTE:
+		case OpCode::JGTE:
+		case OpCode::JEQ:
+		case OpCode::JNE:
+		case OpCode::JNLT:
+		case OpCode::JNGT:
+		case OpCode::JNLTE:
+		case OpCode::JNGTE:
+			return true;
+
+		default:
+			return false;
+	}
+}
+
+// comparison followed by JMP_ZERO -> branch taken when the comparison is false
+static std::optional<OpCode> negated_branch(OpCode code)
+{
+	switch (code)
+	{
+		case OpCode::LT: return OpCode::JNLT;
+		case OpCode::GT: return OpCode::JNGT;
+		case OpCode::LTE: return OpCode::JNLTE;
+		case OpCode::GTE: return OpCode::JNGTE;
+		case OpCode::EQL: return OpCode::JNE;
+		default: return {};
+	}
+}
+
+// comparison followed by JMP_NONZERO -> branch taken when the comparison holds
+static std::optional<OpCode> direct_branch(OpCode code)
+{
+	switch (code)
+	{
+		case OpCode::LT: return OpCode::JLT;
+		case OpCode::GT: return OpCode::JGT;
+		case OpCode::LTE: return OpCode::JLTE;
+		case OpCode::GTE: return OpCode::JGTE;
+		case OpCode::EQL: return OpCode::JEQ;
+		default: return {};
+	}
+}
+
+Fuser::Fuser(std::vector<Instr>& bytecode) : m_bytecode(std::move(bytecode)) {}
+
+std::vector<Instr> Fuser::fuse()
+{
+	mark_targets();
+
+	m_new_idx.resize(m_bytecode.size() + 1);
+	for (size_t i = 0; i < m_bytecode.size(); i++)
+	{
+		m_new_idx[i] = m_fused.size();
+		emit(m_bytecode[i], m_is_target[i]);
+	}
+	m_new_idx[m_bytecode.size()] = m_fused.size();
+
+	remap();
+
+	LOGGER << "Fused " << m_bytecode.size() << " instructions into " << m_fused.size() << std::endl;
+	return m_fused;
+}
+
+void Fuser::mark_targets()
+{
+	m_is_target.assign(m_bytecode.size() + 1, false);
+	for (const Instr& instr : m_bytecode)
+	{
+		if ((is_jump(instr.code) && instr.val.is(ValueType::LIT)) || instr.val.is(ValueType::ADDR))
+			m_is_target[instr.val.operand()] = true;
+	}
+}
+
+void Fuser::emit(const Instr& instr, bool is_target)
+{
+	m_fused.push_back(instr);
+	m_fused_is_target.push_back(is_target);
+	while (reduce());
+}
+
+// tries to merge the last fused instruction into the one before it,
+// which is only allowed when nothing jumps between the two
+bool Fuser::reduce()
+{
+	size_t n = m_fused.size();
+	if (n < 2 || m_fused_is_target[n - 1])
+		return false;
+
+	Instr& prev = m_fused[n - 2];
+	const Instr& last = m_fused[n - 1];
+	std::optional<Instr> merged{};
+
+	// only integer constants that also fit the int imm field become immediates
+	if (prev.code == OpCode::LOAD_CONST && prev.val.is_int() && std::abs(prev.val.operand()) <= INT_MAX &&
+		(last.code == OpCode::ADD || last.code == OpCode::SUB))
+	{
+		int64_t imm = last.code == OpCode::ADD ? prev.val.operand() : -prev.val.operand();
+		merged = Instr{ OpCode::ADD_IMM, { ValueType::LIT, imm } };
+	}
+
+	else if (prev.code == OpCode::LOAD_LOCAL && last.code == OpCode::ADD_IMM)
+		merged = Instr{ OpCode::ADD_LOCAL_IMM, prev.val, static_cast<int>(last.val.operand()) };
+
+	else if (prev.code == OpCode::ADD_LOCAL_IMM && last.code == OpCode::MOV &&
+		last.val.is(ValueType::VAR) && last.val.operand() == prev.val.operand())
+		merged = Instr{ OpCode::INC_LOCAL, prev.val, prev.imm };
+
+	else if (auto branch = negated_branch(prev.code); branch.has_value() && last.code == OpCode::JMP_ZERO)
+		merged = Instr{ branch.value(), last.val };
+
+	else if (auto branch = direct_branch(prev.code); branch.has_value() && last.code == OpCode::JMP_NONZERO)
+		merged = Instr{ branch.value(), last.val };
+
+	if (!merged.has_value())
+		return false;
+
+	m_fused.pop_back();
+	m_fused_is_target.pop_back();
+	m_fused.back() = merged.value();
+	return true;
+}
+
+void Fuser::remap()
+{
+	for (Instr& instr : m_fused)
+	{
+		if ((is_jump(instr.code) && instr.val.is(ValueType::LIT)) || instr.val.is(ValueType::ADDR))
+			instr.val.set_operand(m_new_idx[instr.val.operand()]);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "Compiler.h"
+
+// Rewrites common instruction sequences emitted by Compiler into superinstructions
+// and remaps every jump target and code address accordingly.
+class Fuser
+{
+public:
+	Fuser(std::vector<Instr>& bytecode);
+	std::vector<Instr> fuse();
+
+private:
+	void mark_targets();
+	void emit(const Instr& instr, bool is_target);
+	bool reduce();
+	void remap();
+
+private:
+	const std::vector<Instr> m_bytecode;
+	std::vector<bool> m_is_target; // indexed by original instruction
+	std::vector<size_t> m_new_idx; // original index -> fused index
+	std::vector<Instr> m_fused;
+	std::vector<bool> m_fused_is_target; // fused instruction starts at a jump target
+};
\ No newline at end of file
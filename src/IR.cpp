@@ -0,0 +1,314 @@
+#include "IR.h"
+#include "Utils.h"
+
+#include <algorithm>
+
+namespace IR
+{
+	int Function::add_block()
+	{
+		blocks.emplace_back();
+		return static_cast<int>(blocks.size() - 1);
+	}
+
+	int Function::add(int block, Inst inst)
+	{
+		inst.block = block;
+		insts.push_back(std::move(inst));
+		int id = static_cast<int>(insts.size() - 1);
+		blocks[block].insts.push_back(id);
+
+		const Inst& added = insts[id];
+		for (int i = 0; i < 2 && added.targets[i] >= 0; i++)
+			blocks[added.targets[i]].preds.push_back(block);
+		return id;
+	}
+
+	int Function::insert(int block, size_t pos, Inst inst)
+	{
+		inst.block = block;
+		insts.push_back(std::move(inst));
+		int id = static_cast<int>(insts.size() - 1);
+		blocks[block].insts.insert(blocks[block].insts.begin() + pos, id);
+		return id;
+	}
+
+	// arguments are filled in by the caller, one per predecessor
+	int Function::add_phi(int block)
+	{
+		insts.push_back(Inst{ Op::PHI });
+		int id = static_cast<int>(insts.size() - 1);
+		insts[id].block = block;
+		blocks[block].phis.push_back(id);
+		return id;
+	}
+
+	bool Function::is_terminated(int block) const
+	{
+		const std::vector<int>& body = blocks[block].insts;
+		return !body.empty() && is_terminator(insts[body.back()].op);
+	}
+
+	std::vector<int> Function::succs(int block) const
+	{
+		if (!is_terminated(block))
+			return {};
+
+		const Inst& term = insts[blocks[block].insts.back()];
+		std::vector<int> res;
+		for (int i = 0; i < 2 && term.targets[i] >= 0; i++)
+			res.push_back(term.targets[i]);
+		return res;
+	}
+
+	void Function::replace_uses(int from, int to)
+	{
+		for (Inst& inst : insts)
+		{
+			if (inst.dead)
+				continue;
+			std::replace(inst.args.begin(), inst.args.end(), from, to);
+		}
+	}
+
+	void Function::remove_pred(int block, int pred)
+	{
+		std::vector<int>& preds = blocks[block].preds;
+		auto it = std::find(preds.begin(), preds.end(), pred);
+		if (it == preds.end())
+			return;
+
+		size_t idx = it - preds.begin();
+		preds.erase(it);
+		for (int phi : blocks[block].phis)
+			insts[phi].args.erase(insts[phi].args.begin() + idx);
+	}
+
+	void Function::kill(int inst)
+	{
+		Inst& killed = insts[inst];
+		if (killed.dead)
+			return;
+
+		killed.dead = true;
+		std::vector<int>& list = killed.op == Op::PHI ? blocks[killed.block].phis : blocks[killed.block].insts;
+		list.erase(std::remove(list.begin(), list.end(), inst), list.end());
+	}
+
+	std::vector<std::vector<int>> Function::users() const
+	{
+		std::vector<std::vector<int>> res(insts.size());
+		for (size_t i = 0; i < insts.size(); i++)
+		{
+			if (insts[i].dead)
+				continue;
+			for (int arg : insts[i].args)
+				res[arg].push_back(static_cast<int>(i));
+		}
+		return res;
+	}
+
+	size_t Function::size() const
+	{
+		return std::count_if(insts.begin(), insts.end(), [](const Inst& inst) { return !inst.dead; });
+	}
+
+	bool is_binary(Op op)
+	{
+		return op >= Op::ADD && op <= Op::EQL;
+	}
+
+	bool is_terminator(Op op)
+	{
+		return op >= Op::JMP;
+	}
+
+	// results that are numbers no matter what flows in
+	static bool is_number(const Function& func, int value)
+	{
+		const Inst& inst = func.insts[value];
+		if (inst.op == Op::CONST)
+			return inst.imm.is_number();
+		if (inst.op == Op::PHI)
+			return inst.number;
+		return is_binary(inst.op);
+	}
+
+	static bool is_int(const Function& func, int value)
+	{
+		const Inst& inst = func.insts[value];
+		if (inst.op == Op::CONST)
+			return inst.imm.is_int();
+		return inst.op >= Op::BW_OR && inst.op <= Op::EQL; // bitwise, logical and comparisons give integers
+	}
+
+	bool is_removable(const Function& func, const Inst& inst)
+	{
+		switch (inst.op)
+		{
+			case Op::PARAM:
+			case Op::CONST:
+			case Op::FUNC:
+			case Op::LOAD_GLOBAL:
+			case Op::COPY:
+			case Op::PHI:
+			case Op::OR:
+			case Op::AND:
+			case Op::EQL:
+				return true;
+
+			// type errors are only impossible on numbers
+			case Op::ADD:
+			case Op::SUB:
+			case Op::MUL:
+			case Op::LT:
+			case Op::GT:
+			case Op::GTE:
+			case Op::LTE:
+				return is_number(func, inst.args[0]) && is_number(func, inst.args[1]);
+
+			case Op::DIV:
+			{
+				const Inst& rhs = func.insts[inst.args[1]];
+				return is_number(func, inst.args[0]) && rhs.op == Op::CONST && rhs.imm.is_number() && rhs.imm.to_double() != 0.0;
+			}
+
+			case Op::BW_OR:
+			case Op::BW_AND:
+				return is_int(func, inst.args[0]) && is_int(func, inst.args[1]);
+
+			default:
+				return false;
+		}
+	}
+
+	// optimistic: every PHI starts out as a number until one of its inputs may not be,
+	// so loops carrying numbers around are recognized
+	void infer_numbers(Function& func)
+	{
+		std::vector<int> phis;
+		for (const Block& block : func.blocks)
+		{
+			if (block.dead)
+				continue;
+			for (int phi : block.phis)
+			{
+				func.insts[phi].number = true;
+				phis.push_back(phi);
+			}
+		}
+
+		bool changed = true;
+		while (changed)
+		{
+			changed = false;
+			for (int phi : phis)
+			{
+				Inst& inst = func.insts[phi];
+				if (inst.number && !std::all_of(inst.args.begin(), inst.args.end(), [&](int arg) { return is_number(func, arg); }))
+				{
+					inst.number = false;
+					changed = true;
+				}
+			}
+		}
+	}
+
+	std::string op_to_string(Op op)
+	{
+		switch (op)
+		{
+			case Op::PARAM: return "param";
+			case Op::CONST: return "const";
+			case Op::FUNC: return "func";
+			case Op::LOAD_GLOBAL: return "load_global";
+			case Op::STORE_GLOBAL: return "store_global";
+			case Op::COPY: return "copy";
+			case Op::PHI: return "phi";
+			case Op::ADD: return "add";
+			case Op::SUB: return "sub";
+			case Op::MUL: return "mul";
+			case Op::DIV: return "div";
+			case Op::BW_OR: return "bw_or";
+			case Op::BW_AND: return "bw_and";
+			case Op::OR: return "or";
+			case Op::AND: return "and";
+			case Op::LT: return "lt";
+			case Op::GT: return "gt";
+			case Op::GTE: return "gte";
+			case Op::LTE: return "lte";
+			case Op::EQL: return "eql";
+			case Op::CALL: return "call";
+			case Op::JMP: return "jmp";
+			case Op::BRANCH: return "br";
+			case Op::RET: return "ret";
+			case Op::TAILCALL: return "tailcall";
+			case Op::HLT: return "hlt";
+			default: return "unknown";
+		}
+	}
+
+	static void print_inst(const Function& func, int id, std::ostream& out)
+	{
+		const Inst& inst = func.insts[id];
+		out << "    ";
+		if (!is_terminator(inst.op) && inst.op != Op::STORE_GLOBAL)
+			out << "v" << id << " = ";
+		out << op_to_string(inst.op);
+
+		switch (inst.op)
+		{
+			case Op::CONST: out << " " << format_value(inst.imm); break;
+			case Op::PARAM: out << " " << inst.index; break;
+			case Op::FUNC: out << " @" << inst.index; break;
+			case Op::LOAD_GLOBAL:
+			case Op::STORE_GLOBAL: out << " g" << inst.index; break;
+			default: break;
+		}
+
+		for (size_t i = 0; i < inst.args.size(); i++)
+		{
+			out << (i == 0 && inst.op != Op::STORE_GLOBAL ? " " : ", ") << "v" << inst.args[i];
+			if (inst.op == Op::PHI)
+				out << " [b" << func.blocks[inst.block].preds[i] << "]";
+		}
+
+		for (int i = 0; i < 2 && inst.targets[i] >= 0; i++)
+			out << (i == 0 && inst.args.empty() ? " " : ", ") << "b" << inst.targets[i];
+		out << "\n";
+	}
+
+	void print(const Function& func, std::ostream& out)
+	{
+		out << "fn " << func.name << "(" << func.params << ")" << (func.memoize ? " memo" : "") << ":\n";
+		for (size_t b = 0; b < func.blocks.size(); b++)
+		{
+			const Block& block = func.blocks[b];
+			if (block.dead)
+				continue;
+
+			out << "  b" << b << ":";
+			if (!block.preds.empty())
+			{
+				out << " ; preds";
+				for (int pred : block.preds)
+					out << " b" << pred;
+			}
+			out << "\n";
+
+			for (int phi : block.phis)
+				print_inst(func, phi, out);
+			for (int inst : block.insts)
+				print_inst(func, inst, out);
+		}
+	}
+
+	void print(const Module& module, std::ostream& out)
+	{
+		for (size_t i = 0; i < module.funcs.size(); i++)
+		{
+			out << "@" << i << " ";
+			print(module.funcs[i], out);
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <ostream>
+
+#include "Value.h"
+
+// Mid-level SSA representation between the AST and the stack bytecode, built by
+// IRBuilder, transformed by the passes in IRPasses and turned back into OpCodes by
+// IRLowering.
+//
+// Every instruction defines at most one value, identified by its index in
+// Function::insts. Variables local to a function are plain SSA values joined by PHIs.
+// Globals (variables of the top level) live in stack slots instead: functions read
+// them as absolute slots, and only top-level code ever writes them.
+namespace IR
+{
+	enum class Op
+	{
+		PARAM, // index: argument number
+		CONST, // imm
+		FUNC, // address of function <index>
+		LOAD_GLOBAL, // index: global slot
+		STORE_GLOBAL, // index: global slot, args[0]: value
+		COPY, // args[0], emitted for every local assignment and removed by copy propagation
+		PHI, // one argument per predecessor, in Block::preds order
+
+		ADD,
+		SUB,
+		MUL,
+		DIV,
+		BW_OR,
+		BW_AND,
+		OR,
+		AND,
+		LT,
+		GT,
+		GTE,
+		LTE,
+		EQL,
+
+		CALL, // args[0]: callee, then the arguments
+
+		// terminators, always the last instruction of a block
+		JMP, // targets[0]
+		BRANCH, // args[0]: condition, targets[0] when truthy, targets[1] otherwise
+		RET, // args[0]
+		TAILCALL, // like CALL
+		HLT,
+	};
+
+	struct Inst
+	{
+		Op op;
+		std::vector<int> args{};
+		Value imm{ ValueType::NIL, -1 };
+		int index = -1;
+		int targets[2] = { -1, -1 };
+		int block = -1;
+		bool dead = false;
+		bool number = false; // PHI whose inputs are all numbers, see infer_numbers
+	};
+
+	struct Block
+	{
+		std::vector<int> phis;
+		std::vector<int> insts; // ends with a terminator once the block is complete
+		std::vector<int> preds;
+		bool dead = false;
+	};
+
+	struct Function
+	{
+		std::string name;
+		size_t params = 0;
+		bool top_level = false;
+		bool memoize = false; // results cached by argument values, asked for with @$ or found by IRPasses::memoize
+		std::vector<Inst> insts;
+		std::vector<Block> blocks; // blocks[0] is the entry
+		std::vector<int> layout; // order the blocks are emitted in, source order as built but loop tests after the body
+
+		int add_block();
+		int add(int block, Inst inst); // appends to the block, returns the value
+		int insert(int block, size_t pos, Inst inst); // at pos in the block's instructions, for code built after the fact
+		int add_phi(int block);
+
+		bool is_terminated(int block) const;
+		std::vector<int> succs(int block) const;
+
+		void replace_uses(int from, int to);
+		void remove_pred(int block, int pred); // also drops the matching PHI arguments
+		void kill(int inst); // unlinks from its block
+
+		std::vector<std::vector<int>> users() const; // value -> instructions using it, with repeats
+		size_t size() const; // live instructions
+	};
+
+	struct Module
+	{
+		std::vector<Function> funcs; // funcs[0] is the top level
+		std::unordered_map<std::string, size_t> globals; // variable name -> slot
+		size_t global_slots = 0; // variables and functions of the top level
+	};
+
+	bool is_binary(Op op);
+	bool is_terminator(Op op);
+
+	// pure and can't raise an error, so removing it is always allowed
+	bool is_removable(const Function& func, const Inst& inst);
+
+	// marks the PHIs that only ever see numbers, which makes arithmetic on them removable
+	void infer_numbers(Function& func);
+
+	std::string op_to_string(Op op);
+	void print(const Module& module, std::ostream& out);
+	void print(const Function& func, std::ostream& out);
+}
\ No newline at end of file
@@ -0,0 +1,504 @@
+#include "IRBuilder.h"
+
+#include <algorithm>
+
+IRBuilder::Key IRBuilder::var_key(Symbol name)
+{
+	return static_cast<Key>(name) << 1;
+}
+
+IRBuilder::Key IRBuilder::func_key(Symbol name)
+{
+	return (static_cast<Key>(name) << 1) | 1;
+}
+
+IRBuilder::IRBuilder(const std::vector<Node::Node>& nodes) : m_nodes(nodes) {}
+
+std::optional<IR::Module> IRBuilder::build()
+{
+	m_module.funcs.emplace_back();
+	m_module.funcs[0].name = "main";
+	m_module.funcs[0].top_level = true;
+
+	FuncState state{ 0, -1 };
+	m_state = &state;
+	start_block(new_block(true));
+
+	for (const Node::Node& node : m_nodes)
+	{
+		if (const auto* stmt = std::get_if<Node::Stmt>(&node.node))
+			build_stmt(*stmt);
+
+		else if (const auto* expr = std::get_if<Node::Expr>(&node.node))
+			build_expr(*expr); // the value is dropped
+
+		else if (const auto* scope = std::get_if<Node::Scope>(&node.node))
+			build_stmts(scope->stmts);
+
+		else
+			unsupported("function literal outside an assignment");
+	}
+	emit({ IR::Op::HLT });
+	m_state = nullptr;
+
+	if (!m_supported)
+		return {};
+
+	for (const auto& [key, slot] : m_global_slots)
+	{
+		if ((key & 1) == 0) // variables, not functions
+			m_module.globals[Symbols::name(static_cast<Symbol>(key >> 1))] = slot;
+	}
+	m_module.global_slots = m_global_slots.size();
+	return std::move(m_module);
+}
+
+IR::Function& IRBuilder::func()
+{
+	return m_module.funcs[m_state->func];
+}
+
+int IRBuilder::emit(IR::Inst inst)
+{
+	return func().add(m_state->block, std::move(inst));
+}
+
+int IRBuilder::emit_const(Value val)
+{
+	IR::Inst inst{ IR::Op::CONST };
+	inst.imm = val;
+	return emit(std::move(inst));
+}
+
+void IRBuilder::start_block(int block)
+{
+	m_state->block = block;
+	func().layout.push_back(block);
+}
+
+// a sealed block has all of its predecessors already
+int IRBuilder::new_block(bool sealed)
+{
+	int block = func().add_block();
+	if (sealed)
+		m_state->sealed.insert(block);
+	return block;
+}
+
+void IRBuilder::seal(int block)
+{
+	for (const auto& [key, phi] : m_state->incomplete[block])
+		add_phi_operands(key, phi);
+
+	m_state->incomplete.erase(block);
+	m_state->sealed.insert(block);
+}
+
+void IRBuilder::write_var(Key key, int block, int value)
+{
+	m_state->defs[block][key] = value;
+}
+
+int IRBuilder::read_var(Key key, int block)
+{
+	auto& defs = m_state->defs[block];
+	if (auto it = defs.find(key); it != defs.end())
+		return it->second;
+	return read_var_recursive(key, block);
+}
+
+int IRBuilder::read_var_recursive(Key key, int block)
+{
+	IR::Function& fn = func();
+	int val;
+	if (!m_state->sealed.contains(block))
+	{
+		val = fn.add_phi(block);
+		m_state->incomplete[block].emplace_back(key, val);
+	}
+	else if (fn.blocks[block].preds.size() == 1)
+		val = read_var(key, fn.blocks[block].preds[0]);
+
+	else if (fn.blocks[block].preds.empty())
+	{
+		// unreachable, or assigned only in a branch that didn't run: Compiler leaves
+		// whatever was in the slot, NIL is as good as anything
+		IR::Inst undef{ IR::Op::CONST };
+		undef.block = block;
+		fn.insts.push_back(undef);
+		val = static_cast<int>(fn.insts.size() - 1);
+		fn.blocks[block].insts.insert(fn.blocks[block].insts.begin(), val);
+	}
+	else
+	{
+		// written first so a loop reading the variable back finds the PHI instead of recursing
+		val = fn.add_phi(block);
+		write_var(key, block, val);
+		add_phi_operands(key, val);
+	}
+
+	write_var(key, block, val);
+	return val;
+}
+
+// trivial PHIs (all operands the same) are left for copy propagation
+void IRBuilder::add_phi_operands(Key key, int phi)
+{
+	int block = func().insts[phi].block;
+	std::vector<int> preds = func().blocks[block].preds;
+	for (int pred : preds)
+	{
+		int val = read_var(key, pred);
+		func().insts[phi].args.push_back(val);
+	}
+}
+
+int IRBuilder::declare_global(Key key)
+{
+	auto [it, inserted] = m_global_slots.try_emplace(key, m_global_slots.size());
+	return static_cast<int>(it->second);
+}
+
+int IRBuilder::resolve(Symbol name, bool is_func)
+{
+	Key key = is_func ? func_key(name) : var_key(name);
+	if (m_state->parent && m_state->declared.contains(key))
+		return read_var(key, m_state->block);
+
+	for (FuncState* outer = m_state->parent; outer && outer->parent; outer = outer->parent)
+	{
+		if (outer->declared.contains(key))
+		{
+			unsupported("reference to a local of an enclosing function: " + Symbols::name(name));
+			return emit_const({ ValueType::NIL, -1 });
+		}
+	}
+
+	if (auto it = m_global_slots.find(key); it != m_global_slots.end())
+	{
+		IR::Inst load{ IR::Op::LOAD_GLOBAL };
+		load.index = static_cast<int>(it->second);
+		return emit(std::move(load));
+	}
+
+	ERR_EXIT("Fatal: couldn't find ", is_func ? "func" : "variable", " with name: ", Symbols::name(name));
+}
+
+void IRBuilder::build_stmts(std::span<const Node::Stmt> stmts)
+{
+	for (const Node::Stmt& stmt : stmts)
+		build_stmt(stmt);
+}
+
+void IRBuilder::build_stmt(const Node::Stmt& stmt)
+{
+	struct Visitor
+	{
+		IRBuilder& builder;
+		void operator()(const Node::StmtAsgn& asgn) { builder.build_asgn(asgn); }
+		void operator()(const Node::StmtIf& if_stmt) { builder.build_if(if_stmt); }
+		void operator()(const Node::StmtLoop& loop) { builder.build_loop(loop); }
+		void operator()(const Node::StmtRet& ret) { builder.build_ret(ret); }
+	};
+	std::visit(Visitor{ *this }, stmt.stmt);
+}
+
+// like Compiler::compile_asgn the value is built before the name is declared, except
+// for functions, which can call themselves
+void IRBuilder::build_asgn(const Node::StmtAsgn& asgn)
+{
+	Symbol id = asgn.id.id;
+	bool top_level = m_state->parent == nullptr;
+
+	if (const auto* strct = std::get_if<Node::Struct>(&asgn.val))
+	{
+		Key key = func_key(id);
+		int slot = top_level ? declare_global(key) : -1;
+		m_state->declared.insert(key);
+
+		IR::Inst fn{ IR::Op::FUNC };
+		fn.index = build_func(id, std::get<Node::StructFuncDecl>(strct->strct));
+		int val = emit(std::move(fn));
+
+		if (top_level)
+		{
+			IR::Inst store{ IR::Op::STORE_GLOBAL, { val } };
+			store.index = slot;
+			emit(std::move(store));
+		}
+		else
+			write_var(key, m_state->block, emit({ IR::Op::COPY, { val } }));
+		return;
+	}
+
+	int val = build_expr(std::get<Node::Expr>(asgn.val));
+	if (top_level)
+	{
+		IR::Inst store{ IR::Op::STORE_GLOBAL, { val } };
+		store.index = declare_global(var_key(id));
+		emit(std::move(store));
+	}
+	else
+	{
+		write_var(var_key(id), m_state->block, emit({ IR::Op::COPY, { val } }));
+		m_state->declared.insert(var_key(id));
+	}
+}
+
+void IRBuilder::build_if(const Node::StmtIf& stmt)
+{
+	std::vector<int> ends; // blocks falling through to the end of the chain
+	for (const Node::StmtIf* link = &stmt; link; link = link->elif)
+	{
+		int then_block = new_block(false);
+		int next_block = new_block(false);
+		build_cond(link->cond, then_block, next_block);
+		seal(then_block);
+		seal(next_block);
+
+		start_block(then_block);
+		build_stmts(link->scope->stmts);
+		ends.push_back(m_state->block);
+
+		start_block(next_block);
+	}
+	ends.push_back(m_state->block);
+
+	int merge = new_block(false);
+	for (int end : ends)
+	{
+		IR::Inst jmp{ IR::Op::JMP };
+		jmp.targets[0] = merge;
+		func().add(end, std::move(jmp));
+	}
+	seal(merge);
+	start_block(merge);
+}
+
+// Same order as Compiler::compile_loop (init, condition, body, advance), behind a guard:
+// the condition is tested once more before the loop, so the block between the guard
+// and the header runs only when the body runs at least once. Loop-invariant code goes
+// there, even code that could fail. The header and the blocks of its condition are laid
+// out after the body, which then falls through into the test and one branch per
+// iteration goes back.
+void IRBuilder::build_loop(const Node::StmtLoop& loop)
+{
+	if (loop.init)
+		build_asgn(*loop.init);
+
+	int preheader = new_block(false);
+	int exit = new_block(false);
+	build_cond(loop.cond, preheader, exit);
+	seal(preheader);
+
+	start_block(preheader);
+	int header = new_block(false);
+	IR::Inst enter{ IR::Op::JMP };
+	enter.targets[0] = header;
+	emit(std::move(enter));
+
+	size_t header_pos = func().layout.size();
+	start_block(header);
+	int body = new_block(false);
+	build_cond(loop.cond, body, exit);
+	seal(body);
+
+	size_t body_pos = func().layout.size();
+	start_block(body);
+	build_stmts(loop.scope->stmts);
+	if (loop.adv)
+		build_asgn(*loop.adv);
+
+	IR::Inst back{ IR::Op::JMP };
+	back.targets[0] = header;
+	emit(std::move(back));
+
+	std::vector<int>& layout = func().layout;
+	std::rotate(layout.begin() + header_pos, layout.begin() + body_pos, layout.end());
+
+	seal(header);
+	seal(exit);
+	start_block(exit);
+}
+
+// Ends the current block branching on expr, without a value for && and ||: their
+// right operand gets its own block, reached only when the left one doesn't decide.
+void IRBuilder::build_cond(const Node::Expr& expr, int if_true, int if_false)
+{
+	const auto* bin_expr = std::get_if<Node::BinExpr>(&expr.expr);
+	if (bin_expr && (bin_expr->op == TokenTypes::Operator::AND || bin_expr->op == TokenTypes::Operator::OR))
+	{
+		build_short_circuit(*bin_expr, if_true, if_false);
+		return;
+	}
+
+	IR::Inst branch{ IR::Op::BRANCH, { build_expr(expr) } };
+	branch.targets[0] = if_true;
+	branch.targets[1] = if_false;
+	emit(std::move(branch));
+}
+
+void IRBuilder::build_short_circuit(const Node::BinExpr& bin_expr, int if_true, int if_false)
+{
+	int rhs_block = new_block(false);
+	if (bin_expr.op == TokenTypes::Operator::AND)
+		build_cond(*bin_expr.lhs, rhs_block, if_false);
+	else
+		build_cond(*bin_expr.lhs, if_true, rhs_block);
+	seal(rhs_block);
+
+	start_block(rhs_block);
+	build_cond(*bin_expr.rhs, if_true, if_false);
+}
+
+// && or || as a value: 1 or 0, from a PHI where the branches meet
+int IRBuilder::build_logical(const Node::BinExpr& bin_expr)
+{
+	int one = emit_const(Value::from_bool(true));
+	int zero = emit_const(Value::from_bool(false));
+	int if_true = new_block(false);
+	int if_false = new_block(false);
+	build_short_circuit(bin_expr, if_true, if_false);
+	seal(if_true);
+	seal(if_false);
+
+	int merge = new_block(false);
+	for (int block : { if_true, if_false })
+	{
+		start_block(block);
+		IR::Inst jmp{ IR::Op::JMP };
+		jmp.targets[0] = merge;
+		emit(std::move(jmp));
+	}
+	seal(merge);
+	start_block(merge);
+
+	int phi = func().add_phi(merge);
+	func().insts[phi].args = { one, zero }; // if_true jumped here first
+	return phi;
+}
+
+void IRBuilder::build_ret(const Node::StmtRet& ret)
+{
+	const Node::Call* call = ret.ret_val.has_value() ? std::get_if<Node::Call>(&ret.ret_val->expr) : nullptr;
+	if (m_state->parent && call && std::holds_alternative<Node::LitIdent>(call->fn))
+		build_call(*call, true);
+
+	else
+	{
+		int val = ret.ret_val.has_value() ? build_expr(ret.ret_val.value()) : emit_const({ ValueType::NIL, -1 });
+		emit({ IR::Op::RET, { val } });
+	}
+
+	// whatever follows in the same scope is unreachable but still gets built
+	start_block(new_block(true));
+}
+
+int IRBuilder::build_func(Symbol name, const Node::StructFuncDecl& decl)
+{
+	m_module.funcs.emplace_back();
+	int idx = static_cast<int>(m_module.funcs.size() - 1);
+	m_module.funcs[idx].name = Symbols::name(name);
+	m_module.funcs[idx].params = decl.params.size();
+	m_module.funcs[idx].memoize = decl.memo;
+
+	FuncState state{ idx, -1 };
+	state.parent = m_state;
+	m_state = &state;
+	start_block(new_block(true));
+
+	for (size_t i = 0; i < decl.params.size(); i++)
+	{
+		IR::Inst param{ IR::Op::PARAM };
+		param.index = static_cast<int>(i);
+		write_var(var_key(decl.params[i].id), m_state->block, emit(std::move(param)));
+		m_state->declared.insert(var_key(decl.params[i].id));
+	}
+
+	build_stmts(decl.scope.stmts);
+	emit({ IR::Op::RET, { emit_const({ ValueType::NIL, -1 }) } }); // falling off the end returns NIL
+
+	m_state = state.parent;
+	return idx;
+}
+
+int IRBuilder::build_expr(const Node::Expr& expr)
+{
+	struct Visitor
+	{
+		IRBuilder& builder;
+
+		int operator()(const Node::BinExpr& bin_expr)
+		{
+			// a plain value on the right is as cheap to evaluate as to skip, and can't fail
+			bool logical = bin_expr.op == TokenTypes::Operator::AND || bin_expr.op == TokenTypes::Operator::OR;
+			if (logical && !std::holds_alternative<Node::Lit>(bin_expr.rhs->expr))
+				return builder.build_logical(bin_expr);
+
+			int lhs = builder.build_expr(*bin_expr.lhs);
+			int rhs = builder.build_expr(*bin_expr.rhs);
+
+			IR::Op op;
+			switch (bin_expr.op.value())
+			{
+				case TokenTypes::Operator::EQL: op = IR::Op::EQL; break;
+				case TokenTypes::Operator::ADD: op = IR::Op::ADD; break;
+				case TokenTypes::Operator::SUB: op = IR::Op::SUB; break;
+				case TokenTypes::Operator::DIV: op = IR::Op::DIV; break;
+				case TokenTypes::Operator::MUL: op = IR::Op::MUL; break;
+				case TokenTypes::Operator::OR: op = IR::Op::OR; break;
+				case TokenTypes::Operator::AND: op = IR::Op::AND; break;
+				case TokenTypes::Operator::BW_OR: op = IR::Op::BW_OR; break;
+				case TokenTypes::Operator::BW_AND: op = IR::Op::BW_AND; break;
+				case TokenTypes::Operator::LT: op = IR::Op::LT; break;
+				case TokenTypes::Operator::LTE: op = IR::Op::LTE; break;
+				case TokenTypes::Operator::GT: op = IR::Op::GT; break;
+				case TokenTypes::Operator::GTE: op = IR::Op::GTE; break;
+
+				default:
+					ERR_EXIT("Operator not allowed");
+			}
+			return builder.emit({ op, { lhs, rhs } });
+		}
+
+		int operator()(const Node::Lit& lit)
+		{
+			if (const auto* ident = std::get_if<Node::LitIdent>(&lit.lit))
+				return builder.resolve(ident->id, false);
+
+			if (const auto* integer = std::get_if<Node::LitInt>(&lit.lit))
+				return builder.emit_const(Value::from_int(integer->val));
+
+			return builder.emit_const(Value::from_double(std::get<Node::LitFloat>(lit.lit).val));
+		}
+
+		int operator()(const Node::Call& call)
+		{
+			return builder.build_call(call, false);
+		}
+	};
+	return std::visit(Visitor{ *this }, expr.expr);
+}
+
+int IRBuilder::build_call(const Node::Call& call, bool tail)
+{
+	const auto* ident = std::get_if<Node::LitIdent>(&call.fn);
+	if (!ident)
+	{
+		unsupported("inline function literal call");
+		return emit_const({ ValueType::NIL, -1 });
+	}
+
+	std::vector<int> args;
+	for (const Node::Expr& arg : call.args)
+		args.push_back(build_expr(arg));
+
+	args.insert(args.begin(), resolve(ident->id, true));
+	return emit({ tail ? IR::Op::TAILCALL : IR::Op::CALL, std::move(args) });
+}
+
+void IRBuilder::unsupported(const std::string& what)
+{
+	LOGGER << "IR: unsupported, " << what << std::endl;
+	m_supported = false;
+}
\ No newline at end of file
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <optional>
+#include <unordered_set>
+
+#include "Parser.h"
+#include "IR.h"
+
+// Builds SSA from the AST, one IR::Function per function literal plus the top level.
+// Local variables become SSA values right away: every block remembers the current value
+// of each variable, and reads that reach the start of a block with several predecessors
+// create a PHI (incomplete until all predecessors of a loop header are known). Name
+// resolution follows Compiler: a name refers to the current function once it was
+// assigned there and to the top level otherwise.
+//
+// Programs the IR doesn't model return nothing from build() and go through Compiler:
+// inline function literals, and functions reaching into the locals of an enclosing
+// function.
+class IRBuilder
+{
+public:
+	IRBuilder(const std::vector<Node::Node>& nodes);
+	std::optional<IR::Module> build();
+
+private:
+	// functions and variables are separate namespaces, the low bit of a key tells them apart
+	using Key = uint64_t;
+	static Key var_key(Symbol name);
+	static Key func_key(Symbol name);
+
+	struct FuncState
+	{
+		int func;
+		int block;
+		std::unordered_map<int, std::unordered_map<Key, int>> defs = {}; // block -> variable -> value
+		std::unordered_map<int, std::vector<std::pair<Key, int>>> incomplete = {}; // unsealed block -> (variable, phi)
+		std::unordered_set<int> sealed = {};
+		std::unordered_set<Key> declared = {}; // variables and functions assigned so far, in source order
+		FuncState* parent = nullptr;
+	};
+
+	IR::Function& func();
+	int emit(IR::Inst inst);
+	int emit_const(Value val);
+	void start_block(int block);
+	int new_block(bool sealed);
+	void seal(int block);
+
+	void write_var(Key key, int block, int value);
+	int read_var(Key key, int block);
+	int read_var_recursive(Key key, int block);
+	void add_phi_operands(Key key, int phi);
+
+	int resolve(Symbol name, bool is_func);
+	int declare_global(Key key);
+
+	void build_stmts(std::span<const Node::Stmt> stmts);
+	void build_stmt(const Node::Stmt& stmt);
+	void build_asgn(const Node::StmtAsgn& asgn);
+	void build_if(const Node::StmtIf& stmt);
+	void build_loop(const Node::StmtLoop& loop);
+	void build_ret(const Node::StmtRet& ret);
+	void build_cond(const Node::Expr& expr, int if_true, int if_false);
+	void build_short_circuit(const Node::BinExpr& bin_expr, int if_true, int if_false);
+	int build_logical(const Node::BinExpr& bin_expr);
+	int build_func(Symbol name, const Node::StructFuncDecl& func);
+	int build_expr(const Node::Expr& expr);
+	int build_call(const Node::Call& call, bool tail);
+
+	void unsupported(const std::string& what);
+
+private:
+	const std::vector<Node::Node>& m_nodes;
+	IR::Module m_module;
+	FuncState* m_state = nullptr;
+	std::unordered_map<Key, size_t> m_global_slots; // variables and functions of the top level
+	bool m_supported = true;
+};
\ No newline at end of file
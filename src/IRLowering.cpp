@@ -0,0 +1,734 @@
+#include "IRLowering.h"
+#include "Utils.h"
+
+#include <algorithm>
+#include <climits>
+#include <queue>
+
+static OpCode binary_opcode(IR::Op op)
+{
+	switch (op)
+	{
+		case IR::Op::ADD: return OpCode::ADD;
+		case IR::Op::SUB: return OpCode::SUB;
+		case IR::Op::MUL: return OpCode::MUL;
+		case IR::Op::DIV: return OpCode::DIV;
+		case IR::Op::BW_OR: return OpCode::BW_OR;
+		case IR::Op::BW_AND: return OpCode::BW_AND;
+		case IR::Op::OR: return OpCode::OR;
+		case IR::Op::AND: return OpCode::AND;
+		case IR::Op::LT: return OpCode::LT;
+		case IR::Op::GT: return OpCode::GT;
+		case IR::Op::GTE: return OpCode::GTE;
+		case IR::Op::LTE: return OpCode::LTE;
+		case IR::Op::EQL: return OpCode::EQL;
+		default: ERR_EXIT("IR lowering: not a binary operation: ", IR::op_to_string(op));
+	}
+}
+
+IRLowering::IRLowering(IR::Module& module) : m_module(module) {}
+
+size_t IRLowering::frame_slots() const
+{
+	return m_frame_slots;
+}
+
+size_t IRLowering::shared_slots() const
+{
+	return m_shared_slots;
+}
+
+std::vector<Instr> IRLowering::lower()
+{
+	m_entries.assign(m_module.funcs.size(), 0);
+	for (size_t i = 0; i < m_module.funcs.size(); i++)
+	{
+		split_critical_edges(m_module.funcs[i]);
+		lower_func(static_cast<int>(i));
+	}
+
+	for (const auto& [pos, func] : m_addr_fixups)
+		m_bytecode[pos].val = { ValueType::ADDR, static_cast<int>(m_entries[func]) };
+	return m_bytecode;
+}
+
+// PHI copies go at the end of the predecessor, which only works if it has no other successor
+void IRLowering::split_critical_edges(IR::Function& func)
+{
+	size_t count = func.blocks.size();
+	for (size_t b = 0; b < count; b++)
+	{
+		if (func.blocks[b].dead || !func.is_terminated(static_cast<int>(b)))
+			continue;
+
+		int term = func.blocks[b].insts.back();
+		if (func.insts[term].op != IR::Op::BRANCH)
+			continue;
+
+		for (int k = 0; k < 2; k++)
+		{
+			int target = func.insts[term].targets[k];
+			if (func.blocks[target].phis.empty())
+				continue;
+
+			int split = func.add_block();
+			IR::Inst jmp{ IR::Op::JMP };
+			jmp.targets[0] = target;
+			func.add(split, std::move(jmp));
+
+			// the new block takes the branch's place among the target's predecessors
+			std::vector<int>& preds = func.blocks[target].preds;
+			preds.pop_back();
+			*std::find(preds.begin(), preds.end(), static_cast<int>(b)) = split;
+
+			func.blocks[split].preds.push_back(static_cast<int>(b));
+			func.insts[term].targets[k] = split;
+			// the taken side falls through to its copies, the other one is jumped to anyway
+			if (k == 0)
+				func.layout.insert(std::find(func.layout.begin(), func.layout.end(), static_cast<int>(b)) + 1, split);
+			else
+				func.layout.push_back(split);
+		}
+	}
+}
+
+void IRLowering::lower_func(int idx)
+{
+	const IR::Function& func = m_module.funcs[idx];
+	m_func = &func;
+	m_body.clear();
+	m_jump_fixups.clear();
+	m_body_addr_fixups.clear();
+	m_block_starts.assign(func.blocks.size(), 0);
+	m_slots.assign(func.insts.size(), -1);
+	m_pending.assign(func.insts.size(), false);
+	m_pending_order.clear();
+
+	// the top level keeps its globals in the first slots, functions their arguments
+	int reserved_from = func.top_level ? 0 : static_cast<int>(func.params);
+	int first_local = func.top_level ? static_cast<int>(m_module.global_slots) : static_cast<int>(func.params);
+	m_next_slot = first_local;
+	for (int block : func.layout)
+	{
+		for (int phi : func.blocks[block].phis)
+			m_slots[phi] = m_next_slot++;
+		for (int id : func.blocks[block].insts)
+		{
+			if (func.insts[id].op == IR::Op::PARAM)
+				m_slots[id] = func.insts[id].index;
+		}
+	}
+	analyze_uses();
+
+	for (size_t pos = 0; pos < func.layout.size(); pos++)
+	{
+		int block = func.layout[pos];
+		m_block_starts[block] = m_body.size();
+
+		for (int id : func.blocks[block].insts)
+		{
+			const IR::Inst& inst = func.insts[id];
+			if (IR::is_terminator(inst.op))
+			{
+				emit_terminator(block, pos);
+				continue;
+			}
+
+			if (inst.op == IR::Op::STORE_GLOBAL)
+			{
+				std::vector<int> order;
+				collect_pending(inst.args[0], order);
+				prepare_root(order, false, inst.index);
+				load(inst.args[0]);
+				push_instr(OpCode::MOV, { ValueType::VAR, inst.index });
+				continue;
+			}
+
+			if (is_leaf(id) || m_slots[id] >= 0)
+				continue;
+
+			// a global only called through its own slot is never loaded
+			if (inst.op == IR::Op::LOAD_GLOBAL && m_uses[id] == 0 && !m_needs_slot[id])
+				continue;
+
+			if (!m_needs_slot[id] && m_uses[id] == 1 && m_use_block[id] == block)
+			{
+				m_pending[id] = true;
+				m_pending_order.push_back(id);
+				continue;
+			}
+
+			std::vector<int> order;
+			for (int arg : stack_args(id))
+				collect_pending(arg, order);
+			prepare_root(order, IR::is_removable(func, inst), -1);
+			emit_value(id);
+
+			if (m_uses[id] == 0 && !m_needs_slot[id])
+				push_instr(OpCode::POP, { ValueType::NOT_REQUIRED, -1 });
+			else
+			{
+				m_slots[id] = m_next_slot++;
+				push_instr(OpCode::MOV, { ValueType::VAR, m_slots[id] });
+			}
+		}
+
+		if (!m_pending_order.empty())
+			ERR_EXIT("IR lowering: unused values left on the stack in ", func.name);
+	}
+
+	int frame_end = pack_slots(first_local);
+
+	m_entries[idx] = m_bytecode.size();
+	if (func.memoize)
+		m_bytecode.emplace_back(OpCode::MEMO, Value{ ValueType::LIT, m_memo_caches++ }, static_cast<int>(func.params));
+	if (frame_end > reserved_from)
+		m_bytecode.emplace_back(OpCode::RESERVE, Value{ ValueType::LIT, frame_end - reserved_from });
+
+	size_t start = m_bytecode.size();
+	m_bytecode.insert(m_bytecode.end(), m_body.begin(), m_body.end());
+	for (const auto& [pos, block] : m_jump_fixups)
+		m_bytecode[start + pos].val.set_operand(start + m_block_starts[block]);
+	for (const auto& [pos, target] : m_body_addr_fixups)
+		m_addr_fixups.emplace_back(start + pos, target);
+}
+
+// Slot numbers from first on were handed out one per value. Liveness over the emitted
+// body gives every slot the range of instructions it is live in, its hull over the
+// layout. Ranges are then assigned in order of their start to the lowest slot that is
+// free again, like a linear scan allocator. A slot read before any write reads the
+// NIL of the reservation, so one live into the entry block keeps a slot to itself.
+// Returns the end of the packed frame.
+int IRLowering::pack_slots(int first)
+{
+	const IR::Function& func = *m_func;
+	int count = m_next_slot - first;
+	if (count == 0)
+		return first;
+
+	auto local_of = [&](const Instr& instr) {
+		bool frame_slot = instr.val.is(ValueType::VAR) && (instr.code == OpCode::MOV || instr.code == OpCode::LOAD_LOCAL ||
+			instr.code == OpCode::CALL || instr.code == OpCode::TAILCALL);
+		return frame_slot && instr.val.operand() >= first ? static_cast<int>(instr.val.operand()) - first : -1;
+	};
+
+	struct Range
+	{
+		int start = INT_MAX;
+		int end = -1;
+		std::vector<int> exposed; // blocks reading the slot before writing it
+		std::vector<int> defs; // blocks writing it
+	};
+	std::vector<Range> ranges(count);
+
+	std::vector<int> block_end(func.blocks.size(), 0);
+	for (size_t pos = 0; pos < func.layout.size(); pos++)
+	{
+		int block = func.layout[pos];
+		int begin = static_cast<int>(m_block_starts[block]);
+		int end = pos + 1 < func.layout.size() ? static_cast<int>(m_block_starts[func.layout[pos + 1]]) : static_cast<int>(m_body.size());
+		block_end[block] = end;
+
+		for (int i = begin; i < end; i++)
+		{
+			int local = local_of(m_body[i]);
+			if (local < 0)
+				continue;
+
+			Range& range = ranges[local];
+			range.start = std::min(range.start, i);
+			range.end = std::max(range.end, i);
+
+			bool written = !range.defs.empty() && range.defs.back() == block;
+			if (m_body[i].code == OpCode::MOV)
+			{
+				if (!written)
+					range.defs.push_back(block);
+			}
+			else if (!written && (range.exposed.empty() || range.exposed.back() != block))
+				range.exposed.push_back(block);
+		}
+	}
+
+	// walk back from every exposed read until the writes reaching it
+	std::vector<int> live_in(func.blocks.size(), -1);
+	std::vector<int> live_out(func.blocks.size(), -1);
+	std::vector<int> writes(func.blocks.size(), -1);
+	for (int local = 0; local < count; local++)
+	{
+		Range& range = ranges[local];
+		for (int block : range.defs)
+			writes[block] = local;
+
+		std::vector<int> worklist = range.exposed;
+		for (int block : worklist)
+			live_in[block] = local;
+
+		while (!worklist.empty())
+		{
+			int block = worklist.back();
+			worklist.pop_back();
+			range.start = std::min(range.start, static_cast<int>(m_block_starts[block]));
+			if (block == 0)
+				range.end = static_cast<int>(m_body.size());
+
+			for (int pred : func.blocks[block].preds)
+			{
+				if (live_out[pred] == local)
+					continue;
+
+				live_out[pred] = local;
+				range.end = std::max(range.end, block_end[pred] - 1);
+				if (writes[pred] != local && live_in[pred] != local)
+				{
+					live_in[pred] = local;
+					worklist.push_back(pred);
+				}
+			}
+		}
+	}
+
+	std::vector<int> by_start;
+	for (int local = 0; local < count; local++)
+	{
+		if (ranges[local].end >= 0)
+			by_start.push_back(local);
+	}
+	std::sort(by_start.begin(), by_start.end(), [&](int a, int b) { return ranges[a].start < ranges[b].start; });
+
+	using Active = std::pair<int, int>; // end of the range, slot
+	std::priority_queue<Active, std::vector<Active>, std::greater<Active>> active;
+	std::priority_queue<int, std::vector<int>, std::greater<int>> free;
+	std::vector<int> packed(count, -1);
+	int slots = 0;
+	for (int local : by_start)
+	{
+		while (!active.empty() && active.top().first < ranges[local].start)
+		{
+			free.push(active.top().second);
+			active.pop();
+		}
+
+		if (free.empty())
+			packed[local] = slots++;
+		else
+		{
+			packed[local] = free.top();
+			free.pop();
+		}
+		active.emplace(ranges[local].end, packed[local]);
+	}
+
+	for (Instr& instr : m_body)
+	{
+		if (int local = local_of(instr); local >= 0)
+			instr.val.set_operand(first + packed[local]);
+	}
+
+	m_frame_slots += slots;
+	m_shared_slots += by_start.size() - slots;
+	return first + slots;
+}
+
+void IRLowering::analyze_uses()
+{
+	const IR::Function& func = *m_func;
+	m_uses.assign(func.insts.size(), 0);
+	m_use_block.assign(func.insts.size(), -2);
+	m_needs_slot.assign(func.insts.size(), false);
+	m_direct_calls.assign(func.insts.size(), false);
+
+	auto use = [&](int value, int block) {
+		m_uses[value]++;
+		if (m_use_block[value] == -2)
+			m_use_block[value] = block;
+		else if (m_use_block[value] != block)
+			m_use_block[value] = -1;
+	};
+
+	for (int block : func.layout)
+	{
+		const IR::Block& blk = func.blocks[block];
+		for (int phi : blk.phis)
+		{
+			for (size_t k = 0; k < blk.preds.size(); k++)
+				use(func.insts[phi].args[k], blk.preds[k]); // read at the end of the predecessor
+		}
+
+		for (size_t i = 0; i < blk.insts.size(); i++)
+		{
+			const IR::Inst& inst = func.insts[blk.insts[i]];
+			if (inst.op != IR::Op::CALL && inst.op != IR::Op::TAILCALL)
+			{
+				for (int arg : inst.args)
+					use(arg, block);
+				continue;
+			}
+
+			for (size_t k = 1; k < inst.args.size(); k++)
+				use(inst.args[k], block);
+
+			// globals can be called in place, at the top level only if nothing stored to them since the load
+			int callee = inst.args[0];
+			const IR::Inst& fn = func.insts[callee];
+			bool direct = fn.op == IR::Op::LOAD_GLOBAL;
+			if (direct && func.top_level)
+			{
+				auto load_pos = std::find(blk.insts.begin(), blk.insts.begin() + i, callee);
+				direct = load_pos != blk.insts.begin() + i && std::none_of(load_pos, blk.insts.begin() + i, [&](int id) {
+					return func.insts[id].op == IR::Op::STORE_GLOBAL && func.insts[id].index == fn.index;
+				});
+			}
+
+			if (direct)
+				m_direct_calls[blk.insts[i]] = true; // indexed by the call
+			else
+				m_needs_slot[callee] = true;
+		}
+	}
+}
+
+// loaded again wherever it's used, so never computed where it's defined
+bool IRLowering::is_leaf(int value) const
+{
+	const IR::Inst& inst = m_func->insts[value];
+	switch (inst.op)
+	{
+		case IR::Op::PARAM:
+		case IR::Op::PHI:
+			return true;
+
+		case IR::Op::CONST:
+		case IR::Op::FUNC:
+			return !m_needs_slot[value];
+
+		case IR::Op::LOAD_GLOBAL:
+			return !m_func->top_level;
+
+		default:
+			return false;
+	}
+}
+
+// the arguments that go through the operand stack, callees are operands
+std::vector<int> IRLowering::stack_args(int value) const
+{
+	const IR::Inst& inst = m_func->insts[value];
+	if (inst.op == IR::Op::CALL || inst.op == IR::Op::TAILCALL)
+		return { inst.args.begin() + 1, inst.args.end() };
+	if (inst.op == IR::Op::PHI)
+		return {};
+	return inst.args;
+}
+
+// pending values computed along with value, in the order they will be
+void IRLowering::collect_pending(int value, std::vector<int>& order) const
+{
+	if (!m_pending[value])
+		return;
+
+	for (int arg : stack_args(value))
+		collect_pending(arg, order);
+	order.push_back(value);
+}
+
+bool IRLowering::reads_global(int value, int slot) const
+{
+	const IR::Inst& inst = m_func->insts[value];
+	if (inst.op == IR::Op::LOAD_GLOBAL && inst.index == slot)
+		return true;
+
+	for (int arg : stack_args(value))
+	{
+		if (m_pending[arg] && reads_global(arg, slot))
+			return true;
+	}
+	return false;
+}
+
+void IRLowering::read_slots(int value, std::vector<int>& slots) const
+{
+	if (m_slots[value] >= 0)
+	{
+		slots.push_back(m_slots[value]);
+		return;
+	}
+
+	if (!m_pending[value])
+		return;
+
+	for (int arg : stack_args(value))
+		read_slots(arg, slots);
+}
+
+// Before a root is emitted: whatever it doesn't consume stays pending and moves past it,
+// which is only fine for values that can't fail. Those that can are stored to slots
+// now, unless the root and its operands would compute them out of order anyway.
+void IRLowering::prepare_root(const std::vector<int>& order, bool removable, int stored_global)
+{
+	const IR::Function& func = *m_func;
+	auto can_fail = [&](int value) { return !IR::is_removable(func, func.insts[value]); };
+
+	std::vector<int> in_root;
+	for (int value : order)
+	{
+		if (can_fail(value))
+			in_root.push_back(value);
+	}
+
+	std::vector<int> outside;
+	for (int value : m_pending_order)
+	{
+		if (can_fail(value) && std::find(order.begin(), order.end(), value) == order.end())
+			outside.push_back(value);
+	}
+
+	std::vector<int> to_flush;
+	if (!removable || !in_root.empty())
+	{
+		bool in_sequence = std::is_sorted(in_root.begin(), in_root.end()) &&
+			(outside.empty() || in_root.empty() || *std::max_element(outside.begin(), outside.end()) < in_root.front());
+
+		to_flush = outside;
+		if (!in_sequence)
+			to_flush.insert(to_flush.end(), in_root.begin(), in_root.end());
+	}
+
+	// a global read that the store would overwrite
+	if (stored_global >= 0)
+	{
+		for (int value : m_pending_order)
+		{
+			if (std::find(order.begin(), order.end(), value) == order.end() && reads_global(value, stored_global))
+				to_flush.push_back(value);
+		}
+	}
+
+	std::sort(to_flush.begin(), to_flush.end());
+	for (int value : to_flush)
+		flush(value);
+}
+
+void IRLowering::flush(int value)
+{
+	if (!m_pending[value])
+		return; // computed as part of a value flushed before
+
+	m_pending[value] = false;
+	std::erase(m_pending_order, value);
+	emit_value(value);
+	m_slots[value] = m_next_slot++;
+	push_instr(OpCode::MOV, { ValueType::VAR, m_slots[value] });
+}
+
+void IRLowering::load(int value)
+{
+	if (m_slots[value] >= 0)
+		push_instr(OpCode::LOAD_LOCAL, { ValueType::VAR, m_slots[value] });
+
+	else if (m_pending[value])
+	{
+		m_pending[value] = false;
+		std::erase(m_pending_order, value);
+		emit_value(value);
+	}
+
+	else if (is_leaf(value))
+		emit_value(value);
+
+	else
+		ERR_EXIT("IR lowering: v", value, " is not available in ", m_func->name);
+}
+
+void IRLowering::emit_value(int value)
+{
+	const IR::Inst& inst = m_func->insts[value];
+	switch (inst.op)
+	{
+		case IR::Op::PARAM:
+			push_instr(OpCode::LOAD_LOCAL, { ValueType::VAR, inst.index });
+			break;
+
+		case IR::Op::CONST:
+			if (inst.imm.is(ValueType::NIL))
+				push_instr(OpCode::PUSH, { ValueType::NIL, -1 });
+			else
+				push_instr(OpCode::LOAD_CONST, inst.imm);
+			break;
+
+		case IR::Op::FUNC:
+			m_body_addr_fixups.emplace_back(m_body.size(), inst.index);
+			push_instr(OpCode::PUSH, { ValueType::ADDR, -1 });
+			break;
+
+		case IR::Op::LOAD_GLOBAL:
+			if (m_func->top_level)
+				push_instr(OpCode::LOAD_LOCAL, { ValueType::VAR, inst.index });
+			else
+				push_instr(OpCode::LOAD_GLOBAL, { ValueType::ABS_VAR, inst.index });
+			break;
+
+		case IR::Op::COPY:
+			load(inst.args[0]);
+			break;
+
+		case IR::Op::CALL:
+		case IR::Op::TAILCALL:
+			for (size_t i = 1; i < inst.args.size(); i++)
+				load(inst.args[i]);
+			// a memoized function has to see the result of its tail calls to cache it
+			push_instr(inst.op == IR::Op::CALL || m_func->memoize ? OpCode::CALL : OpCode::TAILCALL, callee_operand(inst), static_cast<int>(inst.args.size() - 1));
+			break;
+
+		default:
+			load(inst.args[0]);
+			load(inst.args[1]);
+			push_instr(binary_opcode(inst.op), { ValueType::NOT_REQUIRED, -1 });
+			break;
+	}
+}
+
+Value IRLowering::callee_operand(const IR::Inst& call) const
+{
+	int call_id = static_cast<int>(&call - m_func->insts.data());
+	const IR::Inst& callee = m_func->insts[call.args[0]];
+	if (m_direct_calls[call_id])
+		return { m_func->top_level ? ValueType::VAR : ValueType::ABS_VAR, callee.index };
+
+	if (m_slots[call.args[0]] < 0)
+		ERR_EXIT("IR lowering: callee v", call.args[0], " has no slot in ", m_func->name);
+	return { ValueType::VAR, m_slots[call.args[0]] };
+}
+
+// Sequential copies where possible: a PHI's slot is written once no other copy still
+// reads it. Copies left in a cycle push all their sources first.
+void IRLowering::emit_phi_copies(int block, int succ)
+{
+	const IR::Function& func = *m_func;
+	const IR::Block& target = func.blocks[succ];
+	size_t pred = std::find(target.preds.begin(), target.preds.end(), block) - target.preds.begin();
+
+	struct Copy
+	{
+		int dest;
+		int src;
+		std::vector<int> reads = {};
+	};
+
+	std::vector<Copy> copies;
+	for (int phi : target.phis)
+	{
+		int src = func.insts[phi].args[pred];
+		if (m_slots[src] == m_slots[phi])
+			continue;
+
+		Copy copy{ m_slots[phi], src };
+		read_slots(src, copy.reads);
+		copies.push_back(std::move(copy));
+	}
+
+	std::vector<Copy> sequential;
+	while (!copies.empty())
+	{
+		auto ready = std::find_if(copies.begin(), copies.end(), [&](const Copy& copy) {
+			return std::none_of(copies.begin(), copies.end(), [&](const Copy& other) {
+				return &other != &copy && std::find(other.reads.begin(), other.reads.end(), copy.dest) != other.reads.end();
+			});
+		});
+
+		if (ready == copies.end())
+			break;
+
+		sequential.push_back(std::move(*ready));
+		copies.erase(ready);
+	}
+
+	std::vector<int> order;
+	for (const Copy& copy : sequential)
+		collect_pending(copy.src, order);
+	for (const Copy& copy : copies)
+		collect_pending(copy.src, order);
+	prepare_root(order, false, -1);
+
+	for (const Copy& copy : sequential)
+	{
+		load(copy.src);
+		push_instr(OpCode::MOV, { ValueType::VAR, copy.dest });
+	}
+
+	for (const Copy& copy : copies)
+		load(copy.src);
+	for (auto it = copies.rbegin(); it != copies.rend(); ++it)
+		push_instr(OpCode::MOV, { ValueType::VAR, it->dest });
+}
+
+void IRLowering::emit_terminator(int block, size_t layout_pos)
+{
+	const IR::Function& func = *m_func;
+	const IR::Inst& term = func.insts[func.blocks[block].insts.back()];
+	int term_id = func.blocks[block].insts.back();
+	int next = layout_pos + 1 < func.layout.size() ? func.layout[layout_pos + 1] : -1;
+
+	std::vector<int> order;
+	for (int arg : stack_args(term_id))
+		collect_pending(arg, order);
+
+	switch (term.op)
+	{
+		case IR::Op::JMP:
+			if (!func.blocks[term.targets[0]].phis.empty())
+				emit_phi_copies(block, term.targets[0]);
+			if (term.targets[0] != next)
+				push_jump(OpCode::JMP, term.targets[0]);
+			break;
+
+		case IR::Op::BRANCH:
+			prepare_root(order, false, -1);
+			load(term.args[0]);
+			if (term.targets[1] == next)
+				push_jump(OpCode::JMP_NONZERO, term.targets[0]);
+			else
+			{
+				push_jump(OpCode::JMP_ZERO, term.targets[1]);
+				if (term.targets[0] != next)
+					push_jump(OpCode::JMP, term.targets[0]);
+			}
+			break;
+
+		case IR::Op::RET:
+			prepare_root(order, false, -1);
+			load(term.args[0]);
+			push_return();
+			break;
+
+		case IR::Op::TAILCALL:
+			prepare_root(order, false, -1);
+			emit_value(term_id);
+			if (func.memoize)
+				push_return();
+			break;
+
+		default:
+			push_instr(OpCode::HLT, { ValueType::NOT_REQUIRED, -1 });
+			break;
+	}
+}
+
+void IRLowering::push_instr(OpCode code, Value val, int imm)
+{
+	m_body.emplace_back(code, val, imm);
+}
+
+void IRLowering::push_return()
+{
+	if (m_func->memoize)
+		push_instr(OpCode::MEMO_RET, { ValueType::LIT, m_memo_caches }, static_cast<int>(m_func->params)); // the cache MEMO takes at the entry
+	else
+		push_instr(OpCode::RET, { ValueType::NOT_REQUIRED, -1 });
+}
+
+void IRLowering::push_jump(OpCode code, int block)
+{
+	m_jump_fixups.emplace_back(m_body.size(), block);
+	push_instr(code, { ValueType::LIT, -1 });
+}
\ No newline at end of file
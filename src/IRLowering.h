@@ -0,0 +1,79 @@
+#pragma once
+
+#include "Compiler.h"
+#include "IR.h"
+
+// Turns an IR::Module back into stack bytecode: the top level first, ending in HLT,
+// then every function body.
+//
+// Values with a single use later in the same block stay on the operand stack and are
+// computed right where they are used, so expressions come out as the same trees
+// Compiler emits. Everything else (PHIs, values used several times or in other blocks)
+// gets its own slot in the frame, right after the parameters (or the globals, for the
+// top level). Constants, functions, parameters and globals read inside functions are
+// loaded again at every use instead. PHIs are resolved by copies at the end of each
+// predecessor, which is why critical edges are split first.
+//
+// Once a body is emitted, slots whose live ranges don't overlap are packed onto the
+// same frame slot, and the function reserves the resulting frame with one RESERVE.
+// A memoized function starts with MEMO and returns through MEMO_RET, tail calls
+// included, which become plain calls.
+class IRLowering
+{
+public:
+	IRLowering(IR::Module& module);
+	std::vector<Instr> lower();
+
+	size_t frame_slots() const; // locals reserved by all functions together
+	size_t shared_slots() const; // locals that got a slot of another one with a disjoint live range
+
+private:
+	void split_critical_edges(IR::Function& func);
+	void lower_func(int idx);
+	int pack_slots(int first);
+
+	// operand stack handling within a block
+	void analyze_uses();
+	bool is_leaf(int value) const;
+	std::vector<int> stack_args(int value) const;
+	void collect_pending(int value, std::vector<int>& order) const;
+	bool reads_global(int value, int slot) const;
+	void read_slots(int value, std::vector<int>& slots) const;
+	void prepare_root(const std::vector<int>& order, bool removable, int stored_global);
+	void flush(int value);
+	void load(int value);
+	void emit_value(int value);
+	void emit_phi_copies(int block, int succ);
+	void emit_terminator(int block, size_t layout_pos);
+	Value callee_operand(const IR::Inst& call) const;
+
+	void push_instr(OpCode code, Value val, int imm = 0);
+	void push_jump(OpCode code, int block);
+	void push_return();
+
+private:
+	IR::Module& m_module;
+	std::vector<Instr> m_bytecode;
+	std::vector<size_t> m_entries; // function -> address of its first instruction
+	std::vector<std::pair<size_t, int>> m_addr_fixups; // PUSH ADDR -> function
+
+	// state of the function being lowered
+	const IR::Function* m_func = nullptr;
+	std::vector<Instr> m_body; // without the slot reservation, which is only known at the end
+	std::vector<size_t> m_block_starts;
+	std::vector<std::pair<size_t, int>> m_jump_fixups; // jump in m_body -> block
+	std::vector<std::pair<size_t, int>> m_body_addr_fixups;
+	std::vector<int> m_uses; // stack uses: arguments of instructions and PHI inputs
+	std::vector<int> m_use_block; // block of the only use, -1 for several blocks
+	std::vector<bool> m_needs_slot; // called through a frame slot
+	std::vector<bool> m_direct_calls; // calls reaching a global through its own slot
+	std::vector<int> m_slots;
+	std::vector<bool> m_pending; // computed where it is used
+	std::vector<int> m_pending_order;
+	int m_next_slot = 0;
+
+	int m_memo_caches = 0; // memoized functions lowered so far, each gets the next cache
+
+	size_t m_frame_slots = 0;
+	size_t m_shared_slots = 0;
+};
\ No newline at end of file
@@ -0,0 +1,1226 @@
+#include "IRPasses.h"
+#include "Utils.h"
+
+#include <algorithm>
+#include <map>
+#include <tuple>
+#include <unordered_set>
+
+static size_t module_size(const IR::Module& module)
+{
+	size_t res = 0;
+	for (const IR::Function& func : module.funcs)
+		res += func.size();
+	return res;
+}
+
+// applies a value -> replacement map to every operand, following chains of replacements
+static void apply_replacements(IR::Function& func, std::unordered_map<int, int>& repl)
+{
+	auto find = [&](int val) {
+		int res = val;
+		while (repl.contains(res))
+			res = repl[res];
+		return res;
+	};
+
+	for (IR::Inst& inst : func.insts)
+	{
+		if (inst.dead)
+			continue;
+		for (int& arg : inst.args)
+			arg = find(arg);
+	}
+
+	for (const auto& [from, to] : repl)
+		func.kill(from);
+}
+
+namespace IRPasses
+{
+	bool copy_propagate(IR::Function& func)
+	{
+		bool changed = false;
+		while (true)
+		{
+			std::unordered_map<int, int> repl;
+			for (size_t i = 0; i < func.insts.size(); i++)
+			{
+				const IR::Inst& inst = func.insts[i];
+				if (inst.dead)
+					continue;
+
+				if (inst.op == IR::Op::COPY)
+					repl[static_cast<int>(i)] = inst.args[0];
+
+				else if (inst.op == IR::Op::PHI)
+				{
+					// a PHI referring only to itself and one other value is that value
+					int unique = -1;
+					bool trivial = true;
+					for (int arg : inst.args)
+					{
+						if (arg == static_cast<int>(i) || arg == unique)
+							continue;
+						trivial &= unique < 0;
+						unique = arg;
+					}
+
+					if (trivial && unique >= 0)
+						repl[static_cast<int>(i)] = unique;
+				}
+			}
+
+			if (repl.empty())
+				return changed;
+
+			apply_replacements(func, repl);
+			changed = true;
+		}
+	}
+
+	bool eliminate_dead_code(IR::Function& func)
+	{
+		bool changed = false;
+
+		// branches on constants
+		for (size_t b = 0; b < func.blocks.size(); b++)
+		{
+			if (func.blocks[b].dead || !func.is_terminated(static_cast<int>(b)))
+				continue;
+
+			IR::Inst& term = func.insts[func.blocks[b].insts.back()];
+			const IR::Inst& cond = term.op == IR::Op::BRANCH ? func.insts[term.args[0]] : term;
+			if (term.op != IR::Op::BRANCH || cond.op != IR::Op::CONST)
+				continue;
+
+			int taken = term.targets[cond.imm.truthy() ? 0 : 1];
+			int skipped = term.targets[cond.imm.truthy() ? 1 : 0];
+			term.op = IR::Op::JMP;
+			term.args.clear();
+			term.targets[0] = taken;
+			term.targets[1] = -1;
+			if (skipped != taken)
+				func.remove_pred(skipped, static_cast<int>(b));
+			changed = true;
+		}
+
+		// unreachable blocks
+		std::vector<bool> reachable(func.blocks.size(), false);
+		std::vector<int> worklist{ 0 };
+		reachable[0] = true;
+		while (!worklist.empty())
+		{
+			int block = worklist.back();
+			worklist.pop_back();
+			for (int succ : func.succs(block))
+			{
+				if (!reachable[succ])
+				{
+					reachable[succ] = true;
+					worklist.push_back(succ);
+				}
+			}
+		}
+
+		for (size_t b = 0; b < func.blocks.size(); b++)
+		{
+			if (reachable[b] || func.blocks[b].dead)
+				continue;
+
+			for (int succ : func.succs(static_cast<int>(b)))
+				func.remove_pred(succ, static_cast<int>(b));
+
+			IR::Block& block = func.blocks[b];
+			for (int inst : block.phis)
+				func.insts[inst].dead = true;
+			for (int inst : block.insts)
+				func.insts[inst].dead = true;
+			block.phis.clear();
+			block.insts.clear();
+			block.dead = true;
+			changed = true;
+		}
+		std::erase_if(func.layout, [&](int block) { return func.blocks[block].dead; });
+
+		// a PHI left with a single predecessor is a copy
+		std::unordered_map<int, int> repl;
+		for (IR::Block& block : func.blocks)
+		{
+			if (block.preds.size() != 1)
+				continue;
+			for (int phi : block.phis)
+				repl[phi] = func.insts[phi].args[0];
+		}
+		if (!repl.empty())
+		{
+			apply_replacements(func, repl);
+			changed = true;
+		}
+
+		// a block whose only predecessor jumps straight to it is part of that predecessor,
+		// so values flowing between them stay on the stack once lowered
+		for (int block : func.layout)
+		{
+			if (func.blocks[block].dead)
+				continue;
+			while (true)
+			{
+				std::vector<int>& insts = func.blocks[block].insts;
+				const IR::Inst& term = func.insts[insts.back()];
+				int next = term.targets[0];
+				if (term.op != IR::Op::JMP || next == block || next == 0 || func.blocks[next].preds.size() != 1 || !func.blocks[next].phis.empty())
+					break;
+
+				func.insts[insts.back()].dead = true;
+				insts.pop_back();
+				for (int id : func.blocks[next].insts)
+				{
+					func.insts[id].block = block;
+					insts.push_back(id);
+				}
+				for (int succ : func.succs(next))
+					std::replace(func.blocks[succ].preds.begin(), func.blocks[succ].preds.end(), next, block);
+
+				func.blocks[next].insts.clear();
+				func.blocks[next].preds.clear();
+				func.blocks[next].dead = true;
+				changed = true;
+			}
+		}
+		std::erase_if(func.layout, [&](int block) { return func.blocks[block].dead; });
+
+		// values nobody needs, starting from everything with an effect
+		std::vector<bool> live(func.insts.size(), false);
+		for (size_t i = 0; i < func.insts.size(); i++)
+		{
+			const IR::Inst& inst = func.insts[i];
+			if (!inst.dead && !IR::is_removable(func, inst))
+			{
+				live[i] = true;
+				worklist.push_back(static_cast<int>(i));
+			}
+		}
+
+		while (!worklist.empty())
+		{
+			int inst = worklist.back();
+			worklist.pop_back();
+			for (int arg : func.insts[inst].args)
+			{
+				if (!live[arg])
+				{
+					live[arg] = true;
+					worklist.push_back(arg);
+				}
+			}
+		}
+
+		for (size_t i = 0; i < func.insts.size(); i++)
+		{
+			if (!func.insts[i].dead && !live[i])
+			{
+				func.kill(static_cast<int>(i));
+				changed = true;
+			}
+		}
+		return changed;
+	}
+
+	// Cooper, Harvey and Kennedy's iterative algorithm over reverse postorder
+	static std::vector<int> dominators(const IR::Function& func, std::vector<int>& rpo)
+	{
+		std::vector<bool> visited(func.blocks.size(), false);
+		std::vector<int> post;
+		std::vector<std::pair<int, size_t>> stack{ { 0, 0 } };
+		visited[0] = true;
+		while (!stack.empty())
+		{
+			auto& [block, next] = stack.back();
+			std::vector<int> succs = func.succs(block);
+			if (next < succs.size())
+			{
+				int succ = succs[next++];
+				if (!visited[succ])
+				{
+					visited[succ] = true;
+					stack.emplace_back(succ, 0);
+				}
+				continue;
+			}
+			post.push_back(block);
+			stack.pop_back();
+		}
+
+		rpo.assign(post.rbegin(), post.rend());
+		std::vector<int> order(func.blocks.size(), -1);
+		for (size_t i = 0; i < rpo.size(); i++)
+			order[rpo[i]] = static_cast<int>(i);
+
+		std::vector<int> idom(func.blocks.size(), -1);
+		idom[0] = 0;
+		bool changed = true;
+		while (changed)
+		{
+			changed = false;
+			for (size_t i = 1; i < rpo.size(); i++)
+			{
+				int block = rpo[i];
+				int new_idom = -1;
+				for (int pred : func.blocks[block].preds)
+				{
+					if (idom[pred] < 0)
+						continue;
+					if (new_idom < 0)
+					{
+						new_idom = pred;
+						continue;
+					}
+
+					int a = pred;
+					int b = new_idom;
+					while (a != b)
+					{
+						while (order[a] > order[b])
+							a = idom[a];
+						while (order[b] > order[a])
+							b = idom[b];
+					}
+					new_idom = a;
+				}
+
+				if (new_idom != idom[block])
+				{
+					idom[block] = new_idom;
+					changed = true;
+				}
+			}
+		}
+		return idom;
+	}
+
+	static bool is_commutative(IR::Op op)
+	{
+		switch (op)
+		{
+			case IR::Op::ADD:
+			case IR::Op::MUL:
+			case IR::Op::BW_OR:
+			case IR::Op::BW_AND:
+			case IR::Op::OR:
+			case IR::Op::AND:
+			case IR::Op::EQL:
+				return true;
+
+			default:
+				return false;
+		}
+	}
+
+	bool eliminate_common_subexpressions(IR::Function& func)
+	{
+		using Key = std::tuple<IR::Op, std::vector<int>, uint64_t, int>;
+
+		std::vector<int> rpo;
+		std::vector<int> idom = dominators(func, rpo);
+		std::vector<std::vector<int>> children(func.blocks.size());
+		for (int block : rpo)
+		{
+			if (block != 0)
+				children[idom[block]].push_back(block);
+		}
+
+		// globals only change while top-level code runs, never during a call
+		auto is_candidate = [&](const IR::Inst& inst) {
+			return inst.op == IR::Op::CONST || inst.op == IR::Op::FUNC || IR::is_binary(inst.op) ||
+				(inst.op == IR::Op::LOAD_GLOBAL && !func.top_level);
+		};
+
+		std::map<Key, int> available;
+		std::unordered_map<int, int> repl;
+		auto find = [&](int val) {
+			while (repl.contains(val))
+				val = repl[val];
+			return val;
+		};
+
+		// depth-first over the dominator tree, undoing each block's entries on the way back
+		std::vector<std::pair<int, std::vector<Key>>> stack{ { 0, {} } };
+		std::vector<size_t> next_child{ 0 };
+		auto visit = [&](int block, std::vector<Key>& added) {
+			for (int id : func.blocks[block].insts)
+			{
+				IR::Inst& inst = func.insts[id];
+				for (int& arg : inst.args)
+					arg = find(arg);
+				if (!is_candidate(inst))
+					continue;
+
+				std::vector<int> args = inst.args;
+				if (is_commutative(inst.op))
+					std::sort(args.begin(), args.end());
+
+				Key key{ inst.op, args, inst.imm.bits(), inst.index };
+				if (auto it = available.find(key); it != available.end())
+					repl[id] = it->second;
+				else
+				{
+					available.emplace(key, id);
+					added.push_back(key);
+				}
+			}
+		};
+
+		visit(0, stack.back().second);
+		while (!stack.empty())
+		{
+			int block = stack.back().first;
+			if (next_child.back() < children[block].size())
+			{
+				int child = children[block][next_child.back()++];
+				stack.push_back({ child, {} });
+				next_child.push_back(0);
+				visit(child, stack.back().second);
+				continue;
+			}
+
+			for (const Key& key : stack.back().second)
+				available.erase(key);
+			stack.pop_back();
+			next_child.pop_back();
+		}
+
+		if (repl.empty())
+			return false;
+
+		apply_replacements(func, repl);
+		return true;
+	}
+
+	struct Loop
+	{
+		int header;
+		int preheader; // the only way in, ends in a JMP to the header
+		int guard; // branches to the preheader on the same condition the header tests
+		std::vector<int> latches = {};
+		std::vector<int> blocks = {}; // the body in reverse postorder
+		std::unordered_set<int> body = {};
+	};
+
+	static bool dominates(const std::vector<int>& idom, int a, int b)
+	{
+		while (b != a && b != 0)
+			b = idom[b];
+		return b == a;
+	}
+
+	// natural loops of back edges, innermost first; only the ones shaped like
+	// IRBuilder::build_loop builds them, guarded, with a preheader
+	static std::vector<Loop> find_loops(const IR::Function& func)
+	{
+		std::vector<int> rpo;
+		std::vector<int> idom = dominators(func, rpo);
+		std::vector<int> order(func.blocks.size(), -1);
+		for (size_t i = 0; i < rpo.size(); i++)
+			order[rpo[i]] = static_cast<int>(i);
+
+		// everything below only walks the loop itself, so a function full of loops stays linear
+		std::vector<Loop> res;
+		for (int header : rpo)
+		{
+			Loop loop{ header, -1, -1 };
+			for (int pred : func.blocks[header].preds)
+			{
+				// only an edge going back in reverse postorder can be a back edge, which
+				// saves walking the dominator tree up from every forward edge
+				if (order[pred] >= order[header] && dominates(idom, header, pred))
+					loop.latches.push_back(pred);
+			}
+			if (loop.latches.empty())
+				continue;
+
+			loop.body.insert(header);
+			std::vector<int> worklist = loop.latches;
+			while (!worklist.empty())
+			{
+				int block = worklist.back();
+				worklist.pop_back();
+				if (!loop.body.insert(block).second)
+					continue;
+				for (int pred : func.blocks[block].preds)
+					worklist.push_back(pred);
+			}
+			for (int block : loop.body)
+			{
+				if (order[block] >= 0)
+					loop.blocks.push_back(block);
+			}
+			std::sort(loop.blocks.begin(), loop.blocks.end(), [&](int a, int b) { return order[a] < order[b]; });
+
+			for (int pred : func.blocks[header].preds)
+			{
+				if (loop.body.contains(pred))
+					continue;
+				if (loop.preheader >= 0)
+				{
+					loop.preheader = -1;
+					break;
+				}
+				loop.preheader = pred;
+			}
+			if (loop.preheader < 0 || func.succs(loop.preheader).size() != 1 || func.blocks[loop.preheader].preds.size() != 1)
+				continue;
+
+			const IR::Inst& test = func.insts[func.blocks[header].insts.back()];
+			int guard = func.blocks[loop.preheader].preds[0];
+			const IR::Inst& guard_test = func.insts[func.blocks[guard].insts.back()];
+			if (test.op != IR::Op::BRANCH || !loop.body.contains(test.targets[0]) || guard_test.op != IR::Op::BRANCH ||
+				guard_test.targets[0] != loop.preheader || guard_test.targets[1] != test.targets[1])
+				continue;
+
+			loop.guard = guard;
+			res.push_back(std::move(loop));
+		}
+
+		std::stable_sort(res.begin(), res.end(), [](const Loop& a, const Loop& b) { return a.blocks.size() < b.blocks.size(); });
+		return res;
+	}
+
+	static void move_to_preheader(IR::Function& func, int inst, int preheader)
+	{
+		std::vector<int>& from = func.blocks[func.insts[inst].block].insts;
+		from.erase(std::find(from.begin(), from.end(), inst));
+		std::vector<int>& to = func.blocks[preheader].insts;
+		to.insert(to.end() - 1, inst);
+		func.insts[inst].block = preheader;
+	}
+
+	bool hoist_loop_invariants(IR::Function& func)
+	{
+		IR::infer_numbers(func);
+		std::vector<std::vector<int>> users = func.users();
+		std::vector<bool> hoist(func.insts.size(), false); // cleared again after every loop
+
+		bool changed = false;
+		for (const Loop& loop : find_loops(func))
+		{
+			// a global written inside the loop is not invariant, and only top-level code writes globals
+			std::unordered_map<int, bool> stored_slots;
+			for (int block : loop.blocks)
+			{
+				for (int id : func.blocks[block].insts)
+				{
+					if (func.insts[id].op == IR::Op::STORE_GLOBAL)
+						stored_slots[func.insts[id].index] = true;
+				}
+			}
+
+			// an instruction that may fail can still move out of the header, whose work the
+			// guard already did once successfully, and out of the start of the block entered
+			// from it, as long as nothing with an effect would be reordered
+			const std::vector<int>& header = func.blocks[loop.header].insts;
+			int first = func.insts[header.back()].targets[0];
+			bool calls = std::any_of(header.begin(), header.end(), [&](int id) { return func.insts[id].op == IR::Op::CALL; });
+			if (first == loop.header || func.blocks[first].preds.size() != 1 || calls)
+				first = -1;
+
+			std::vector<int> order;
+			for (int block : loop.blocks)
+			{
+				bool effects = false;
+				for (int id : func.blocks[block].insts)
+				{
+					const IR::Inst& inst = func.insts[id];
+					bool candidate = inst.op == IR::Op::CONST || inst.op == IR::Op::FUNC || IR::is_binary(inst.op) ||
+						(inst.op == IR::Op::LOAD_GLOBAL && !stored_slots.contains(inst.index));
+					bool invariant = std::all_of(inst.args.begin(), inst.args.end(),
+						[&](int arg) { return hoist[arg] || !loop.body.contains(func.insts[arg].block); });
+					bool removable = IR::is_removable(func, inst);
+					bool safe = removable || block == loop.header || (block == first && !effects);
+
+					if (candidate && invariant && safe)
+					{
+						hoist[id] = true;
+						order.push_back(id);
+					}
+					else if (!removable)
+						effects = true;
+				}
+			}
+
+			// constants and loads are only worth a slot when something computed from them moves too
+			for (int id : order)
+			{
+				const IR::Inst& inst = func.insts[id];
+				if (IR::is_binary(inst.op))
+					continue;
+				hoist[id] = std::any_of(users[id].begin(), users[id].end(), [&](int user) { return hoist[user]; });
+			}
+
+			for (int id : order)
+			{
+				if (!hoist[id])
+					continue;
+				move_to_preheader(func, id, loop.preheader);
+				hoist[id] = false;
+				changed = true;
+			}
+		}
+		return changed;
+	}
+
+	static bool int_const(const IR::Function& func, int value, int64_t& res)
+	{
+		const IR::Inst& inst = func.insts[value];
+		if (inst.op != IR::Op::CONST || !inst.imm.is_int())
+			return false;
+		res = inst.imm.operand();
+		return true;
+	}
+
+	// i = PHI(init, i + step), tested against a constant bound by the header
+	struct Induction
+	{
+		int phi;
+		int next;
+		int64_t init = 0;
+		int64_t step = 0;
+		int64_t limit = 0; // largest magnitude i or next can reach
+	};
+
+	static bool find_induction(const IR::Function& func, const Loop& loop, int phi, Induction& res)
+	{
+		const IR::Block& header = func.blocks[loop.header];
+		if (loop.latches.size() != 1 || header.preds.size() != 2)
+			return false;
+
+		size_t entry = header.preds[0] == loop.preheader ? 0 : 1;
+		const IR::Inst& inst = func.insts[phi];
+		int next = inst.args[1 - entry];
+		const IR::Inst& step = func.insts[next];
+		res = { phi, next };
+		if (!int_const(func, inst.args[entry], res.init) || !loop.body.contains(step.block))
+			return false;
+
+		if (step.op == IR::Op::ADD && step.args[0] == phi && int_const(func, step.args[1], res.step)) {}
+		else if (step.op == IR::Op::ADD && step.args[1] == phi && int_const(func, step.args[0], res.step)) {}
+		else if (step.op == IR::Op::SUB && step.args[0] == phi && int_const(func, step.args[1], res.step))
+			res.step = -res.step;
+		else
+			return false;
+
+		// the loop only runs while i moves towards the bound
+		const IR::Inst& test = func.insts[func.insts[header.insts.back()].args[0]];
+		if (test.args.size() != 2)
+			return false;
+
+		int64_t bound;
+		IR::Op op = test.op;
+		if (test.args[0] == phi && int_const(func, test.args[1], bound)) {}
+		else if (test.args[1] == phi && int_const(func, test.args[0], bound))
+		{
+			switch (op)
+			{
+				case IR::Op::LT: op = IR::Op::GT; break;
+				case IR::Op::GT: op = IR::Op::LT; break;
+				case IR::Op::LTE: op = IR::Op::GTE; break;
+				case IR::Op::GTE: op = IR::Op::LTE; break;
+				default: return false;
+			}
+		}
+		else
+			return false;
+
+		bool up = op == IR::Op::LT || op == IR::Op::LTE;
+		bool down = op == IR::Op::GT || op == IR::Op::GTE;
+		if (!((up && res.step > 0) || (down && res.step < 0)))
+			return false;
+
+		int64_t lo = std::min(res.init, bound) - std::abs(res.step);
+		int64_t hi = std::max(res.init, bound) + std::abs(res.step);
+		res.limit = std::max(std::abs(lo), std::abs(hi));
+		return res.limit < Value::INT_MAX_VAL;
+	}
+
+	bool reduce_strength(IR::Function& func)
+	{
+		bool changed = false;
+		for (const Loop& loop : find_loops(func))
+		{
+			size_t entry = func.blocks[loop.header].preds[0] == loop.preheader ? 0 : 1;
+			std::vector<int> phis = func.blocks[loop.header].phis;
+			for (int phi : phis)
+			{
+				Induction iv;
+				if (!find_induction(func, loop, phi, iv))
+					continue;
+
+				// i * k becomes t, with t starting at init * k and growing by step * k,
+				// as long as every product stays an exact integer
+				std::vector<int> muls;
+				for (int block : loop.blocks)
+				{
+					for (int id : func.blocks[block].insts)
+					{
+						if (func.insts[id].op == IR::Op::MUL)
+							muls.push_back(id);
+					}
+				}
+				std::sort(muls.begin(), muls.end());
+
+				std::unordered_map<int64_t, std::pair<int, int>> scaled; // k -> (t, t + step * k)
+				for (int id : muls)
+				{
+					IR::Inst& mul = func.insts[id];
+					if (mul.dead)
+						continue;
+
+					int64_t k;
+					int var = mul.args[0];
+					if (!int_const(func, mul.args[1], k))
+					{
+						var = mul.args[1];
+						if (!int_const(func, mul.args[0], k))
+							continue;
+					}
+
+					__int128 limit = static_cast<__int128>(iv.limit) * k;
+					if ((var != iv.phi && var != iv.next) || limit > Value::INT_MAX_VAL || -limit > Value::INT_MAX_VAL)
+						continue;
+
+					auto it = scaled.find(k);
+					if (it == scaled.end())
+					{
+						const std::vector<int>& pre = func.blocks[loop.preheader].insts;
+						int start = func.insert(loop.preheader, pre.size() - 1, { IR::Op::CONST, {}, Value::from_int(iv.init * k) });
+
+						int t = func.add_phi(loop.header);
+						func.insts[t].args.assign(2, -1);
+						func.insts[t].number = true;
+
+						int block = func.insts[iv.next].block;
+						const std::vector<int>& insts = func.blocks[block].insts;
+						size_t pos = std::find(insts.begin(), insts.end(), iv.next) - insts.begin() + 1;
+						int delta = func.insert(block, pos, { IR::Op::CONST, {}, Value::from_int(iv.step * k) });
+						int t_next = func.insert(block, pos + 1, { IR::Op::ADD, { t, delta } });
+
+						func.insts[t].args[entry] = start;
+						func.insts[t].args[1 - entry] = t_next;
+						it = scaled.emplace(k, std::make_pair(t, t_next)).first;
+					}
+
+					int to = var == iv.phi ? it->second.first : it->second.second;
+					func.replace_uses(id, to);
+					func.kill(id);
+					changed = true;
+				}
+			}
+		}
+		return changed;
+	}
+
+	// the function a callee value always holds, or -1
+	struct Callees
+	{
+		const IR::Module& module;
+		std::vector<int> global_func; // slot -> function stored there once and for all, or -1
+		std::vector<int> stored_at; // slot -> position of that store in the entry block of the top level
+
+		Callees(const IR::Module& module) : module(module)
+		{
+			// a single store of a function, made before the top level calls anything, is
+			// what every call through that global sees
+			const IR::Function& top = module.funcs[0];
+			global_func.assign(module.global_slots, -1);
+			stored_at.assign(module.global_slots, -1);
+			std::vector<int> stores(module.global_slots, 0);
+			int first_call = -1;
+			const std::vector<int>& entry = top.blocks[0].insts;
+			for (size_t pos = 0; pos < entry.size(); pos++)
+			{
+				const IR::Inst& inst = top.insts[entry[pos]];
+				if ((inst.op == IR::Op::CALL || inst.op == IR::Op::TAILCALL) && first_call < 0)
+					first_call = static_cast<int>(pos);
+				if (inst.op == IR::Op::STORE_GLOBAL && (first_call < 0 || static_cast<int>(pos) < first_call))
+				{
+					const IR::Inst& value = top.insts[follow(top, inst.args[0])];
+					global_func[inst.index] = value.op == IR::Op::FUNC ? value.index : -1;
+					stored_at[inst.index] = static_cast<int>(pos);
+				}
+			}
+
+			for (const IR::Inst& inst : top.insts)
+			{
+				if (!inst.dead && inst.op == IR::Op::STORE_GLOBAL)
+					stores[inst.index]++;
+			}
+			for (size_t slot = 0; slot < global_func.size(); slot++)
+			{
+				if (stores[slot] != 1)
+					global_func[slot] = -1;
+			}
+		}
+
+		static int follow(const IR::Function& func, int value)
+		{
+			while (func.insts[value].op == IR::Op::COPY)
+				value = func.insts[value].args[0];
+			return value;
+		}
+
+		int resolve(const IR::Function& func, int call) const
+		{
+			const IR::Inst& callee = func.insts[follow(func, func.insts[call].args[0])];
+			if (callee.op == IR::Op::FUNC)
+				return callee.index;
+			if (callee.op != IR::Op::LOAD_GLOBAL || global_func[callee.index] < 0)
+				return -1;
+
+			// the top level itself may still read the slot before the store
+			if (func.top_level)
+			{
+				const std::vector<int>& entry = func.blocks[0].insts;
+				auto load = std::find(entry.begin(), entry.end(), func.insts[call].args[0]);
+				if (load != entry.end() && load - entry.begin() < stored_at[callee.index])
+					return -1;
+			}
+			return global_func[callee.index];
+		}
+	};
+
+	// copies the body of callee in place of a call in func, parameters replaced by the arguments
+	static void inline_call(IR::Function& func, int call, const IR::Function& callee)
+	{
+		int block = func.insts[call].block;
+		bool tail = func.insts[call].op == IR::Op::TAILCALL;
+		std::vector<int> args(func.insts[call].args.begin() + 1, func.insts[call].args.end());
+
+		// everything after the call continues in a block of its own
+		int cont = -1;
+		if (!tail)
+		{
+			cont = func.add_block();
+			std::vector<int>& insts = func.blocks[block].insts;
+			auto rest = std::find(insts.begin(), insts.end(), call) + 1;
+			for (auto it = rest; it != insts.end(); it++)
+			{
+				func.insts[*it].block = cont;
+				func.blocks[cont].insts.push_back(*it);
+			}
+			insts.erase(rest, insts.end());
+
+			for (int succ : func.succs(cont))
+				std::replace(func.blocks[succ].preds.begin(), func.blocks[succ].preds.end(), block, cont);
+		}
+
+		std::vector<int> block_map(callee.blocks.size(), -1);
+		for (size_t b = 0; b < callee.blocks.size(); b++)
+		{
+			if (!callee.blocks[b].dead)
+				block_map[b] = func.add_block();
+		}
+
+		// operands can refer to values of blocks copied later, so they are mapped once everything exists
+		std::vector<int> value_map(callee.insts.size(), -1);
+		std::vector<int> copies;
+		std::vector<std::pair<int, int>> returns; // block -> returned value, still of the callee
+		for (size_t b = 0; b < callee.blocks.size(); b++)
+		{
+			const IR::Block& from = callee.blocks[b];
+			int to = block_map[b];
+			if (to < 0)
+				continue;
+
+			for (int pred : from.preds)
+				func.blocks[to].preds.push_back(block_map[pred]);
+			for (int phi : from.phis)
+			{
+				value_map[phi] = func.add_phi(to);
+				func.insts[value_map[phi]].args = callee.insts[phi].args;
+				copies.push_back(value_map[phi]);
+			}
+
+			for (int id : from.insts)
+			{
+				IR::Inst inst = callee.insts[id];
+				if (inst.op == IR::Op::PARAM)
+				{
+					value_map[id] = args[inst.index];
+					continue;
+				}
+
+				for (int i = 0; i < 2 && inst.targets[i] >= 0; i++)
+					inst.targets[i] = block_map[inst.targets[i]];
+
+				// returning goes on with the code after the call
+				if (!tail && (inst.op == IR::Op::RET || inst.op == IR::Op::TAILCALL))
+				{
+					int value = inst.args[0];
+					if (inst.op == IR::Op::TAILCALL)
+					{
+						inst.op = IR::Op::CALL;
+						value = id;
+						value_map[id] = func.insert(to, func.blocks[to].insts.size(), std::move(inst));
+						copies.push_back(value_map[id]);
+					}
+					returns.emplace_back(to, value);
+
+					IR::Inst jump{ IR::Op::JMP };
+					jump.targets[0] = cont;
+					func.insert(to, func.blocks[to].insts.size(), std::move(jump));
+					func.blocks[cont].preds.push_back(to);
+					continue;
+				}
+
+				value_map[id] = func.insert(to, func.blocks[to].insts.size(), std::move(inst));
+				copies.push_back(value_map[id]);
+			}
+		}
+
+		for (int id : copies)
+		{
+			for (int& arg : func.insts[id].args)
+				arg = value_map[arg];
+		}
+
+		IR::Inst enter{ IR::Op::JMP };
+		enter.targets[0] = block_map[0];
+		func.kill(call);
+		func.add(block, std::move(enter));
+
+		std::vector<int>& layout = func.layout;
+		auto pos = std::find(layout.begin(), layout.end(), block) + 1;
+		std::vector<int> added;
+		for (int b : callee.layout)
+		{
+			if (block_map[b] >= 0)
+				added.push_back(block_map[b]);
+		}
+		if (!tail)
+			added.push_back(cont);
+		layout.insert(pos, added.begin(), added.end());
+
+		if (tail)
+			return;
+
+		// the result, a PHI when the callee returns in several places
+		int result;
+		if (returns.size() == 1)
+			result = value_map[returns[0].second];
+		else if (returns.empty())
+			result = func.insert(cont, 0, { IR::Op::CONST, {}, { ValueType::NIL, -1 } });
+		else
+		{
+			result = func.add_phi(cont);
+			for (const auto& [from, value] : returns)
+				func.insts[result].args.push_back(value_map[value]);
+		}
+		func.replace_uses(call, result);
+	}
+
+	bool inline_calls(IR::Module& module, size_t threshold, std::vector<std::string>& inlined)
+	{
+		// resolved up front, inlining moves code of the top level out of its entry block
+		Callees callees(module);
+		size_t count = module.funcs.size();
+		std::vector<std::vector<std::pair<int, int>>> calls(count); // function -> (call, callee)
+		for (size_t f = 0; f < count; f++)
+		{
+			const IR::Function& func = module.funcs[f];
+			for (size_t i = 0; i < func.insts.size(); i++)
+			{
+				const IR::Inst& inst = func.insts[i];
+				if (inst.dead || (inst.op != IR::Op::CALL && inst.op != IR::Op::TAILCALL))
+					continue;
+				if (int target = callees.resolve(func, static_cast<int>(i)); target >= 0)
+					calls[f].emplace_back(static_cast<int>(i), target);
+			}
+		}
+
+		// callees before their callers, so what gets copied is already inlined into;
+		// a function that can reach itself is never copied
+		std::vector<int> order;
+		std::vector<int> state(count, 0); // 0: unvisited, 1: on the stack, 2: done
+		std::vector<bool> recursive(count, false);
+		std::vector<std::pair<int, size_t>> stack;
+		for (size_t root = 0; root < count; root++)
+		{
+			if (state[root] != 0)
+				continue;
+			stack.emplace_back(static_cast<int>(root), 0);
+			state[root] = 1;
+			while (!stack.empty())
+			{
+				auto& [f, next] = stack.back();
+				if (next < calls[f].size())
+				{
+					int callee = calls[f][next++].second;
+					if (state[callee] == 1)
+					{
+						for (auto it = stack.rbegin(); it != stack.rend(); it++)
+						{
+							recursive[it->first] = true;
+							if (it->first == callee)
+								break;
+						}
+					}
+					else if (state[callee] == 0)
+					{
+						state[callee] = 1;
+						stack.emplace_back(callee, 0);
+					}
+					continue;
+				}
+				state[f] = 2;
+				order.push_back(f);
+				stack.pop_back();
+			}
+		}
+
+		bool changed = false;
+		for (int f : order)
+		{
+			IR::Function& func = module.funcs[f];
+			for (auto [call, target] : calls[f])
+			{
+				const IR::Function& callee = module.funcs[target];
+				if (recursive[target] || target == f || callee.memoize || callee.size() > threshold ||
+					callee.params != func.insts[call].args.size() - 1 || !callee.blocks[0].phis.empty())
+					continue;
+
+				inline_call(func, call, callee);
+				inlined.push_back(callee.name + " into " + func.name);
+				changed = true;
+			}
+		}
+		return changed;
+	}
+
+	bool memoize(IR::Module& module, std::vector<std::string>& memoized)
+	{
+		// Looser than Callees: a global the top level only ever stores one function to
+		// holds NIL before that, and calling NIL is an error, so a call through it either
+		// reaches that function or ends the program before any result could be cached
+		const IR::Function& top = module.funcs[0];
+		std::vector<int> global_func(module.global_slots, -1);
+		std::vector<int> stores(module.global_slots, 0);
+		for (const IR::Inst& inst : top.insts)
+		{
+			if (inst.dead || inst.op != IR::Op::STORE_GLOBAL)
+				continue;
+
+			const IR::Inst& value = top.insts[Callees::follow(top, inst.args[0])];
+			global_func[inst.index] = stores[inst.index]++ == 0 && value.op == IR::Op::FUNC ? value.index : -1;
+		}
+
+		size_t count = module.funcs.size();
+		std::vector<bool> pure(count, false);
+		std::vector<std::vector<int>> calls(count); // function -> callee of each call
+		for (size_t f = 1; f < count; f++)
+		{
+			const IR::Function& func = module.funcs[f];
+			std::vector<std::vector<int>> users = func.users();
+			pure[f] = true;
+			for (const IR::Block& block : func.blocks)
+			{
+				if (block.dead)
+					continue;
+
+				for (int id : block.insts)
+				{
+					const IR::Inst& inst = func.insts[id];
+					switch (inst.op)
+					{
+						case IR::Op::LOAD_GLOBAL: // anything but calling it could see the NIL
+							pure[f] = pure[f] && global_func[inst.index] >= 0 &&
+								std::all_of(users[id].begin(), users[id].end(), [&](int user) {
+									const IR::Inst& call = func.insts[user];
+									return (call.op == IR::Op::CALL || call.op == IR::Op::TAILCALL) && call.args[0] == id &&
+										std::count(call.args.begin(), call.args.end(), id) == 1;
+								});
+							break;
+
+						case IR::Op::CALL:
+						case IR::Op::TAILCALL:
+						{
+							const IR::Inst& callee = func.insts[Callees::follow(func, inst.args[0])];
+							int target = callee.op == IR::Op::FUNC ? callee.index :
+								callee.op == IR::Op::LOAD_GLOBAL ? global_func[callee.index] : -1;
+							pure[f] = pure[f] && target > 0;
+							if (target >= 0)
+								calls[f].push_back(target);
+							break;
+						}
+
+						case IR::Op::STORE_GLOBAL:
+						case IR::Op::HLT:
+							pure[f] = false;
+							break;
+
+						default:
+							break;
+					}
+				}
+			}
+		}
+
+		// a call to anything impure makes the caller impure too
+		for (bool changed = true; changed;)
+		{
+			changed = false;
+			for (size_t f = 1; f < count; f++)
+			{
+				if (pure[f] && std::any_of(calls[f].begin(), calls[f].end(), [&](int callee) { return !pure[callee]; }))
+				{
+					pure[f] = false;
+					changed = true;
+				}
+			}
+		}
+
+		bool changed = false;
+		for (size_t f = 1; f < count; f++)
+		{
+			IR::Function& func = module.funcs[f];
+			if (!func.memoize && pure[f])
+			{
+				// functions that can call f, f itself included
+				std::vector<bool> reaches(count, false);
+				reaches[f] = true;
+				for (bool grew = true; grew;)
+				{
+					grew = false;
+					for (size_t g = 1; g < count; g++)
+					{
+						if (!reaches[g] && std::any_of(calls[g].begin(), calls[g].end(), [&](int callee) { return reaches[callee]; }))
+						{
+							reaches[g] = true;
+							grew = true;
+						}
+					}
+				}
+
+				size_t recursive_calls = std::count_if(calls[f].begin(), calls[f].end(), [&](int callee) { return reaches[callee]; });
+				func.memoize = recursive_calls >= 2;
+				changed |= func.memoize;
+			}
+
+			if (func.memoize)
+				memoized.push_back(func.name);
+		}
+		return changed;
+	}
+}
+
+// a pass over one function at a time
+static PassManager::Pass per_function(bool (*pass)(IR::Function&))
+{
+	return [pass](IR::Module& module) {
+		bool changed = false;
+		for (IR::Function& func : module.funcs)
+			changed |= pass(func);
+		return changed;
+	};
+}
+
+std::vector<std::string> PassManager::passes_for_level(int level)
+{
+	if (level <= 0)
+		return {};
+	if (level == 1)
+		return { "copyprop", "dce" };
+	return { "copyprop", "inline", "cse", "licm", "sr", "dce", "memo" };
+}
+
+PassManager::PassManager(std::ostream* print_ir, size_t inline_threshold) : m_print_ir(print_ir), m_inline_threshold(inline_threshold) {}
+
+void PassManager::add(const std::string& name)
+{
+	if (name == "copyprop")
+		m_passes.push_back({ name, per_function(IRPasses::copy_propagate) });
+
+	else if (name == "dce")
+		m_passes.push_back({ name, per_function(IRPasses::eliminate_dead_code) });
+
+	else if (name == "cse")
+		m_passes.push_back({ name, per_function(IRPasses::eliminate_common_subexpressions) });
+
+	else if (name == "licm")
+		m_passes.push_back({ name, per_function(IRPasses::hoist_loop_invariants) });
+
+	else if (name == "sr")
+		m_passes.push_back({ name, per_function(IRPasses::reduce_strength) });
+
+	else if (name == "inline")
+		m_passes.push_back({ name, [this](IR::Module& module) { return IRPasses::inline_calls(module, m_inline_threshold, m_inlined); } });
+
+	else if (name == "memo")
+		m_passes.push_back({ name, [this](IR::Module& module) { return IRPasses::memoize(module, m_memoized); } });
+
+	else
+		ERR_EXIT("Unknown IR pass: ", name);
+}
+
+void PassManager::run(IR::Module& module)
+{
+	m_built = module_size(module);
+	if (m_print_ir)
+	{
+		*m_print_ir << "; built, " << m_built << " instructions\n";
+		IR::print(module, *m_print_ir);
+	}
+
+	for (Entry& entry : m_passes)
+	{
+		size_t before = module_size(module);
+		entry.pass(module);
+
+		size_t after = module_size(module);
+		entry.removed += static_cast<int64_t>(before) - static_cast<int64_t>(after);
+		if (m_print_ir)
+		{
+			*m_print_ir << "; after " << entry.name << ", " << after << " instructions\n";
+			IR::print(module, *m_print_ir);
+		}
+	}
+	m_final = module_size(module);
+}
+
+void PassManager::report(std::ostream& out) const
+{
+	out << "ir: " << m_built << " instructions built";
+	for (const Entry& entry : m_passes)
+		out << ", " << entry.name << (entry.removed < 0 ? " +" : " -") << std::abs(entry.removed);
+	out << ", " << m_final << " left" << std::endl;
+
+	if (!m_memoized.empty())
+	{
+		out << "memo: " << m_memoized.size() << (m_memoized.size() == 1 ? " function" : " functions") << " memoized (";
+		for (size_t i = 0; i < m_memoized.size(); i++)
+			out << (i ? ", " : "") << m_memoized[i];
+		out << ")" << std::endl;
+	}
+
+	if (m_inlined.empty())
+		return;
+
+	// one entry per callee and caller, in the order they were first inlined
+	std::vector<std::pair<std::string, size_t>> counts;
+	for (const std::string& call : m_inlined)
+	{
+		auto it = std::find_if(counts.begin(), counts.end(), [&](const auto& count) { return count.first == call; });
+		if (it == counts.end())
+			counts.emplace_back(call, 1);
+		else
+			it->second++;
+	}
+
+	out << "inline: " << m_inlined.size() << (m_inlined.size() == 1 ? " call" : " calls") << " inlined (";
+	for (size_t i = 0; i < counts.size(); i++)
+	{
+		out << (i ? ", " : "") << counts[i].first;
+		if (counts[i].second > 1)
+			out << " x" << counts[i].second;
+	}
+	out << ")" << std::endl;
+}
\ No newline at end of file
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <functional>
+#include <ostream>
+
+#include "IR.h"
+
+// each pass returns whether it changed anything
+namespace IRPasses
+{
+	// replaces COPYs and PHIs whose operands are all the same value by that value
+	bool copy_propagate(IR::Function& func);
+
+	// folds branches on constants, drops unreachable blocks, merges blocks joined by a
+	// lone jump and drops every instruction whose value is never used and that can't have
+	// an effect (IR::is_removable)
+	bool eliminate_dead_code(IR::Function& func);
+
+	// dominator-based value numbering: an instruction computing the same pure operation
+	// on the same values as one that dominates it is replaced by that one
+	bool eliminate_common_subexpressions(IR::Function& func);
+
+	// moves computations whose operands don't change inside a loop to its preheader;
+	// one that may fail only moves if the loop would have run it first anyway
+	bool hoist_loop_invariants(IR::Function& func);
+
+	// turns i * k, for an integer induction variable i counting towards a constant bound,
+	// into a second induction variable stepping by k, when no product can leave the
+	// integer range
+	bool reduce_strength(IR::Function& func);
+
+	// copies the body of functions of at most threshold instructions into the places that
+	// call them, when the callee is known and can't end up calling itself; works on the
+	// whole module and records every inlined call as "callee into caller"
+	bool inline_calls(IR::Module& module, size_t threshold, std::vector<std::string>& inlined);
+
+	// marks functions for memoization that are pure (only read their parameters and call
+	// known pure functions) and call back into themselves from more than one place, which
+	// is what makes naive recursion exponential; records every memoized function, those
+	// asked for with @$ included
+	bool memoize(IR::Module& module, std::vector<std::string>& memoized);
+}
+
+// Runs a list of named passes over every function of a module, optionally printing the
+// IR after each one and counting how many instructions each pass removed (or added).
+class PassManager
+{
+public:
+	using Pass = std::function<bool(IR::Module&)>;
+
+	static constexpr size_t DEFAULT_INLINE_THRESHOLD = 24; // instructions of the callee
+
+	// the passes of -O1 and -O2; -O0 skips the IR altogether
+	static std::vector<std::string> passes_for_level(int level);
+
+	PassManager(std::ostream* print_ir = nullptr, size_t inline_threshold = DEFAULT_INLINE_THRESHOLD);
+	void add(const std::string& name); // one of copyprop, dce, cse, licm, sr, inline, memo
+	void run(IR::Module& module);
+	void report(std::ostream& out) const;
+
+private:
+	struct Entry
+	{
+		std::string name;
+		Pass pass;
+		int64_t removed = 0; // negative for passes that add code, like sr
+	};
+
+	std::vector<Entry> m_passes;
+	std::ostream* m_print_ir;
+	size_t m_inline_threshold;
+	std::vector<std::string> m_inlined;
+	std::vector<std::string> m_memoized;
+	size_t m_built = 0; // instructions before any pass
+	size_t m_final = 0;
+};
\ No newline at end of file
@@ -0,0 +1,843 @@
+#include "Jit.h"
+#include "Encoder.h"
+
+#include <map>
+#include <set>
+#include <cstddef>
+
+#ifdef PISP_JIT_X64
+#include <sys/mman.h>
+
+static_assert(sizeof(VM::Frame) == 16 && offsetof(VM::Frame, ret_ip) == 0 && offsetof(VM::Frame, bp) == 8,
+	"native calls write VM::Frame directly");
+
+static constexpr size_t JIT_BUFFER_SIZE = 16 * 1024 * 1024;
+static constexpr size_t MAX_FUNCTION_INSTRS = 20000;
+
+enum Reg
+{
+	RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+	R8, R9, R10, R11, R12, R13, R14, R15
+};
+
+// Register assignment inside native code:
+//   rbx  JitState*
+//   rbp  integer tag, or-ed into 48-bit payloads
+//   r12  sp
+//   r13  bp
+//   r14  stack base, for absolute slots and frame records
+//   r15  native table
+// rax, rcx, rdx and rsi are scratch. Nothing else is touched, so native code never
+// needs a C stack frame of its own.
+enum Cond
+{
+	CC_O = 0x0, CC_AE = 0x3, CC_E = 0x4, CC_NE = 0x5, CC_NP = 0xB,
+	CC_L = 0xC, CC_GE = 0xD, CC_LE = 0xE, CC_G = 0xF
+};
+
+enum AluOp
+{
+	ALU_ADD = 0x01, ALU_OR = 0x09, ALU_AND = 0x21, ALU_SUB = 0x29, ALU_CMP = 0x39, ALU_TEST = 0x85, ALU_MOV = 0x89
+};
+
+enum ShiftOp
+{
+	SHIFT_SHL = 4, SHIFT_SHR = 5, SHIFT_SAR = 7
+};
+
+// scalar double arithmetic, xmm0 and xmm1 are the only SSE registers used
+enum SseOp
+{
+	SSE_ADD = 0x58, SSE_MUL = 0x59, SSE_SUB = 0x5C, SSE_DIV = 0x5E
+};
+
+enum Xmm
+{
+	XMM0, XMM1
+};
+
+static constexpr int32_t STATE_STACK = offsetof(JitState, stack);
+static constexpr int32_t STATE_SP = offsetof(JitState, sp);
+static constexpr int32_t STATE_BP = offsetof(JitState, bp);
+static constexpr int32_t STATE_FRAMES = offsetof(JitState, frames);
+static constexpr int32_t STATE_FRAME_COUNT = offsetof(JitState, frame_count);
+static constexpr int32_t STATE_NATIVE = offsetof(JitState, native);
+static constexpr int32_t STATE_IP = offsetof(JitState, ip);
+static constexpr int32_t STATE_CALLED = offsetof(JitState, called);
+
+static constexpr int32_t INT_TAG = static_cast<int32_t>(Value::TAG_BASE >> Value::PAYLOAD_BITS);
+static constexpr int32_t ADDR_TAG = static_cast<int32_t>(Value(ValueType::ADDR, 0).bits() >> Value::PAYLOAD_BITS);
+static constexpr int TAG_SHIFT = 64 - Value::PAYLOAD_BITS;
+
+// Minimal x86-64 encoder, only the forms the templates use
+class Assembler
+{
+public:
+	size_t pos() const { return m_out.size(); }
+	std::vector<uint8_t>& bytes() { return m_out; }
+
+	void byte(uint8_t val) { m_out.push_back(val); }
+
+	void u32(uint32_t val)
+	{
+		for (int i = 0; i < 4; i++)
+			byte(static_cast<uint8_t>(val >> (i * 8)));
+	}
+
+	void u64(uint64_t val)
+	{
+		for (int i = 0; i < 8; i++)
+			byte(static_cast<uint8_t>(val >> (i * 8)));
+	}
+
+	void patch_rel32(size_t at, size_t target)
+	{
+		int32_t rel = static_cast<int32_t>(static_cast<int64_t>(target) - static_cast<int64_t>(at + 4));
+		for (int i = 0; i < 4; i++)
+			m_out[at + i] = static_cast<uint8_t>(static_cast<uint32_t>(rel) >> (i * 8));
+	}
+
+	void mov(Reg dst, Reg src) { alu(ALU_MOV, dst, src); }
+	void alu(AluOp op, Reg dst, Reg src) { rex_w(src, 0, dst); byte(op); byte(0xC0 | (src & 7) << 3 | (dst & 7)); }
+	void alu_imm(int ext, Reg dst, int32_t imm) { rex_w(0, 0, dst); byte(0x81); byte(0xC0 | ext << 3 | (dst & 7)); u32(imm); }
+	void add_imm(Reg dst, int32_t imm) { alu_imm(0, dst, imm); }
+	void sub_imm(Reg dst, int32_t imm) { alu_imm(5, dst, imm); }
+	void cmp_imm(Reg dst, int32_t imm) { alu_imm(7, dst, imm); }
+	void shift(ShiftOp op, Reg dst, uint8_t amount) { rex_w(0, 0, dst); byte(0xC1); byte(0xC0 | op << 3 | (dst & 7)); byte(amount); }
+	void imul(Reg dst, Reg src) { rex_w(dst, 0, src); byte(0x0F); byte(0xAF); byte(0xC0 | (dst & 7) << 3 | (src & 7)); }
+	void cqo() { byte(0x48); byte(0x99); }
+
+	// movq xmm, r64 / movq r64, xmm
+	void movq_to_xmm(Xmm dst, Reg src) { byte(0x66); rex_w(0, 0, src); byte(0x0F); byte(0x6E); byte(0xC0 | dst << 3 | (src & 7)); }
+	void movq_from_xmm(Reg dst, Xmm src) { byte(0x66); rex_w(0, 0, dst); byte(0x0F); byte(0x7E); byte(0xC0 | src << 3 | (dst & 7)); }
+	void sse(SseOp op, Xmm dst, Xmm src) { byte(0xF2); byte(0x0F); byte(op); byte(0xC0 | dst << 3 | src); }
+	void ucomisd(Xmm lhs, Xmm rhs) { byte(0x66); byte(0x0F); byte(0x2E); byte(0xC0 | lhs << 3 | rhs); }
+	void idiv(Reg src) { rex_w(0, 0, src); byte(0xF7); byte(0xF8 | (src & 7)); }
+
+	void load(Reg dst, Reg base, int32_t disp) { rex_w(dst, 0, base); byte(0x8B); mem(dst, base, disp); }
+	void store(Reg base, int32_t disp, Reg src) { rex_w(src, 0, base); byte(0x89); mem(src, base, disp); }
+	void store_imm(Reg base, int32_t disp, int32_t imm) { rex_w(0, 0, base); byte(0xC7); mem(0, base, disp); u32(imm); }
+	void lea(Reg dst, Reg base, int32_t disp) { rex_w(dst, 0, base); byte(0x8D); mem(dst, base, disp); }
+	void add_mem(Reg dst, Reg base, int32_t disp) { rex_w(dst, 0, base); byte(0x03); mem(dst, base, disp); }
+
+	// dst = [base + index * 8]
+	void load_index(Reg dst, Reg base, Reg index) { rex_w(dst, index, base); byte(0x8B); mem_index(dst, base, index); }
+	void lea_index(Reg dst, Reg base, Reg index) { rex_w(dst, index, base); byte(0x8D); mem_index(dst, base, index); }
+
+	void mov_imm(Reg dst, uint64_t imm) { rex_w(0, 0, dst); byte(0xB8 + (dst & 7)); u64(imm); }
+
+	// al = cc, cl = cc
+	void setcc_al(Cond cc) { byte(0x0F); byte(0x90 + cc); byte(0xC0); }
+	void setcc_cl(Cond cc) { byte(0x0F); byte(0x90 + cc); byte(0xC1); }
+	void and_al_cl() { byte(0x20); byte(0xC8); }
+	void or_al_cl() { byte(0x08); byte(0xC8); }
+	void movzx_rax_al() { byte(0x0F); byte(0xB6); byte(0xC0); }
+
+	// return the position of the rel32 to patch
+	size_t jmp() { byte(0xE9); u32(0); return pos() - 4; }
+	size_t jcc(Cond cc) { byte(0x0F); byte(0x80 + cc); u32(0); return pos() - 4; }
+
+	void jmp_reg(Reg target) { if (target >= R8) byte(0x41); byte(0xFF); byte(0xE0 | (target & 7)); }
+	void push(Reg reg) { if (reg >= R8) byte(0x41); byte(0x50 + (reg & 7)); }
+	void pop(Reg reg) { if (reg >= R8) byte(0x41); byte(0x58 + (reg & 7)); }
+	void ret() { byte(0xC3); }
+
+private:
+	void rex_w(int reg, int index, int base) { byte(static_cast<uint8_t>(0x48 | (reg >> 3) << 2 | (index >> 3) << 1 | (base >> 3))); }
+
+	// [base + disp32], rsp and r12 as a base need a SIB byte
+	void mem(int reg, Reg base, int32_t disp)
+	{
+		byte(0x80 | (reg & 7) << 3 | (base & 7));
+		if ((base & 7) == RSP)
+			byte(0x24);
+		u32(disp);
+	}
+
+	// [base + index * 8], rbp and r13 as a base need an explicit displacement
+	void mem_index(int reg, Reg base, Reg index)
+	{
+		bool disp8 = (base & 7) == RBP;
+		byte((disp8 ? 0x44 : 0x04) | (reg & 7) << 3);
+		byte(0xC0 | (index & 7) << 3 | (base & 7));
+		if (disp8)
+			byte(0);
+	}
+
+private:
+	std::vector<uint8_t> m_out;
+};
+
+// Translates one function, or the part of it reachable from a loop head. Every
+// instruction that may give up jumps to a stub that records its own byte offset as the
+// interpreter's ip, so the value stack is always left exactly as the interpreter expects
+// it before that instruction.
+class FunctionCompiler
+{
+public:
+	FunctionCompiler(const std::vector<uint8_t>& code, size_t load_addr, size_t exit_addr)
+		: m_code(code), m_load_addr(load_addr), m_exit_addr(exit_addr) {}
+
+	bool discover(size_t entry, bool memo_off);
+	void emit();
+
+	Assembler& assembler() { return m_asm; }
+	const std::set<size_t>& block_starts() const { return m_block_starts; }
+	size_t label(size_t ip) const { return m_labels.at(ip); }
+
+private:
+	void emit_instr(size_t ip, const Instr& instr, size_t next_ip);
+	void check_int(Reg reg, size_t ip);
+	void check_addr(Reg reg, size_t ip);
+	void check_double(Reg reg, size_t ip);
+	void tag_int(Reg reg);
+	void lookup_and_jump(bool called);
+	void binary_int(OpCode code, size_t ip);
+	void binary_double(SseOp op, size_t ip);
+	void compare(Cond cc, size_t ip);
+	void logical(bool is_and, size_t ip);
+	void add_imm(int64_t imm, size_t ip);
+	void branch(Cond cc, size_t target, size_t ip);
+
+	void bail(size_t at, size_t ip) { m_bails.emplace_back(at, ip); }
+	void jump_to(size_t at, size_t target) { m_jumps.emplace_back(at, target); }
+	void jump_exit(size_t at) { m_exits.push_back(at); }
+
+
+private:
+	const std::vector<uint8_t>& m_code;
+	const size_t m_load_addr;
+	const size_t m_exit_addr;
+	Assembler m_asm;
+	std::map<size_t, std::pair<Instr, size_t>> m_instrs; // byte offset -> instruction, offset of the next one
+	std::set<size_t> m_block_starts;
+	std::map<size_t, size_t> m_labels; // byte offset -> native offset
+	std::vector<std::pair<size_t, size_t>> m_bails; // rel32 position, byte offset to give up at
+	std::vector<std::pair<size_t, size_t>> m_jumps; // rel32 position, byte offset to jump to
+	std::vector<size_t> m_exits; // rel32 positions jumping to the exit routine
+	std::vector<size_t> m_call_exits; // rel32 positions: stop at the callee entry in rax
+	std::vector<size_t> m_resume_exits; // rel32 positions: stop at the return address in rax
+};
+
+static bool is_cond_jump(OpCode code)
+{
+	switch (code)
+	{
+		case OpCode::JMP_ZERO:
+		case OpCode::JMP_NONZERO:
+		case OpCode::JLT:
+		case OpCode::JGT:
+		case OpCode::JLTE:
+		case OpCode::JGTE:
+		case OpCode::JEQ:
+		case OpCode::JNE:
+		case OpCode::JNLT:
+		case OpCode::JNGT:
+		case OpCode::JNLTE:
+		case OpCode::JNGTE:
+			return true;
+
+		default:
+			return false;
+	}
+}
+
+// the function is everything reachable from its entry without following calls; a
+// memoized one only once its cache gave up, its native code then ignores the cache
+bool FunctionCompiler::discover(size_t entry, bool memo_off)
+{
+	std::vector<size_t> worklist{ entry };
+	m_block_starts.insert(entry);
+	while (!worklist.empty())
+	{
+		size_t ip = worklist.back();
+		worklist.pop_back();
+		if (m_instrs.contains(ip))
+			continue;
+
+		if (ip >= m_code.size() || m_instrs.size() >= MAX_FUNCTION_INSTRS)
+			return false;
+
+		size_t next = ip;
+		Instr instr = decode_instr(m_code, next);
+		if (instr.code == OpCode::MEMO && !memo_off)
+			return false; // the interpreter owns the caches
+		m_instrs[ip] = { instr, next };
+
+		if (instr.code == OpCode::JMP)
+		{
+			m_block_starts.insert(instr.val.operand());
+			worklist.push_back(instr.val.operand());
+		}
+		else if (is_cond_jump(instr.code))
+		{
+			m_block_starts.insert(instr.val.operand());
+			m_block_starts.insert(next);
+			worklist.push_back(instr.val.operand());
+			worklist.push_back(next);
+		}
+		else if (instr.code == OpCode::CALL)
+		{
+			m_block_starts.insert(next); // return address
+			worklist.push_back(next);
+		}
+		else if (instr.code != OpCode::RET && instr.code != OpCode::TAILCALL && instr.code != OpCode::MEMO_RET && instr.code != OpCode::HLT)
+			worklist.push_back(next);
+	}
+	return true;
+}
+
+void FunctionCompiler::emit()
+{
+	for (const auto& [ip, entry] : m_instrs)
+	{
+		if (m_block_starts.contains(ip))
+			m_labels[ip] = m_asm.pos();
+		emit_instr(ip, entry.first, entry.second);
+	}
+
+	// stubs handing control back to the interpreter
+	std::map<size_t, size_t> stubs;
+	for (const auto& [at, ip] : m_bails)
+	{
+		auto it = stubs.find(ip);
+		if (it == stubs.end())
+		{
+			it = stubs.emplace(ip, m_asm.pos()).first;
+			m_asm.store_imm(RBX, STATE_IP, static_cast<int32_t>(ip));
+			jump_exit(m_asm.jmp());
+		}
+		m_asm.patch_rel32(at, it->second);
+	}
+
+	if (!m_call_exits.empty())
+	{
+		size_t stub = m_asm.pos();
+		m_asm.store(RBX, STATE_IP, RAX);
+		m_asm.store_imm(RBX, STATE_CALLED, 1);
+		jump_exit(m_asm.jmp());
+		for (size_t at : m_call_exits)
+			m_asm.patch_rel32(at, stub);
+	}
+
+	if (!m_resume_exits.empty())
+	{
+		size_t stub = m_asm.pos();
+		m_asm.store(RBX, STATE_IP, RAX);
+		jump_exit(m_asm.jmp());
+		for (size_t at : m_resume_exits)
+			m_asm.patch_rel32(at, stub);
+	}
+
+	for (const auto& [at, target] : m_jumps)
+		m_asm.patch_rel32(at, m_labels.at(target));
+
+	// the exit routine lives outside this function, rel32 is relative to where the code gets loaded
+	for (size_t at : m_exits)
+		m_asm.patch_rel32(at, m_exit_addr - m_load_addr);
+}
+
+void FunctionCompiler::check_int(Reg reg, size_t ip)
+{
+	m_asm.mov(RDX, reg);
+	m_asm.shift(SHIFT_SHR, RDX, Value::PAYLOAD_BITS);
+	m_asm.cmp_imm(RDX, INT_TAG);
+	bail(m_asm.jcc(CC_NE), ip);
+}
+
+void FunctionCompiler::check_addr(Reg reg, size_t ip)
+{
+	m_asm.mov(RDX, reg);
+	m_asm.shift(SHIFT_SHR, RDX, Value::PAYLOAD_BITS);
+	m_asm.cmp_imm(RDX, ADDR_TAG);
+	bail(m_asm.jcc(CC_NE), ip);
+}
+
+// every tagged value sits at or above the tag base in rbp
+void FunctionCompiler::check_double(Reg reg, size_t ip)
+{
+	m_asm.alu(ALU_CMP, reg, RBP);
+	bail(m_asm.jcc(CC_AE), ip);
+}
+
+// reg holds a payload shifted into the top 48 bits
+void FunctionCompiler::tag_int(Reg reg)
+{
+	m_asm.shift(SHIFT_SHR, reg, TAG_SHIFT);
+	m_asm.alu(ALU_OR, reg, RBP);
+}
+
+// rax holds a byte offset: continue in its native code, or stop there
+void FunctionCompiler::lookup_and_jump(bool called)
+{
+	m_asm.load_index(RCX, R15, RAX);
+	m_asm.alu(ALU_TEST, RCX, RCX);
+	size_t at = m_asm.jcc(CC_E);
+	(called ? m_call_exits : m_resume_exits).push_back(at);
+	m_asm.jmp_reg(RCX);
+}
+
+// Integer payloads are shifted up into the top 48 bits, where the CPU's own
+// overflow flag tells whether the result still fits
+void FunctionCompiler::binary_int(OpCode code, size_t ip)
+{
+	m_asm.load(RAX, R12, -16);
+	m_asm.load(RCX, R12, -8);
+	check_int(RAX, ip);
+	check_int(RCX, ip);
+
+	switch (code)
+	{
+		case OpCode::ADD:
+		case OpCode::SUB:
+			m_asm.shift(SHIFT_SHL, RAX, TAG_SHIFT);
+			m_asm.shift(SHIFT_SHL, RCX, TAG_SHIFT);
+			m_asm.alu(code == OpCode::ADD ? ALU_ADD : ALU_SUB, RAX, RCX);
+			bail(m_asm.jcc(CC_O), ip);
+			tag_int(RAX);
+			break;
+
+		case OpCode::MUL:
+			m_asm.shift(SHIFT_SHL, RAX, TAG_SHIFT);
+			m_asm.shift(SHIFT_SAR, RAX, TAG_SHIFT);
+			m_asm.shift(SHIFT_SHL, RCX, TAG_SHIFT);
+			m_asm.imul(RAX, RCX);
+			bail(m_asm.jcc(CC_O), ip);
+			tag_int(RAX);
+			break;
+
+		case OpCode::DIV:
+			m_asm.shift(SHIFT_SHL, RAX, TAG_SHIFT);
+			m_asm.shift(SHIFT_SAR, RAX, TAG_SHIFT);
+			m_asm.shift(SHIFT_SHL, RCX, TAG_SHIFT);
+			m_asm.shift(SHIFT_SAR, RCX, TAG_SHIFT);
+			m_asm.alu(ALU_TEST, RCX, RCX);
+			bail(m_asm.jcc(CC_E), ip); // let the interpreter report it
+			m_asm.cqo();
+			m_asm.idiv(RCX);
+			m_asm.shift(SHIFT_SHL, RAX, TAG_SHIFT);
+			m_asm.mov(RDX, RAX);
+			m_asm.shift(SHIFT_SAR, RDX, TAG_SHIFT);
+			m_asm.shift(SHIFT_SHL, RDX, TAG_SHIFT);
+			m_asm.alu(ALU_CMP, RDX, RAX);
+			bail(m_asm.jcc(CC_NE), ip);
+			tag_int(RAX);
+			break;
+
+		case OpCode::BW_OR:
+			m_asm.alu(ALU_OR, RAX, RCX); // equal tags survive
+			break;
+
+		case OpCode::BW_AND:
+			m_asm.alu(ALU_AND, RAX, RCX);
+			break;
+
+		default:
+			break;
+	}
+
+	m_asm.store(R12, -16, RAX);
+	m_asm.lea(R12, R12, -8);
+}
+
+// only emitted where the interpreter quickened the instruction, a NaN result gets the
+// canonical bits Value::from_double gives it
+void FunctionCompiler::binary_double(SseOp op, size_t ip)
+{
+	m_asm.load(RAX, R12, -16);
+	m_asm.load(RCX, R12, -8);
+	check_double(RAX, ip);
+	check_double(RCX, ip);
+	m_asm.movq_to_xmm(XMM0, RAX);
+	m_asm.movq_to_xmm(XMM1, RCX);
+	m_asm.sse(op, XMM0, XMM1);
+	m_asm.movq_from_xmm(RAX, XMM0);
+	m_asm.ucomisd(XMM0, XMM0);
+	size_t not_nan = m_asm.jcc(CC_NP);
+	m_asm.mov_imm(RAX, Value::CANONICAL_NAN);
+	m_asm.patch_rel32(not_nan, m_asm.pos());
+	m_asm.store(R12, -16, RAX);
+	m_asm.lea(R12, R12, -8);
+}
+
+void FunctionCompiler::compare(Cond cc, size_t ip)
+{
+	m_asm.load(RAX, R12, -16);
+	m_asm.load(RCX, R12, -8);
+	check_int(RAX, ip);
+	check_int(RCX, ip);
+	m_asm.shift(SHIFT_SHL, RAX, TAG_SHIFT);
+	m_asm.shift(SHIFT_SHL, RCX, TAG_SHIFT);
+	m_asm.alu(ALU_CMP, RAX, RCX);
+	m_asm.setcc_al(cc);
+	m_asm.movzx_rax_al();
+	m_asm.alu(ALU_OR, RAX, RBP);
+	m_asm.store(R12, -16, RAX);
+	m_asm.lea(R12, R12, -8);
+}
+
+void FunctionCompiler::logical(bool is_and, size_t ip)
+{
+	m_asm.load(RAX, R12, -16);
+	m_asm.load(RCX, R12, -8);
+	check_int(RAX, ip);
+	check_int(RCX, ip);
+	m_asm.shift(SHIFT_SHL, RAX, TAG_SHIFT);
+	m_asm.shift(SHIFT_SHL, RCX, TAG_SHIFT);
+	m_asm.alu(ALU_TEST, RAX, RAX);
+	m_asm.setcc_al(CC_NE);
+	m_asm.alu(ALU_TEST, RCX, RCX);
+	m_asm.setcc_cl(CC_NE);
+	if (is_and)
+		m_asm.and_al_cl();
+	else
+		m_asm.or_al_cl();
+	m_asm.movzx_rax_al();
+	m_asm.alu(ALU_OR, RAX, RBP);
+	m_asm.store(R12, -16, RAX);
+	m_asm.lea(R12, R12, -8);
+}
+
+// rax holds an integer value, adds imm to it
+void FunctionCompiler::add_imm(int64_t imm, size_t ip)
+{
+	check_int(RAX, ip);
+	m_asm.shift(SHIFT_SHL, RAX, TAG_SHIFT);
+	m_asm.mov_imm(RCX, static_cast<uint64_t>(imm) << TAG_SHIFT);
+	m_asm.alu(ALU_ADD, RAX, RCX);
+	bail(m_asm.jcc(CC_O), ip);
+	tag_int(RAX);
+}
+
+// pops two integers and jumps to target when cc holds; lea keeps the flags of the cmp
+void FunctionCompiler::branch(Cond cc, size_t target, size_t ip)
+{
+	m_asm.load(RAX, R12, -16);
+	m_asm.load(RCX, R12, -8);
+	check_int(RAX, ip);
+	check_int(RCX, ip);
+	m_asm.shift(SHIFT_SHL, RAX, TAG_SHIFT);
+	m_asm.shift(SHIFT_SHL, RCX, TAG_SHIFT);
+	m_asm.alu(ALU_CMP, RAX, RCX);
+	m_asm.lea(R12, R12, -16);
+	jump_to(m_asm.jcc(cc), target);
+}
+
+void FunctionCompiler::emit_instr(size_t ip, const Instr& instr, size_t next_ip)
+{
+	constexpr int32_t VALUE_SIZE = sizeof(Value);
+	switch (instr.code)
+	{
+		case OpCode::PUSH:
+		case OpCode::LOAD_CONST:
+			m_asm.mov_imm(RAX, instr.val.bits());
+			m_asm.store(R12, 0, RAX);
+			m_asm.lea(R12, R12, VALUE_SIZE);
+			break;
+
+		case OpCode::POP:
+			m_asm.lea(R12, R12, -VALUE_SIZE);
+			break;
+
+		case OpCode::RESERVE:
+			m_asm.mov_imm(RAX, Value(ValueType::NIL, -1).bits());
+			for (int32_t i = 0; i < static_cast<int32_t>(instr.val.operand()); i++)
+				m_asm.store(R12, i * VALUE_SIZE, RAX);
+			m_asm.lea(R12, R12, static_cast<int32_t>(instr.val.operand()) * VALUE_SIZE);
+			break;
+
+		case OpCode::LOAD_LOCAL:
+		case OpCode::LOAD_GLOBAL:
+			m_asm.load(RAX, instr.code == OpCode::LOAD_LOCAL ? R13 : R14, static_cast<int32_t>(instr.val.operand()) * VALUE_SIZE);
+			m_asm.store(R12, 0, RAX);
+			m_asm.lea(R12, R12, VALUE_SIZE);
+			break;
+
+		case OpCode::MOV:
+			m_asm.load(RAX, R12, -VALUE_SIZE);
+			m_asm.lea(R12, R12, -VALUE_SIZE);
+			m_asm.store(R13, static_cast<int32_t>(instr.val.operand()) * VALUE_SIZE, RAX);
+			break;
+
+		case OpCode::ADD:
+		case OpCode::SUB:
+		case OpCode::MUL:
+		case OpCode::DIV:
+		case OpCode::BW_OR:
+		case OpCode::BW_AND:
+			binary_int(instr.code, ip);
+			break;
+
+		case OpCode::ADD_DBL: binary_double(SSE_ADD, ip); break;
+		case OpCode::SUB_DBL: binary_double(SSE_SUB, ip); break;
+		case OpCode::MUL_DBL: binary_double(SSE_MUL, ip); break;
+		case OpCode::DIV_DBL: binary_double(SSE_DIV, ip); break;
+
+		case OpCode::OR: logical(false, ip); break;
+		case OpCode::AND: logical(true, ip); break;
+
+		case OpCode::LT: compare(CC_L, ip); break;
+		case OpCode::GT: compare(CC_G, ip); break;
+		case OpCode::GTE: compare(CC_GE, ip); break;
+		case OpCode::LTE: compare(CC_LE, ip); break;
+		case OpCode::EQL: compare(CC_E, ip); break;
+
+		case OpCode::JMP:
+			jump_to(m_asm.jmp(), instr.val.operand());
+			break;
+
+		case OpCode::JMP_ZERO:
+		case OpCode::JMP_NONZERO:
+			m_asm.load(RAX, R12, -VALUE_SIZE);
+			check_int(RAX, ip);
+			m_asm.lea(R12, R12, -VALUE_SIZE);
+			m_asm.shift(SHIFT_SHL, RAX, TAG_SHIFT);
+			m_asm.alu(ALU_TEST, RAX, RAX);
+			jump_to(m_asm.jcc(instr.code == OpCode::JMP_ZERO ? CC_E : CC_NE), instr.val.operand());
+			break;
+
+		case OpCode::JLT: branch(CC_L, instr.val.operand(), ip); break;
+		case OpCode::JGT: branch(CC_G, instr.val.operand(), ip); break;
+		case OpCode::JLTE: branch(CC_LE, instr.val.operand(), ip); break;
+		case OpCode::JGTE: branch(CC_GE, instr.val.operand(), ip); break;
+		case OpCode::JEQ: branch(CC_E, instr.val.operand(), ip); break;
+		case OpCode::JNE: branch(CC_NE, instr.val.operand(), ip); break;
+
+		// integers only, so the negated comparisons are the plain opposite ones
+		case OpCode::JNLT: branch(CC_GE, instr.val.operand(), ip); break;
+		case OpCode::JNGT: branch(CC_LE, instr.val.operand(), ip); break;
+		case OpCode::JNLTE: branch(CC_G, instr.val.operand(), ip); break;
+		case OpCode::JNGTE: branch(CC_L, instr.val.operand(), ip); break;
+
+		case OpCode::ADD_IMM:
+			m_asm.load(RAX, R12, -VALUE_SIZE);
+			add_imm(instr.val.operand(), ip);
+			m_asm.store(R12, -VALUE_SIZE, RAX);
+			break;
+
+		case OpCode::ADD_LOCAL_IMM:
+			m_asm.load(RAX, R13, static_cast<int32_t>(instr.val.operand()) * VALUE_SIZE);
+			add_imm(instr.imm, ip);
+			m_asm.store(R12, 0, RAX);
+			m_asm.lea(R12, R12, VALUE_SIZE);
+			break;
+
+		case OpCode::INC_LOCAL:
+			m_asm.load(RAX, R13, static_cast<int32_t>(instr.val.operand()) * VALUE_SIZE);
+			add_imm(instr.imm, ip);
+			m_asm.store(R13, static_cast<int32_t>(instr.val.operand()) * VALUE_SIZE, RAX);
+			break;
+
+		case OpCode::CALL:
+		{
+			Reg base = instr.val.is(ValueType::ABS_VAR) ? R14 : R13;
+			m_asm.load(RAX, base, static_cast<int32_t>(instr.val.operand()) * VALUE_SIZE);
+			check_addr(RAX, ip);
+
+			m_asm.load(RCX, RBX, STATE_FRAME_COUNT);
+
+			// frames[frame_count++] = { next_ip, bp - stack }
+			m_asm.mov(RDX, RCX);
+			m_asm.shift(SHIFT_SHL, RDX, 4);
+			m_asm.add_mem(RDX, RBX, STATE_FRAMES);
+			m_asm.store_imm(RDX, 0, static_cast<int32_t>(next_ip));
+			m_asm.mov(RSI, R13);
+			m_asm.alu(ALU_SUB, RSI, R14);
+			m_asm.shift(SHIFT_SHR, RSI, 3);
+			m_asm.store(RDX, 8, RSI);
+			m_asm.add_imm(RCX, 1);
+			m_asm.store(RBX, STATE_FRAME_COUNT, RCX);
+
+			m_asm.lea(R13, R12, -instr.imm * VALUE_SIZE);
+			m_asm.shift(SHIFT_SHL, RAX, TAG_SHIFT);
+			m_asm.shift(SHIFT_SHR, RAX, TAG_SHIFT);
+			lookup_and_jump(true);
+			break;
+		}
+
+		case OpCode::TAILCALL:
+		{
+			Reg base = instr.val.is(ValueType::ABS_VAR) ? R14 : R13;
+			m_asm.load(RAX, base, static_cast<int32_t>(instr.val.operand()) * VALUE_SIZE);
+			check_addr(RAX, ip);
+
+			for (int i = 0; i < instr.imm; i++)
+			{
+				m_asm.load(RCX, R12, (i - instr.imm) * VALUE_SIZE);
+				m_asm.store(R13, i * VALUE_SIZE, RCX);
+			}
+			m_asm.lea(R12, R13, instr.imm * VALUE_SIZE);
+
+			m_asm.shift(SHIFT_SHL, RAX, TAG_SHIFT);
+			m_asm.shift(SHIFT_SHR, RAX, TAG_SHIFT);
+			lookup_and_jump(true);
+			break;
+		}
+
+		case OpCode::MEMO:
+			break;
+
+		case OpCode::RET:
+		case OpCode::MEMO_RET:
+		{
+			m_asm.load(RCX, RBX, STATE_FRAME_COUNT);
+			m_asm.alu(ALU_TEST, RCX, RCX);
+			bail(m_asm.jcc(CC_E), ip); // the top level returning ends the program
+
+			m_asm.load(RAX, R12, -VALUE_SIZE);
+			m_asm.sub_imm(RCX, 1);
+			m_asm.store(RBX, STATE_FRAME_COUNT, RCX);
+			m_asm.shift(SHIFT_SHL, RCX, 4);
+			m_asm.add_mem(RCX, RBX, STATE_FRAMES);
+
+			m_asm.store(R13, 0, RAX);
+			m_asm.lea(R12, R13, VALUE_SIZE);
+			m_asm.load(RDX, RCX, 8);
+			m_asm.lea_index(R13, R14, RDX);
+			m_asm.load(RAX, RCX, 0);
+			lookup_and_jump(false);
+			break;
+		}
+
+		default: // HLT
+			bail(m_asm.jmp(), ip);
+			break;
+	}
+}
+
+Jit::Jit(const std::vector<uint8_t>& code, size_t threshold)
+	: m_code(code), m_threshold(threshold), m_native(code.size() + 1, nullptr), m_counts(code.size() + 1, 0)
+{
+	void* mem = mmap(nullptr, JIT_BUFFER_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (mem == MAP_FAILED)
+		return;
+
+	m_buffer = static_cast<uint8_t*>(mem);
+	m_capacity = JIT_BUFFER_SIZE;
+
+	// void enter(JitState* state, const void* native)
+	Assembler as;
+	as.push(RBX);
+	as.push(RBP);
+	as.push(R12);
+	as.push(R13);
+	as.push(R14);
+	as.push(R15);
+	as.mov(RBX, RDI);
+	as.load(R12, RBX, STATE_SP);
+	as.load(R13, RBX, STATE_BP);
+	as.load(R14, RBX, STATE_STACK);
+	as.load(R15, RBX, STATE_NATIVE);
+	as.mov_imm(RBP, Value::TAG_BASE);
+	as.jmp_reg(RSI);
+
+	m_exit = as.pos();
+	as.store(RBX, STATE_SP, R12);
+	as.store(RBX, STATE_BP, R13);
+	as.pop(R15);
+	as.pop(R14);
+	as.pop(R13);
+	as.pop(R12);
+	as.pop(RBP);
+	as.pop(RBX);
+	as.ret();
+
+	std::copy(as.bytes().begin(), as.bytes().end(), m_buffer);
+	m_used = (as.pos() + 15) & ~size_t{ 15 };
+	mprotect(m_buffer, m_capacity, PROT_READ | PROT_EXEC);
+}
+
+Jit::~Jit()
+{
+	if (m_buffer)
+		munmap(m_buffer, m_capacity);
+}
+
+bool Jit::supported()
+{
+	return true;
+}
+
+bool Jit::compile(size_t entry)
+{
+	FunctionCompiler compiler(m_code, m_used, m_exit);
+	if (!compiler.discover(entry, m_memo_off.contains(entry)))
+		return false;
+	compiler.emit();
+
+	const std::vector<uint8_t>& bytes = compiler.assembler().bytes();
+	if (m_used + bytes.size() > m_capacity)
+		return false;
+
+	mprotect(m_buffer, m_capacity, PROT_READ | PROT_WRITE);
+	std::copy(bytes.begin(), bytes.end(), m_buffer + m_used);
+	mprotect(m_buffer, m_capacity, PROT_READ | PROT_EXEC);
+
+	for (size_t ip : compiler.block_starts())
+		m_native[ip] = m_buffer + m_used + compiler.label(ip);
+
+	LOGGER << "JIT: code at " << entry << " -> " << bytes.size() << " bytes" << std::endl;
+	m_used = (m_used + bytes.size() + 15) & ~size_t{ 15 };
+	m_compiled++;
+	return true;
+}
+
+void Jit::run(const void* native, JitState& state) const
+{
+	using Enter = void (*)(JitState*, const void*);
+	reinterpret_cast<Enter>(m_buffer)(&state, native);
+}
+
+#else
+
+Jit::Jit(const std::vector<uint8_t>& code, size_t threshold)
+	: m_code(code), m_threshold(threshold), m_native(code.size() + 1, nullptr), m_counts(code.size() + 1, 0) {}
+
+Jit::~Jit() = default;
+
+bool Jit::supported()
+{
+	return false;
+}
+
+bool Jit::compile(size_t)
+{
+	return false;
+}
+
+void Jit::run(const void*, JitState&) const {}
+
+#endif
+
+const void* Jit::on_entry(size_t entry)
+{
+	if (m_native[entry] || !m_buffer)
+		return m_native[entry];
+
+	// code that failed to compile stays past the threshold and is never retried
+	if (m_counts[entry] < m_threshold && ++m_counts[entry] < m_threshold)
+		return nullptr;
+
+	if (m_counts[entry] == m_threshold)
+	{
+		m_counts[entry]++;
+		compile(entry);
+	}
+	return m_native[entry];
+}
+
+void Jit::memo_off(size_t entry)
+{
+	m_memo_off.insert(entry);
+	m_counts[entry] = 0;
+}
+
+const void* const* Jit::native_table() const
+{
+	return m_native.data();
+}
+
+size_t Jit::compiled() const
+{
+	return m_compiled;
+}
\ No newline at end of file
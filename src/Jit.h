@@ -0,0 +1,78 @@
+#pragma once
+
+#include <set>
+
+#include "VM.h"
+
+// The JIT emits raw x86-64 and needs mmap, so it only exists on x86-64 Linux.
+// Everywhere else Jit never compiles anything and VM just interprets.
+#if defined(__x86_64__) && defined(__linux__)
+#define PISP_JIT_X64
+#endif
+
+// Everything native code reads or writes, handed over by VM on every entry.
+// Field offsets are baked into the generated code.
+struct JitState
+{
+	Value* stack;
+	Value* sp; // next free slot
+	Value* bp;
+	VM::Frame* frames;
+	size_t frame_count;
+	const void* const* native; // byte offset -> native code
+	uint64_t ip; // where the interpreter continues
+	uint64_t called; // 1 when native code stopped at the entry of a function it has no code for
+};
+
+// Baseline template JIT for the stack bytecode. A function is compiled once VM has
+// called it threshold times, and a loop once its back edge was taken threshold times,
+// so a single call running a hot loop (or a loop at the top level) gets native code
+// too. Every reachable instruction becomes a fixed x86-64
+// sequence working directly on the VM value stack, so native code can give control
+// back to the interpreter at any instruction boundary. It does so whenever an
+// operand isn't an integer (a double, at arithmetic the interpreter quickened to its
+// double form before compiling), an integer result leaves the 48-bit range, or the
+// instruction has no template (HLT, returning from the top level). Like the
+// interpreter it never checks for stack room, the guard pages of VM's stacks catch
+// overflows. Calls and returns between compiled functions stay
+// in native code.
+class Jit
+{
+public:
+	Jit(const std::vector<uint8_t>& code, size_t threshold);
+	~Jit();
+
+	static bool supported();
+
+	// counts a call to the function at entry or a jump back to the loop head at entry,
+	// returns its native code once there is some
+	const void* on_entry(size_t entry);
+
+	// native code that can take over at ip, if any
+	const void* resume_point(size_t ip) const
+	{
+		return m_native[ip];
+	}
+
+	// the cache of the memoized function at entry gave up, which lets it be compiled
+	void memo_off(size_t entry);
+
+	const void* const* native_table() const;
+	void run(const void* native, JitState& state) const;
+	size_t compiled() const;
+
+private:
+	bool compile(size_t entry);
+
+private:
+	const std::vector<uint8_t>& m_code;
+	const size_t m_threshold;
+	std::vector<const void*> m_native; // indexed by byte offset
+	std::vector<uint32_t> m_counts; // indexed by byte offset of a function entry or loop head
+	std::set<size_t> m_memo_off; // entries of memoized functions whose cache gave up
+	uint8_t* m_buffer = nullptr; // executable code, starts with the enter and exit routines
+	size_t m_capacity = 0;
+	size_t m_used = 0;
+	size_t m_exit = 0; // offset of the exit routine
+	size_t m_compiled = 0;
+};
\ No newline at end of file
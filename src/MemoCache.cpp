@@ -0,0 +1,66 @@
+#include "MemoCache.h"
+
+#include <bit>
+
+MemoCache::MemoCache(size_t argc) : m_argc(argc), m_keys(CAPACITY * argc), m_results(CAPACITY), m_used(CAPACITY, false) {}
+
+const Value* MemoCache::find(const Value* args)
+{
+	if (++m_window_lookups == CAPACITY)
+	{
+		m_active = m_window_hits * MIN_HIT_RATE >= CAPACITY;
+		m_window_hits = 0;
+		m_window_lookups = 0;
+	}
+
+	size_t idx = index(args);
+	if (m_used[idx])
+	{
+		const Value* key = &m_keys[idx * m_argc];
+		bool same = true;
+		for (size_t i = 0; i < m_argc && same; i++)
+			same = key[i].bits() == args[i].bits();
+
+		if (same)
+		{
+			m_hits++;
+			m_window_hits++;
+			return &m_results[idx];
+		}
+	}
+	m_misses++;
+	return nullptr;
+}
+
+void MemoCache::store(const Value* args, Value result)
+{
+	size_t idx = index(args);
+	for (size_t i = 0; i < m_argc; i++)
+		m_keys[idx * m_argc + i] = args[i];
+	m_results[idx] = result;
+	m_used[idx] = true;
+}
+
+bool MemoCache::active() const
+{
+	return m_active;
+}
+
+size_t MemoCache::hits() const
+{
+	return m_hits;
+}
+
+size_t MemoCache::misses() const
+{
+	return m_misses;
+}
+
+// multiplicative hashing of every argument, the high bits pick the entry
+size_t MemoCache::index(const Value* args) const
+{
+	uint64_t hash = 0;
+	for (size_t i = 0; i < m_argc; i++)
+		hash = (hash ^ args[i].bits()) * 0x9E3779B97F4A7C15ull;
+	return static_cast<size_t>(hash >> (64 - std::countr_zero(CAPACITY)));
+}
\ No newline at end of file
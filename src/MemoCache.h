@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "Value.h"
+
+// Results of one memoized function, keyed on the bits of its arguments. The table is
+// direct-mapped with a fixed number of entries, so a function called with ever new
+// arguments can't grow it: an entry simply replaces whatever hashed to the same
+// place before. A cache that answers less than one lookup in MIN_HIT_RATE over a
+// window of CAPACITY lookups turns itself off for good, the function then costs
+// no more than a plain one.
+class MemoCache
+{
+public:
+	static constexpr size_t CAPACITY = 4096; // entries, a power of two
+	static constexpr size_t MIN_HIT_RATE = 8;
+
+	MemoCache(size_t argc);
+
+	const Value* find(const Value* args); // the result cached for these arguments, if any
+	void store(const Value* args, Value result);
+	bool active() const;
+
+	size_t hits() const;
+	size_t misses() const;
+
+private:
+	size_t index(const Value* args) const;
+
+private:
+	size_t m_argc;
+	std::vector<Value> m_keys; // argc per entry
+	std::vector<Value> m_results;
+	std::vector<bool> m_used;
+	size_t m_hits = 0;
+	size_t m_misses = 0;
+	size_t m_window_hits = 0;
+	size_t m_window_lookups = 0;
+	bool m_active = true;
+};
\ No newline at end of file
@@ -0,0 +1,418 @@
+#include "Optimizer.h"
+
+Optimizer::Optimizer(const std::vector<Node::Node>& nodes, Arena& arena) : m_nodes(nodes), m_arena(arena) {}
+
+std::vector<Node::Node> Optimizer::optimize()
+{
+	FuncScope global{};
+	for (const Node::Node& node : m_nodes)
+	{
+		AsgnVisitor count = [&](const Node::StmtAsgn& asgn) {
+			if (std::holds_alternative<Node::Expr>(asgn.val))
+				global.assignments[asgn.id.id]++;
+		};
+
+		if (const auto* stmt = std::get_if<Node::Stmt>(&node.node))
+			for_each_asgn(*stmt, count);
+		else if (const auto* expr = std::get_if<Node::Expr>(&node.node))
+			for_each_asgn(*expr, count);
+	}
+	m_scope = &global;
+
+	std::vector<Node::Node> res;
+	for (const Node::Node& node : m_nodes)
+	{
+		if (const auto* stmt = std::get_if<Node::Stmt>(&node.node))
+		{
+			std::vector<Node::Stmt> out;
+			optimize_stmt(*stmt, out, true);
+			for (Node::Stmt& optimized : out)
+				res.push_back(Node::Node{ std::move(optimized) });
+		}
+		else if (const auto* expr = std::get_if<Node::Expr>(&node.node))
+			res.push_back(Node::Node{ optimize_expr(*expr) });
+		else
+			res.push_back(node);
+	}
+
+	m_scope = nullptr;
+	return res;
+}
+
+size_t Optimizer::folded() const
+{
+	return m_folded;
+}
+
+size_t Optimizer::propagated() const
+{
+	return m_propagated;
+}
+
+size_t Optimizer::pruned() const
+{
+	return m_pruned;
+}
+
+// straight_line: every statement runs exactly once per execution of the enclosing function
+Node::Scope Optimizer::optimize_scope(const Node::Scope& scope, bool straight_line)
+{
+	std::vector<Node::Stmt> out;
+	optimize_stmts(scope.stmts, out, straight_line);
+	return Node::Scope{ m_arena.copy(out) };
+}
+
+void Optimizer::optimize_stmts(std::span<const Node::Stmt> stmts, std::vector<Node::Stmt>& out, bool straight_line)
+{
+	for (const Node::Stmt& stmt : stmts)
+		optimize_stmt(stmt, out, straight_line);
+}
+
+void Optimizer::optimize_stmt(const Node::Stmt& stmt, std::vector<Node::Stmt>& out, bool straight_line)
+{
+	struct Visitor
+	{
+		Optimizer& optimizer;
+		std::vector<Node::Stmt>& out;
+		bool straight_line;
+
+		void operator()(const Node::StmtAsgn& asgn)
+		{
+			out.push_back(Node::Stmt{ optimizer.optimize_asgn(asgn, straight_line) });
+		}
+
+		void operator()(const Node::StmtIf& if_stmt)
+		{
+			optimizer.optimize_if(if_stmt, out);
+		}
+
+		// same order as Compiler::compile_loop, which is the order variables get declared in
+		void operator()(const Node::StmtLoop& loop)
+		{
+			Node::StmtLoop res;
+			if (loop.init)
+				res.init = optimizer.m_arena.make<Node::StmtAsgn>(optimizer.optimize_asgn(*loop.init, false));
+
+			res.cond = optimizer.optimize_expr(loop.cond);
+			res.scope = optimizer.m_arena.make<Node::Scope>(optimizer.optimize_scope(*loop.scope, false));
+
+			if (loop.adv)
+				res.adv = optimizer.m_arena.make<Node::StmtAsgn>(optimizer.optimize_asgn(*loop.adv, false));
+
+			out.push_back(Node::Stmt{ std::move(res) });
+		}
+
+		void operator()(const Node::StmtRet& ret)
+		{
+			Node::StmtRet res;
+			if (ret.ret_val.has_value())
+				res.ret_val = optimizer.optimize_expr(ret.ret_val.value());
+
+			out.push_back(Node::Stmt{ std::move(res) });
+		}
+	};
+	std::visit(Visitor{ *this, out, straight_line }, stmt.stmt);
+}
+
+Node::StmtAsgn Optimizer::optimize_asgn(const Node::StmtAsgn& asgn, bool straight_line)
+{
+	Symbol id = asgn.id.id;
+	if (const auto* strct = std::get_if<Node::Struct>(&asgn.val))
+	{
+		m_scope->declared_funcs.insert(id); // visible inside its own body, for recursion
+		const auto& func = std::get<Node::StructFuncDecl>(strct->strct);
+		return { asgn.id, Node::Struct{ optimize_func(func) } };
+	}
+
+	// the value is compiled before the variable is declared, so it still sees an outer one
+	Node::Expr val = optimize_expr(std::get<Node::Expr>(asgn.val));
+	m_scope->declared_vars.insert(id);
+
+	if (straight_line && m_scope->assignments[id] == 1 && !m_scope->params.contains(id))
+	{
+		if (const auto* lit = std::get_if<Node::Lit>(&val.expr); lit && !std::holds_alternative<Node::LitIdent>(lit->lit))
+			m_scope->constants[id] = *lit;
+	}
+	return { asgn.id, std::move(val) };
+}
+
+void Optimizer::optimize_if(const Node::StmtIf& stmt, std::vector<Node::Stmt>& out)
+{
+	std::vector<const Node::StmtIf*> links;
+	for (const Node::StmtIf* link = &stmt; link; link = link->elif)
+		links.push_back(link);
+
+	// dropped branches must not declare anything, the compilers declare variables even
+	// in branches that never run
+	auto rest_declares = [&](size_t from) {
+		for (size_t i = from; i < links.size(); i++)
+		{
+			if (declares_new(links[i]->scope->stmts))
+				return true;
+		}
+		return false;
+	};
+
+	std::vector<Node::StmtIf> kept;
+	for (size_t i = 0; i < links.size(); i++)
+	{
+		Node::Expr cond = optimize_expr(links[i]->cond);
+		std::optional<Value> val = constant_of(cond);
+		if (val.has_value() && !val->truthy() && !declares_new(links[i]->scope->stmts))
+		{
+			m_pruned++;
+			continue;
+		}
+
+		const Node::Scope* body = m_arena.make<Node::Scope>(optimize_scope(*links[i]->scope, false));
+		kept.push_back(Node::StmtIf{ std::move(cond), body });
+
+		if (val.has_value() && val->truthy() && !rest_declares(i + 1))
+		{
+			m_pruned += links.size() - i - 1;
+			break;
+		}
+	}
+
+	if (kept.empty())
+		return;
+
+	// a condition known to hold is as good as no condition at all
+	if (std::optional<Value> val = constant_of(kept[0].cond); kept.size() == 1 && val.has_value() && val->truthy())
+	{
+		m_pruned++;
+		out.insert(out.end(), kept[0].scope->stmts.begin(), kept[0].scope->stmts.end());
+		return;
+	}
+
+	for (size_t i = kept.size() - 1; i > 0; i--)
+		kept[i - 1].elif = m_arena.make<Node::StmtIf>(std::move(kept[i]));
+
+	out.push_back(Node::Stmt{ std::move(kept[0]) });
+}
+
+Node::StructFuncDecl Optimizer::optimize_func(const Node::StructFuncDecl& func)
+{
+	FuncScope scope{};
+	scope.parent = m_scope;
+	for (const Node::LitIdent& param : func.params)
+	{
+		scope.params.insert(param.id);
+		scope.declared_vars.insert(param.id);
+	}
+
+	for_each_asgn(func.scope.stmts, [&](const Node::StmtAsgn& asgn) {
+		if (std::holds_alternative<Node::Expr>(asgn.val))
+			scope.assignments[asgn.id.id]++;
+	});
+
+	m_scope = &scope;
+	Node::StructFuncDecl res{ func.params, optimize_scope(func.scope, true), func.memo };
+	m_scope = scope.parent;
+	return res;
+}
+
+Node::Expr Optimizer::optimize_expr(const Node::Expr& expr)
+{
+	struct Visitor
+	{
+		Optimizer& optimizer;
+
+		Node::Expr operator()(const Node::BinExpr& bin_expr)
+		{
+			Node::Expr lhs = optimizer.optimize_expr(*bin_expr.lhs);
+			Node::Expr rhs = optimizer.optimize_expr(*bin_expr.rhs);
+
+			std::optional<Value> lhs_val = constant_of(lhs);
+			std::optional<Value> rhs_val = constant_of(rhs);
+			if (lhs_val.has_value() && rhs_val.has_value())
+			{
+				if (auto lit = optimizer.fold(bin_expr.op.value(), lhs_val.value(), rhs_val.value()))
+				{
+					optimizer.m_folded++;
+					return Node::Expr{ lit.value() };
+				}
+			}
+
+			return Node::Expr{ Node::BinExpr{ optimizer.m_arena.make<Node::Expr>(std::move(lhs)),
+				optimizer.m_arena.make<Node::Expr>(std::move(rhs)), bin_expr.op } };
+		}
+
+		Node::Expr operator()(const Node::Lit& lit)
+		{
+			if (const auto* ident = std::get_if<Node::LitIdent>(&lit.lit))
+			{
+				if (auto val = optimizer.lookup(ident->id))
+				{
+					optimizer.m_propagated++;
+					return Node::Expr{ val.value() };
+				}
+			}
+			return Node::Expr{ lit };
+		}
+
+		// arguments first, then an inline function body, like Compiler::compile_call
+		Node::Expr operator()(const Node::Call& call)
+		{
+			Node::Call res{ call.fn, {} };
+			std::vector<Node::Expr> args;
+			for (const Node::Expr& arg : call.args)
+				args.push_back(optimizer.optimize_expr(arg));
+			res.args = optimizer.m_arena.copy(args);
+
+			if (const auto* func = std::get_if<const Node::StructFuncDecl*>(&call.fn))
+			{
+				res.fn = optimizer.m_arena.make<Node::StructFuncDecl>((*func)->params, optimizer.optimize_scope((*func)->scope, false), (*func)->memo);
+			}
+			return Node::Expr{ std::move(res) };
+		}
+	};
+	return std::visit(Visitor{ *this }, expr.expr);
+}
+
+std::optional<Node::Lit> Optimizer::fold(TokenTypes::Operator op, Value lhs, Value rhs)
+{
+	Value res;
+	switch (op)
+	{
+		case TokenTypes::Operator::ADD: res = ValueOps::add(lhs, rhs); break;
+		case TokenTypes::Operator::SUB: res = ValueOps::sub(lhs, rhs); break;
+		case TokenTypes::Operator::MUL: res = ValueOps::mul(lhs, rhs); break;
+
+		case TokenTypes::Operator::DIV:
+			if (Value::both_int(lhs, rhs) && rhs.operand() == 0) // left for the runtime error
+				return {};
+			res = ValueOps::div(lhs, rhs);
+			break;
+
+		case TokenTypes::Operator::BW_OR:
+		case TokenTypes::Operator::BW_AND:
+			if (!Value::both_int(lhs, rhs))
+				return {};
+			res = op == TokenTypes::Operator::BW_OR ? ValueOps::bw_or(lhs, rhs) : ValueOps::bw_and(lhs, rhs);
+			break;
+
+		case TokenTypes::Operator::OR: res = ValueOps::logical_or(lhs, rhs); break;
+		case TokenTypes::Operator::AND: res = ValueOps::logical_and(lhs, rhs); break;
+
+		case TokenTypes::Operator::LT: res = Value::from_bool(ValueOps::lt(lhs, rhs)); break;
+		case TokenTypes::Operator::LTE: res = Value::from_bool(ValueOps::lte(lhs, rhs)); break;
+		case TokenTypes::Operator::GT: res = Value::from_bool(ValueOps::gt(lhs, rhs)); break;
+		case TokenTypes::Operator::GTE: res = Value::from_bool(ValueOps::gte(lhs, rhs)); break;
+		case TokenTypes::Operator::EQL: res = Value::from_bool(ValueOps::eql(lhs, rhs)); break;
+
+		default:
+			return {};
+	}
+
+	if (res.is_int())
+		return Node::Lit{ Node::LitInt{ res.operand() } };
+	return Node::Lit{ Node::LitFloat{ res.as_double() } };
+}
+
+// a variable is looked up in the innermost function that assigns it anywhere, before its
+// declaration the compilers would resolve it further out, so it's simply not known there
+std::optional<Node::Lit> Optimizer::lookup(Symbol name) const
+{
+	for (const FuncScope* scope = m_scope; scope; scope = scope->parent)
+	{
+		if (scope->params.contains(name) || scope->assignments.contains(name))
+		{
+			auto it = scope->constants.find(name);
+			if (it == scope->constants.end())
+				return {};
+			return it->second;
+		}
+	}
+	return {};
+}
+
+bool Optimizer::declares_new(std::span<const Node::Stmt> stmts) const
+{
+	bool res = false;
+	for_each_asgn(stmts, [&](const Node::StmtAsgn& asgn) {
+		if (std::holds_alternative<Node::Struct>(asgn.val))
+			res |= !m_scope->declared_funcs.contains(asgn.id.id);
+		else
+			res |= !m_scope->declared_vars.contains(asgn.id.id);
+	});
+	return res;
+}
+
+std::optional<Value> Optimizer::constant_of(const Node::Expr& expr)
+{
+	const auto* lit = std::get_if<Node::Lit>(&expr.expr);
+	if (!lit)
+		return {};
+
+	if (const auto* integer = std::get_if<Node::LitInt>(&lit->lit))
+		return Value::from_int(integer->val);
+	if (const auto* number = std::get_if<Node::LitFloat>(&lit->lit))
+		return Value::from_double(number->val);
+	return {};
+}
+
+// every assignment that lands in the current function, function bodies are their own
+void Optimizer::for_each_asgn(std::span<const Node::Stmt> stmts, const AsgnVisitor& visit)
+{
+	for (const Node::Stmt& stmt : stmts)
+		for_each_asgn(stmt, visit);
+}
+
+void Optimizer::for_each_asgn(const Node::Stmt& stmt, const AsgnVisitor& visit)
+{
+	struct Visitor
+	{
+		const AsgnVisitor& visit;
+
+		void operator()(const Node::StmtAsgn& asgn)
+		{
+			visit(asgn);
+			if (const auto* expr = std::get_if<Node::Expr>(&asgn.val))
+				for_each_asgn(*expr, visit);
+		}
+
+		void operator()(const Node::StmtIf& if_stmt)
+		{
+			for_each_asgn(if_stmt.cond, visit);
+			for_each_asgn(if_stmt.scope->stmts, visit);
+			if (if_stmt.elif)
+				(*this)(*if_stmt.elif);
+		}
+
+		void operator()(const Node::StmtLoop& loop)
+		{
+			if (loop.init)
+				(*this)(*loop.init);
+			for_each_asgn(loop.cond, visit);
+			for_each_asgn(loop.scope->stmts, visit);
+			if (loop.adv)
+				(*this)(*loop.adv);
+		}
+
+		void operator()(const Node::StmtRet& ret)
+		{
+			if (ret.ret_val.has_value())
+				for_each_asgn(ret.ret_val.value(), visit);
+		}
+	};
+	std::visit(Visitor{ visit }, stmt.stmt);
+}
+
+void Optimizer::for_each_asgn(const Node::Expr& expr, const AsgnVisitor& visit)
+{
+	if (const auto* bin_expr = std::get_if<Node::BinExpr>(&expr.expr))
+	{
+		for_each_asgn(*bin_expr->lhs, visit);
+		for_each_asgn(*bin_expr->rhs, visit);
+	}
+	else if (const auto* call = std::get_if<Node::Call>(&expr.expr))
+	{
+		for (const Node::Expr& arg : call->args)
+			for_each_asgn(arg, visit);
+
+		// an inline function body is compiled straight into the caller
+		if (const auto* func = std::get_if<const Node::StructFuncDecl*>(&call->fn))
+			for_each_asgn((*func)->scope.stmts, visit);
+	}
+}
\ No newline at end of file
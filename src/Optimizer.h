@@ -0,0 +1,67 @@
+#pragma once
+
+#include <unordered_map>
+#include <unordered_set>
+#include <functional>
+
+#include "Parser.h"
+#include "Value.h"
+
+// AST pass run between Parser and either compiler:
+//  - folds operators whose operands are both literals, evaluating them with the same
+//    ValueOps the VMs use so the result is bit-identical (anything that would raise an
+//    error at runtime, like an integer division by zero, is left alone)
+//  - propagates variables assigned exactly once in their function, unconditionally and
+//    from a constant, into every later use; the assignment itself stays because it
+//    allocates the variable's slot
+//  - prunes ? / !? / ! branches whose condition is constant, unless a dropped branch
+//    would have declared a variable (declarations shape the frame layout)
+class Optimizer
+{
+public:
+	Optimizer(const std::vector<Node::Node>& nodes, Arena& arena); // new nodes are made in arena
+	std::vector<Node::Node> optimize();
+
+	size_t folded() const;
+	size_t propagated() const;
+	size_t pruned() const;
+
+private:
+	// one per function body, mirroring the Env the compilers build
+	struct FuncScope
+	{
+		std::unordered_set<Symbol> params;
+		std::unordered_map<Symbol, size_t> assignments; // name -> number of assignments anywhere in the body
+		std::unordered_map<Symbol, Node::Lit> constants;
+		std::unordered_set<Symbol> declared_vars; // declared so far
+		std::unordered_set<Symbol> declared_funcs;
+		FuncScope* parent;
+	};
+
+	using AsgnVisitor = std::function<void(const Node::StmtAsgn&)>;
+
+	Node::Scope optimize_scope(const Node::Scope& scope, bool straight_line);
+	void optimize_stmts(std::span<const Node::Stmt> stmts, std::vector<Node::Stmt>& out, bool straight_line);
+	void optimize_stmt(const Node::Stmt& stmt, std::vector<Node::Stmt>& out, bool straight_line);
+	Node::StmtAsgn optimize_asgn(const Node::StmtAsgn& asgn, bool straight_line);
+	void optimize_if(const Node::StmtIf& stmt, std::vector<Node::Stmt>& out);
+	Node::StructFuncDecl optimize_func(const Node::StructFuncDecl& func);
+	Node::Expr optimize_expr(const Node::Expr& expr);
+	std::optional<Node::Lit> fold(TokenTypes::Operator op, Value lhs, Value rhs);
+
+	std::optional<Node::Lit> lookup(Symbol name) const;
+	bool declares_new(std::span<const Node::Stmt> stmts) const;
+
+	static std::optional<Value> constant_of(const Node::Expr& expr);
+	static void for_each_asgn(std::span<const Node::Stmt> stmts, const AsgnVisitor& visit);
+	static void for_each_asgn(const Node::Stmt& stmt, const AsgnVisitor& visit);
+	static void for_each_asgn(const Node::Expr& expr, const AsgnVisitor& visit);
+
+private:
+	const std::vector<Node::Node>& m_nodes;
+	Arena& m_arena;
+	FuncScope* m_scope = nullptr;
+	size_t m_folded = 0;
+	size_t m_propagated = 0;
+	size_t m_pruned = 0;
+};
\ No newline at end of file
@@ -1,362 +1,329 @@
 #include "Parser.h"
 #include "Utils.h"
 
-Parser::Parser(std::vector<Token>& tokens) : m_tokens(std::move(tokens)), m_index(0) {}
+#include <array>
 
-std::vector<Node::Node> Parser::parse_prog()
+// the items pushed onto stack since first, copied into the arena and popped
+template<typename T>
+static std::span<const T> take(Arena& arena, std::vector<T>& stack, size_t first)
 {
-	std::vector<Node::Node> prog;
-	while (peek().has_value())
-	{
-		auto node = strict(parse_node());
-		prog.push_back(node);
-	}
-	return prog;
+	std::span<const T> res = arena.copy(std::span<const T>(stack).subspan(first));
+	stack.resize(first);
+	return res;
 }
 
-std::optional<Node::Node> Parser::parse_node()
-{
-	if (auto node = parse_stmt())
-		return Node::Node{ std::move(node.value()) };
-
-	else if (auto node = parse_expr())
-		return Node::Node{ std::move(node.value()) };
-
-	else if (auto node = parse_struct())
-		return Node::Node{ std::move(node.value()) };
+Parser::Parser(std::vector<Token>& tokens, Arena& arena) : m_tokens(std::move(tokens)), m_arena(arena), m_index(0) {}
 
-	else if (auto node = parse_scope())
-		return Node::Node{ std::move(node.value()) };
-	
-	return {};
+Parser::Kind Parser::kind_of(const TokenType& type)
+{
+	static_assert(static_cast<int>(Kind::SYMBOL_NONE) - static_cast<int>(Kind::OPEN_PAREN) == static_cast<int>(TokenTypes::Symbol::NONE));
+	static_assert(static_cast<int>(Kind::OPERATOR_NONE) - static_cast<int>(Kind::ASGN) == static_cast<int>(TokenTypes::Operator::NONE));
+	static_assert(static_cast<int>(Kind::LITERAL_NONE) - static_cast<int>(Kind::INT) == static_cast<int>(TokenTypes::Literal::NONE));
+	static_assert(static_cast<int>(Kind::STATEMENT_NONE) - static_cast<int>(Kind::IF) == static_cast<int>(TokenTypes::Statement::NONE));
+	static_assert(static_cast<int>(Kind::MEMO_FUNC) - static_cast<int>(Kind::FUNC) == static_cast<int>(TokenTypes::Struct::MEMO_FUNC));
+
+	// the first kind of each TokenTypes enum, in the order of the TokenType alternatives
+	static constexpr std::array<Kind, std::variant_size_v<TokenType>> bases = {
+		Kind::OPEN_PAREN, Kind::ASGN, Kind::INT, Kind::IF, Kind::FUNC
+	};
+	uint8_t value = std::visit([](auto val) { return static_cast<uint8_t>(val); }, type);
+	return static_cast<Kind>(static_cast<uint8_t>(bases[type.index()]) + value);
 }
 
-std::optional<Node::Lit> Parser::parse_lit()
+Parser::Form Parser::form_of(Kind kind)
 {
-	if (peek().has_value() && peek().value() == TokenTypes::Literal::INT)
-		return Node::Lit{ Node::LitInt{ std::stoi(consume().value.value()) } };
-
-	else if (peek().has_value() && peek().value() == TokenTypes::Literal::IDENT)
-		return Node::Lit{ Node::LitIdent{ consume().value.value() } };
-
-	return {};
+	static constexpr auto forms = [] {
+		std::array<Form, static_cast<size_t>(Kind::END) + 1> forms{};
+		forms.fill(Form::INVALID);
+
+		forms[static_cast<size_t>(Kind::ASGN)] = Form::ASGN;
+		forms[static_cast<size_t>(Kind::IF)] = Form::IF;
+		forms[static_cast<size_t>(Kind::LOOP)] = Form::LOOP;
+		forms[static_cast<size_t>(Kind::RET)] = Form::RET;
+		forms[static_cast<size_t>(Kind::CALL)] = Form::CALL;
+		forms[static_cast<size_t>(Kind::FUNC)] = Form::FUNC;
+		forms[static_cast<size_t>(Kind::MEMO_FUNC)] = Form::FUNC;
+		forms[static_cast<size_t>(Kind::OPEN_PAREN)] = Form::SCOPE;
+		forms[static_cast<size_t>(Kind::CLOSE_PAREN)] = Form::SCOPE;
+
+		for (Kind op : { Kind::EQL, Kind::MUL, Kind::DIV, Kind::ADD, Kind::SUB, Kind::GT, Kind::LT, Kind::GTE, Kind::LTE,
+			Kind::AND, Kind::OR, Kind::BW_AND, Kind::BW_OR })
+			forms[static_cast<size_t>(op)] = Form::BINARY;
+		return forms;
+	}();
+	return forms[static_cast<size_t>(kind)];
 }
 
-std::optional<Node::Struct> Parser::parse_struct()
+std::vector<Node::Node> Parser::parse_prog()
 {
-	if (auto node = parse_func_decl())
-		return Node::Struct{ std::move(node.value()) };
-	return {};
+	std::vector<Node::Node> prog;
+	while (kind() != Kind::END)
+		prog.push_back(parse_node());
+	return prog;
 }
 
-std::optional<Node::StructFuncDecl> Parser::parse_func_decl()
+Node::Node Parser::parse_node()
 {
-	if (!peek().has_value() || peek().value() != TokenTypes::Symbol::OPEN_PAREN ||
-		!peek(1).has_value() || peek(1).value() != TokenTypes::Struct::FUNC)
-		return {};
-
-	consume(2);
-
-	Node::StructFuncDecl node;
-	consume(); // '('
-
-	while (peek().has_value() && peek().value() != TokenTypes::Symbol::CLOSE_PAREN)
+	switch (form())
 	{
-		if (peek().value() != TokenTypes::Literal::IDENT)
-			ERR_EXIT("[INDEX: ", std::to_string(m_index), "] ", "Expected identifiers in function parameter list");
+		case Form::ASGN:
+		case Form::IF:
+		case Form::LOOP:
+		case Form::RET:
+			return Node::Node{ parse_stmt() };
 
-		node.params.push_back(Node::LitIdent{ consume().value.value()});
-	}
-	consume(); // ')' (param list)
-	node.scope = strict(parse_scope());
-	consume(); // ')'
-	return node;
-}
+		case Form::CALL:
+		case Form::BINARY:
+			return Node::Node{ parse_expr() };
 
-std::optional<Node::Expr> Parser::parse_expr()
-{
-	if (auto token = peek(); token.has_value())
-	{
-		if (auto lit = parse_lit())
-			return Node::Expr{ std::move(lit.value()) };
+		case Form::FUNC:
+			return Node::Node{ Node::Struct{ parse_func_decl() } };
 
-		else if (auto call = parse_call())
-			return Node::Expr{ call.value() };
+		case Form::SCOPE:
+			return Node::Node{ parse_scope() };
 
+		case Form::INVALID:
+			break;
 	}
-	if (!peek().has_value() || peek().value() != TokenTypes::Symbol::OPEN_PAREN) return {};
-	if (auto token = peek(1); !token.has_value() ||
-		(
-		token.value() != TokenTypes::Operator::ADD &&
-		token.value() != TokenTypes::Operator::SUB &&
-		token.value() != TokenTypes::Operator::MUL &&
-		token.value() != TokenTypes::Operator::DIV &&
-		token.value() != TokenTypes::Operator::BW_AND &&
-		token.value() != TokenTypes::Operator::BW_OR &&
-		token.value() != TokenTypes::Operator::AND &&
-		token.value() != TokenTypes::Operator::OR &&
-		token.value() != TokenTypes::Operator::GT &&
-		token.value() != TokenTypes::Operator::LT &&
-		token.value() != TokenTypes::Operator::GTE &&
-		token.value() != TokenTypes::Operator::LTE
-		)
-	) return {};
 
-	consume(); // '('
-	Node::BinExpr node;
-	while (peek().has_value() && peek().value() != TokenTypes::Symbol::CLOSE_PAREN)
-	{
-		if (
-			auto token = peek().value();
-			token == TokenTypes::Operator::ADD ||
-			token == TokenTypes::Operator::SUB ||
-			token == TokenTypes::Operator::MUL ||
-			token == TokenTypes::Operator::DIV ||
-			token == TokenTypes::Operator::BW_AND ||
-			token == TokenTypes::Operator::BW_OR ||
-			token == TokenTypes::Operator::AND ||
-			token == TokenTypes::Operator::OR ||
-			token == TokenTypes::Operator::GT ||
-			token == TokenTypes::Operator::LT ||
-			token == TokenTypes::Operator::GTE ||
-			token == TokenTypes::Operator::LTE
-			)
-		{
-			if (node.op.has_value())
-				ERR_EXIT("[INDEX: ", std::to_string(m_index), "] ", "Expected expression");
-
-			node.op = std::get<TokenTypes::Operator>(token.type);
-			consume();
-		}
-		else if (auto lit = parse_lit())
-		{
-			if (!node.lhs.has_value())
-				node.lhs = std::make_shared<Node::Expr>(Node::Expr{ std::move(lit.value()) });
-
-			else if (!node.rhs.has_value())
-				node.rhs = std::make_shared<Node::Expr>(Node::Expr{ std::move(lit.value()) });
-
-		}
-		else if (auto call = parse_call())
-		{
-			if (!node.lhs.has_value())
-				node.lhs = std::make_shared<Node::Expr>(Node::Expr{ std::move(call.value()) });
-
-			else if (!node.rhs.has_value())
-				node.rhs = std::make_shared<Node::Expr>(Node::Expr{ std::move(call.value()) });
-		}
-		else if (peek().value() == TokenTypes::Symbol::OPEN_PAREN)
-		{
-			auto expr = strict(parse_expr()); // "Expected sub-expression"
-			LOGGER << (node_to_string(Node::Node{ expr }));
-
-			if (!node.lhs.has_value())
-				node.lhs = std::make_shared<Node::Expr>(expr);
-
-			else
-				node.rhs = std::make_shared<Node::Expr>(expr);
-
-		}
-		else
-			return {};
-	}
-	consume();
-	return Node::Expr{ node };
+	if (kind() == Kind::INT || kind() == Kind::FLOAT || kind() == Kind::IDENT)
+		return Node::Node{ Node::Expr{ parse_lit() } };
+	fail("statement, expression, function or scope");
 }
 
-std::optional<Node::Scope> Parser::parse_scope()
+Node::Stmt Parser::parse_stmt()
 {
-	if (peek().has_value() && peek().value() == TokenTypes::Symbol::OPEN_PAREN)
+	Node::Stmt res;
+	switch (form())
 	{
-		consume();
-		std::vector<Node::Stmt> stmts;
-		while (peek().has_value() && peek().value() != TokenTypes::Symbol::CLOSE_PAREN)
-		{
-			auto stmt = strict(parse_stmt());
-			stmts.push_back(stmt);
-		}
-		if (peek().has_value()) consume(); // skip ')'
-		else ERR_EXIT("[INDEX: ", std::to_string(m_index), "] ", "Expected ')'");
-
-		return Node::Scope{ stmts };
+		case Form::ASGN: res.stmt = parse_asgn(); break;
+		case Form::IF: res.stmt = parse_if(); break;
+		case Form::LOOP: res.stmt = parse_loop(); break;
+		case Form::RET: res.stmt = parse_ret(); break;
+		default: fail("statement");
 	}
-	return {};
+	m_nodes++;
+	return res;
 }
 
-std::optional<Node::Call> Parser::parse_call()
+Node::StmtAsgn Parser::parse_asgn()
 {
-	if (!peek().has_value() || peek().value() != TokenTypes::Symbol::OPEN_PAREN ||
-		!peek(1).has_value() || peek(1).value() != TokenTypes::Statement::CALL)
-		return {};
-
-	consume(2);
-
-	Node::Call node;
-	if (peek().has_value() && peek().value() == TokenTypes::Literal::IDENT)
-		node.fn = Node::LitIdent{ consume().value.value() };
-
-	else if (auto fn = parse_func_decl())
-		node.fn = fn.value();
-
+	consume(2); // '(' '='
+	if (kind() != Kind::IDENT)
+		fail("identifier after assignment");
+
+	Node::StmtAsgn node;
+	node.id = Node::LitIdent{ consume().symbol };
+	if (form() == Form::FUNC)
+		node.val = Node::Struct{ parse_func_decl() };
 	else
-		return {};
+		node.val = parse_expr();
 
-	consume(); // '('
-	while (peek().has_value() && peek().value() != TokenTypes::Symbol::CLOSE_PAREN)
-		node.args.push_back(strict(parse_expr()));
-	
-	consume(); // ')' (arg list)
-	consume(); // ')' (stmt end)
+	expect(Kind::CLOSE_PAREN, "')' after assignment");
+	return node;
+}
 
+Node::StmtIf Parser::parse_if()
+{
+	consume(2); // '(' '?'
+	Node::StmtIf node;
+	node.cond = parse_expr();
+	node.scope = m_arena.make<Node::Scope>(parse_scope());
+	expect(Kind::CLOSE_PAREN, "')' after if");
+
+	node.elif = parse_else_chain();
 	return node;
 }
 
-std::optional<Node::StmtIf> Parser::parse_if_chain()
+// (!? cond (...)) links and a final (! (...)), which becomes a link whose condition is 1
+const Node::StmtIf* Parser::parse_else_chain()
 {
-	if (peek().has_value() && peek().value() == TokenTypes::Symbol::OPEN_PAREN &&
-		peek(1).has_value() && peek(1).value() == TokenTypes::Statement::ELSE)
+	if (kind() != Kind::OPEN_PAREN || kind(1) != Kind::ELSE)
+		return nullptr;
+
+	consume(2); // '(' '!'
+	Node::StmtIf node;
+	if (kind() == Kind::IF)
+	{
+		consume();
+		node.cond = parse_expr();
+		node.scope = m_arena.make<Node::Scope>(parse_scope());
+		expect(Kind::CLOSE_PAREN, "')' after else if");
+		node.elif = parse_else_chain();
+	}
+	else
 	{
-		consume(2);
-		if (peek().has_value() && peek().value() == TokenTypes::Statement::IF)
-		{
-			consume();
-			Node::StmtIf node;
-			auto expr = strict(parse_expr());
-
-			node.cond = expr;
-			node.scope = std::make_shared<Node::Scope>(strict(parse_scope()));
-			consume();
-			if (auto if_chain = parse_if_chain(); if_chain.has_value())
-				node.elif = std::make_shared<Node::StmtIf>(if_chain.value());
-
-			return node;
-		}
-
-		Node::StmtIf node;
 		node.cond = Node::Expr{ Node::Lit{ Node::LitInt{ 1 } } };
-		node.scope = std::make_shared<Node::Scope>(strict(parse_scope()));
-
-		consume(); // ')'
-		return node;
+		node.scope = m_arena.make<Node::Scope>(parse_scope());
+		expect(Kind::CLOSE_PAREN, "')' after else");
 	}
-	return {}; // no elif
+	return m_arena.make<Node::StmtIf>(std::move(node));
 }
 
-std::optional<Node::StmtAsgn> Parser::parse_asgn_stmt()
+Node::StmtLoop Parser::parse_loop()
 {
-	if (peek().has_value() && peek().value() == TokenTypes::Symbol::OPEN_PAREN &&
-		peek(1).has_value() && peek(1).value() == TokenTypes::Operator::ASGN)
-	{
-		consume(2);
-		Node::StmtAsgn node;
+	consume(2); // '(' '::'
+	Node::StmtLoop node;
+	if (form() == Form::ASGN)
+		node.init = m_arena.make<Node::StmtAsgn>(parse_asgn());
 
-		if (auto token = peek(); !token.has_value() || token.value() != TokenTypes::Literal::IDENT) return {};
+	node.cond = parse_expr();
+	if (form() == Form::ASGN)
+		node.adv = m_arena.make<Node::StmtAsgn>(parse_asgn());
 
-		auto ident = consume();
-		node.id = Node::LitIdent{ ident.value.value() };
-		
-		if (auto expr = parse_expr())
-			node.val = expr.value();
+	node.scope = m_arena.make<Node::Scope>(parse_scope());
+	expect(Kind::CLOSE_PAREN, "')' after loop");
+	return node;
+}
 
-		else if (auto strct = parse_struct())
-			node.val = strct.value();
+Node::StmtRet Parser::parse_ret()
+{
+	consume(2); // '(' '<-'
+	Node::StmtRet node;
+	if (kind() != Kind::CLOSE_PAREN)
+		node.ret_val = parse_expr();
 
-		else
-			ERR_EXIT("[INDEX: ", std::to_string(m_index), "] ", "Expected expression after assignment");
+	expect(Kind::CLOSE_PAREN, "')' after return");
+	return node;
+}
 
-		consume(); // ')'
-		return node;
+Node::Scope Parser::parse_scope()
+{
+	if (form() != Form::SCOPE)
+		fail("scope");
 
+	consume(); // '('
+	size_t first = m_stmts.size();
+	while (kind() != Kind::CLOSE_PAREN)
+	{
+		if (kind() == Kind::END)
+			fail("')'");
+		Node::Stmt stmt = parse_stmt();
+		m_stmts.push_back(stmt);
 	}
-	return {}; // no assigment
+	consume(); // ')'
+	m_nodes++;
+	return Node::Scope{ take(m_arena, m_stmts, first) };
 }
 
-std::optional<Node::StmtIf> Parser::parse_if_stmt()
+Node::StructFuncDecl Parser::parse_func_decl()
 {
-	if (peek().has_value() && peek().value() == TokenTypes::Symbol::OPEN_PAREN &&
-		peek(1).has_value() && peek(1).value() == TokenTypes::Statement::IF)
-	{
-		consume(2);
-		Node::StmtIf node;
-		auto expr = strict(parse_expr());
-
-		node.cond = expr;
-		node.scope = std::make_shared<Node::Scope>(strict(parse_scope()));
-		consume(); // ')'
-
-		if (auto if_chain = parse_if_chain(); if_chain.has_value())
-		{
-			node.elif = std::make_shared<Node::StmtIf>(if_chain.value());
-		}
-		
-		return node;
-	}
-	return {}; // no if
+	Node::StructFuncDecl node;
+	node.memo = kind(1) == Kind::MEMO_FUNC;
+	consume(2); // '(' '@'
+	expect(Kind::OPEN_PAREN, "'(' before parameters");
+
+	size_t first = m_params.size();
+	while (kind() == Kind::IDENT)
+		m_params.push_back(Node::LitIdent{ consume().symbol });
+	expect(Kind::CLOSE_PAREN, "identifiers in function parameter list");
+	node.params = take(m_arena, m_params, first);
+
+	node.scope = parse_scope();
+	expect(Kind::CLOSE_PAREN, "')' after function");
+	m_nodes++;
+	return node;
 }
 
-std::optional<Node::StmtLoop> Parser::parse_loop_stmt()
+Node::Expr Parser::parse_expr()
 {
-	if (peek().has_value() && peek().value() == TokenTypes::Symbol::OPEN_PAREN &&
-		peek(1).has_value() && peek(1).value() == TokenTypes::Statement::LOOP)
+	switch (form())
 	{
-		consume(2);
-		Node::StmtLoop node;
-		node.init = parse_asgn_stmt();
-
-		auto expr = strict(parse_expr());
-		node.cond = expr;
-		node.adv = parse_asgn_stmt();
-		node.scope = std::make_shared<Node::Scope>(strict(parse_scope()));
-		
-		consume(); // ')'
-		return node;
+		case Form::CALL: return Node::Expr{ parse_call() };
+		case Form::BINARY: return Node::Expr{ parse_bin_expr() };
+		default: break;
 	}
-	return {}; // no loop
+
+	if (kind() == Kind::INT || kind() == Kind::FLOAT || kind() == Kind::IDENT)
+		return Node::Expr{ parse_lit() };
+	fail("expression");
 }
 
-std::optional<Node::StmtRet> Parser::parse_ret_stmt()
+Node::BinExpr Parser::parse_bin_expr()
 {
-	if (!peek().has_value() || peek().value() != TokenTypes::Symbol::OPEN_PAREN ||
-		!peek(1).has_value() || peek(1).value() != TokenTypes::Statement::RET)
-
-		return {};
-
-	consume(2);
-	Node::StmtRet ret_node{ parse_expr() };
+	consume(); // '('
+	Node::BinExpr node;
+	// the form said it is an operator, so its kind is an offset into them
+	node.op = static_cast<TokenTypes::Operator>(static_cast<uint8_t>(kind()) - static_cast<uint8_t>(Kind::ASGN));
 	consume();
-	return ret_node;
+	node.lhs = m_arena.make<Node::Expr>(parse_expr());
+	node.rhs = m_arena.make<Node::Expr>(parse_expr());
+	expect(Kind::CLOSE_PAREN, "')' after two operands");
+	m_nodes++;
+	return node;
 }
 
-std::optional<Node::Stmt> Parser::parse_stmt()
+Node::Call Parser::parse_call()
 {
-	std::optional<Node::Stmt> ret_node{};
-	if (auto node = parse_asgn_stmt())
-		ret_node = Node::Stmt{ node.value() };
+	consume(2); // '(' '@@'
+	Node::Call node;
+	if (kind() == Kind::IDENT)
+		node.fn = Node::LitIdent{ consume().symbol };
+	else if (form() == Form::FUNC)
+		node.fn = m_arena.make<Node::StructFuncDecl>(parse_func_decl());
+	else
+		fail("function name or literal after call");
 
-	else if (auto node = parse_if_stmt())
-		ret_node = Node::Stmt{ node.value() };
+	expect(Kind::OPEN_PAREN, "'(' before arguments");
+	size_t first = m_args.size();
+	while (kind() != Kind::CLOSE_PAREN)
+	{
+		Node::Expr arg = parse_expr();
+		m_args.push_back(arg);
+	}
+	node.args = take(m_arena, m_args, first);
 
-	else if (auto node = parse_loop_stmt())
-		ret_node = Node::Stmt{ node.value() };
+	consume(); // ')' (arg list)
+	expect(Kind::CLOSE_PAREN, "')' after call");
+	m_nodes++;
+	return node;
+}
+
+Node::Lit Parser::parse_lit()
+{
+	const Token& token = consume();
+	m_nodes++;
+	switch (kind_of(token.type))
+	{
+		case Kind::INT: return Node::Lit{ Node::LitInt{ token.int_val } };
+		case Kind::FLOAT: return Node::Lit{ Node::LitFloat{ token.float_val } };
+		default: return Node::Lit{ Node::LitIdent{ token.symbol } };
+	}
+}
 
-	else if (auto node = parse_ret_stmt())
-		ret_node = Node::Stmt{ node.value() };
+size_t Parser::nodes() const
+{
+	return m_nodes;
+}
 
-	return ret_node;
+Parser::Kind Parser::kind(size_t offset) const
+{
+	size_t index = m_index + offset;
+	return index < m_tokens.size() ? kind_of(m_tokens[index].type) : Kind::END;
 }
 
-[[nodiscard]] std::optional<Token> Parser::peek(int offset)
+Parser::Form Parser::form() const
 {
-	if (m_index + offset < m_tokens.size())
-		return m_tokens[m_index + offset];
-	return {};
+	return kind() == Kind::OPEN_PAREN ? form_of(kind(1)) : Form::INVALID;
 }
 
-Token Parser::consume(unsigned int amount)
+const Token& Parser::consume(size_t amount)
 {
-	if (amount == 0) [[unlikely]]
-		ERR_EXIT("[INDEX: ", std::to_string(m_index), "] ", "Consume called with a value of 0");
+	if (m_index + amount > m_tokens.size())
+		ERR_EXIT("[INDEX: ", std::to_string(m_index), "] ", "Unexpected end of input");
 
 	m_index += amount;
-	return peek(-1).value(); // return last consumed token
+	return m_tokens[m_index - 1]; // return last consumed token
+}
+
+void Parser::expect(Kind kind, const char* what)
+{
+	if (this->kind() != kind)
+		fail(what);
+	m_index++;
+}
+
+void Parser::fail(const char* what) const
+{
+	ERR_EXIT("[INDEX: ", std::to_string(m_index), "] ", "Expected ", what);
 }
\ No newline at end of file
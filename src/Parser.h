@@ -16,17 +16,27 @@
 
 #include "Tokenizer.h"
 #include "Utils.h"
+#include "Arena.h"
 
+// Children that would make a node large or recursive are pointers into the Arena the
+// Parser (and Optimizer) build the tree in, and lists of children are spans there, so a
+// node stays a few words long, copying one never copies a subtree and no node needs a
+// destructor.
 namespace Node
 {
 	struct LitInt
 	{
-		int val;
+		int64_t val;
+	};
+
+	struct LitFloat
+	{
+		double val;
 	};
 
 	struct LitIdent
 	{
-		std::string id;
+		Symbol id;
 		bool operator==(const LitIdent& other) const
 		{
 			return id == other.id;
@@ -35,15 +45,15 @@ namespace Node
 
 	struct Lit
 	{
-		std::variant<LitInt, LitIdent> lit;
+		std::variant<LitInt, LitFloat, LitIdent> lit;
 	};
 
 	struct Expr;
 
 	struct BinExpr
 	{
-		std::optional<std::shared_ptr<Expr>> lhs;
-		std::optional<std::shared_ptr<Expr>> rhs;
+		const Expr* lhs = nullptr;
+		const Expr* rhs = nullptr;
 		std::optional<TokenTypes::Operator> op;
 	};
 
@@ -51,13 +61,14 @@ namespace Node
 
 	struct Scope
 	{
-		std::vector<Stmt> stmts;
+		std::span<const Stmt> stmts;
 	};
 
 	struct StructFuncDecl
 	{
-		std::vector<LitIdent> params;
+		std::span<const LitIdent> params;
 		Scope scope;
+		bool memo = false; // declared with @$
 	};
 
 	struct Struct
@@ -68,8 +79,8 @@ namespace Node
 
 	struct Call
 	{
-		std::variant<LitIdent, StructFuncDecl> fn;
-		std::vector<Expr> args;
+		std::variant<LitIdent, const StructFuncDecl*> fn;
+		std::span<const Expr> args;
 	};
 
 	struct Expr
@@ -86,16 +97,16 @@ namespace Node
 	struct StmtIf
 	{
 		Expr cond; // else will just be and elif with cond set to True
-		std::shared_ptr<Scope> scope;
-		std::optional<std::shared_ptr<StmtIf>> elif{};
+		const Scope* scope = nullptr;
+		const StmtIf* elif = nullptr;
 	};
 
 	struct StmtLoop
 	{
-		std::optional<StmtAsgn> init{};
+		const StmtAsgn* init = nullptr;
 		Expr cond;
-		std::optional<StmtAsgn> adv{};
-		std::shared_ptr<Scope> scope;
+		const StmtAsgn* adv = nullptr;
+		const Scope* scope = nullptr;
 	};
 
 	struct StmtRet
@@ -112,28 +123,21 @@ namespace Node
 	{
 		std::variant<Expr, Stmt, Struct, Scope> node;
 	};
+
+	static_assert(std::is_trivially_destructible_v<Node> && std::is_trivially_copyable_v<Node>);
 }
 
+// Predictive recursive descent: a token that isn't '(' can only start a literal, and what
+// a '(' opens is decided by the token right after it through a table (see Form). Every
+// construct is therefore recognized from at most two tokens of lookahead, without trying
+// alternatives, and malformed input is reported where it is found.
 class Parser
 {
 public:
-	Parser(std::vector<Token>& tokens);
+	Parser(std::vector<Token>& tokens, Arena& arena);
 	std::vector<Node::Node> parse_prog();
-	std::optional<Node::Node> parse_node();
-	std::optional<Node::Expr> parse_expr();
-	std::optional<Node::Stmt> parse_stmt();
-	std::optional<Node::Scope> parse_scope();
-	std::optional<Node::Struct> parse_struct();
-	std::optional<Node::Lit> parse_lit();
-
-	std::optional<Node::StructFuncDecl> parse_func_decl();
-
-	std::optional<Node::StmtIf> parse_if_chain();
-	std::optional<Node::StmtAsgn> parse_asgn_stmt();
-	std::optional<Node::StmtIf> parse_if_stmt();
-	std::optional<Node::StmtLoop> parse_loop_stmt();
-	std::optional<Node::Call> parse_call();
-	std::optional<Node::StmtRet> parse_ret_stmt();
+
+	size_t nodes() const; // AST nodes built so far
 	
 
 	static std::string node_to_string(const Node::Node& node, const size_t depth = 0)
@@ -168,9 +172,9 @@ public:
 					else if constexpr (std::is_same_v<U, Node::BinExpr>)
 					{
 						temp << inner_tab << typeid(expr).name() << " {\n";
-						temp << node_to_string(Node::Node{ *expr.lhs.value() }, depth + 2) + " " +
+						temp << node_to_string(Node::Node{ *expr.lhs }, depth + 2) + " " +
 							Tokenizer::tokentype_to_string(expr.op.value_or(TokenTypes::Operator::NONE)) + " \n" +
-							node_to_string(Node::Node{ *expr.rhs.value() }, depth + 2);
+							node_to_string(Node::Node{ *expr.rhs }, depth + 2);
 					}
 					temp << inner_tab << "}\n";
 					return temp.str();
@@ -191,21 +195,21 @@ public:
 					res << ", ";
 				}
 				res << "]" << std::endl;
-				if (stmt.elif.has_value())
+				if (stmt.elif)
 				{
-					res << node_to_string(Node::Node{ Node::Stmt{ *stmt.elif.value() }}) << std::endl;
+					res << node_to_string(Node::Node{ Node::Stmt{ *stmt.elif }}) << std::endl;
 				}
 			}
 			else if constexpr (std::is_same_v<T, Node::StmtLoop>)
 			{
-				if (stmt.init.has_value())
+				if (stmt.init)
 				{
-					res << node_to_string(Node::Node{ Node::Stmt{ stmt.init.value() }}) << std::endl;;
+					res << node_to_string(Node::Node{ Node::Stmt{ *stmt.init }}) << std::endl;;
 				}
 				res << node_to_string(Node::Node{ Node::Stmt{ stmt.cond }}) << std::endl;
-				if (stmt.adv.has_value())
+				if (stmt.adv)
 				{
-					res << node_to_string(Node::Node{ Node::Stmt{ stmt.adv.value() }}) << std::endl;;
+					res << node_to_string(Node::Node{ Node::Stmt{ *stmt.adv }}) << std::endl;;
 				}
 				res << "[";
 				for (const Node::Stmt& stmt : stmt.scope->stmts)
@@ -223,20 +227,62 @@ public:
 
 
 private:
-	[[nodiscard]] std::optional<Token> peek(int offset = 0);
-	Token consume(unsigned int amount = 1);
+	// every token type as one dense number, the TokenTypes enums one after the other
+	enum class Kind : uint8_t
+	{
+		OPEN_PAREN, CLOSE_PAREN, SYMBOL_NONE,
+		ASGN, EQL, MUL, DIV, ADD, SUB, GT, LT, GTE, LTE, AND, OR, BW_AND, BW_OR, OPERATOR_NONE,
+		INT, FLOAT, IDENT, LITERAL_NONE,
+		IF, ELSE, LOOP, RET, CALL, STATEMENT_NONE,
+		FUNC, MEMO_FUNC,
+		END, // past the last token
+	};
 
-	template<typename T>
-		requires requires { typename T::value_type; }
-	auto strict(const T& opt) -> typename T::value_type
+	// what a '(' opens, by the kind of the token after it
+	enum class Form : uint8_t
 	{
-		if (opt.has_value())
-			return opt.value();
-		ERR_EXIT("[INDEX: ", std::to_string(m_index), "] ", "Expected ", std::string(typeid(typename T::value_type).name()));
-	}
+		INVALID,
+		ASGN, // (= x ...)
+		IF, // (? cond (...)), else links follow as (!? cond (...)) and (! (...))
+		LOOP, // (:: init cond adv (...))
+		RET, // (<- ...)
+		CALL, // (@@ f (args))
+		FUNC, // (@ (params) (...)) or (@$ ...)
+		BINARY, // (op lhs rhs)
+		SCOPE, // ((stmt) ...) or ()
+	};
+
+	static Kind kind_of(const TokenType& type);
+	static Form form_of(Kind kind);
+
+	Node::Node parse_node();
+	Node::Stmt parse_stmt();
+	Node::StmtAsgn parse_asgn();
+	Node::StmtIf parse_if();
+	const Node::StmtIf* parse_else_chain();
+	Node::StmtLoop parse_loop();
+	Node::StmtRet parse_ret();
+	Node::Scope parse_scope();
+	Node::StructFuncDecl parse_func_decl();
+	Node::Expr parse_expr();
+	Node::BinExpr parse_bin_expr();
+	Node::Call parse_call();
+	Node::Lit parse_lit();
+
+	Kind kind(size_t offset = 0) const; // END past the last token
+	Form form() const; // of the '(' at the current token, INVALID if it isn't one
+	const Token& consume(size_t amount = 1);
+	void expect(Kind kind, const char* what);
+	[[noreturn]] void fail(const char* what) const;
 
 private:
 	const std::vector<Token> m_tokens;
-	uint16_t m_index;
+	Arena& m_arena;
+	// lists still being parsed, nested ones on top of the enclosing; a finished list is
+	// copied into the arena and popped, so parsing allocates nothing but arena memory
+	std::vector<Node::Stmt> m_stmts;
+	std::vector<Node::Expr> m_args;
+	std::vector<Node::LitIdent> m_params;
+	size_t m_index;
+	size_t m_nodes = 0;
 };
-
@@ -0,0 +1,239 @@
+#include "Peephole.h"
+
+static bool is_jump(OpCode code)
+{
+	switch (code)
+	{
+		case OpCode::JMP:
+		case OpCode::JMP_ZERO:
+		case OpCode::JMP_NONZERO:
+		case OpCode::JLT:
+		case OpCode::JGT:
+		case OpCode::JLTE:
+		case OpCode::JGTE:
+		case OpCode::JEQ:
+		case OpCode::JNE:
+		case OpCode::JNLT:
+		case OpCode::JNGT:
+		case OpCode::JNLTE:
+		case OpCode::JNGTE:
+			return true;
+
+		default:
+			return false;
+	}
+}
+
+static bool has_target(const Instr& instr)
+{
+	return (is_jump(instr.code) && instr.val.is(ValueType::LIT)) || instr.val.is(ValueType::ADDR);
+}
+
+// execution never continues with the next instruction
+static bool ends_flow(OpCode code)
+{
+	return code == OpCode::JMP || code == OpCode::RET || code == OpCode::TAILCALL || code == OpCode::MEMO_RET || code == OpCode::HLT;
+}
+
+// pushes one value and has no other effect
+static bool is_pure_push(OpCode code)
+{
+	return code == OpCode::PUSH || code == OpCode::LOAD_LOCAL || code == OpCode::LOAD_GLOBAL || code == OpCode::LOAD_CONST;
+}
+
+Peephole::Peephole(std::vector<Instr>& bytecode) : m_bytecode(std::move(bytecode)) {}
+
+std::vector<Instr> Peephole::optimize()
+{
+	size_t before = m_bytecode.size();
+	while (true)
+	{
+		m_dead.assign(m_bytecode.size(), false);
+		bool changed = thread_jumps();
+		changed |= rewrite();
+		changed |= remove_unreachable();
+		if (!changed)
+			break;
+		compact();
+	}
+
+	LOGGER << "Peephole: " << before << " instructions into " << m_bytecode.size() << std::endl;
+	return m_bytecode;
+}
+
+size_t Peephole::threaded() const
+{
+	return m_threaded;
+}
+
+size_t Peephole::removed_jumps() const
+{
+	return m_removed_jumps;
+}
+
+size_t Peephole::removed_pairs() const
+{
+	return m_removed_pairs;
+}
+
+size_t Peephole::removed_unreachable() const
+{
+	return m_removed_unreachable;
+}
+
+bool Peephole::thread_jumps()
+{
+	bool changed = false;
+	for (Instr& instr : m_bytecode)
+	{
+		if (!is_jump(instr.code) || !instr.val.is(ValueType::LIT))
+			continue;
+
+		// bounded, so a loop made only of jumps can't hang the pass
+		size_t target = instr.val.operand();
+		for (size_t hops = 0; hops < m_bytecode.size() && target < m_bytecode.size() && m_bytecode[target].code == OpCode::JMP; hops++)
+		{
+			size_t next = m_bytecode[target].val.operand();
+			if (next == target)
+				break;
+			target = next;
+		}
+
+		if (target != static_cast<size_t>(instr.val.operand()))
+		{
+			instr.val.set_operand(target);
+			m_threaded++;
+			changed = true;
+		}
+	}
+	return changed;
+}
+
+// two-instruction windows; the second one must not be a jump target, since whatever
+// jumps there expects the first one to have run
+bool Peephole::rewrite()
+{
+	std::vector<bool> is_target(m_bytecode.size() + 1, false);
+	for (const Instr& instr : m_bytecode)
+	{
+		if (has_target(instr))
+			is_target[instr.val.operand()] = true;
+	}
+
+	bool changed = false;
+	for (size_t i = 0; i < m_bytecode.size(); i++)
+	{
+		Instr& instr = m_bytecode[i];
+		if (m_dead[i])
+			continue;
+
+		if (is_jump(instr.code) && instr.val.is(ValueType::LIT) && static_cast<size_t>(instr.val.operand()) == i + 1)
+		{
+			// a branch to the next instruction still pops its condition
+			if (instr.code == OpCode::JMP)
+			{
+				m_dead[i] = true;
+				m_removed_jumps++;
+			}
+			else if (instr.code == OpCode::JMP_ZERO || instr.code == OpCode::JMP_NONZERO)
+				instr = { OpCode::POP, { ValueType::NOT_REQUIRED, -1 } };
+			else
+				continue;
+
+			changed = true;
+			continue;
+		}
+
+		if (i == 0 || m_dead[i - 1] || is_target[i])
+			continue;
+
+		Instr& prev = m_bytecode[i - 1];
+		if (is_pure_push(prev.code) && instr.code == OpCode::POP)
+		{
+			m_dead[i - 1] = m_dead[i] = true;
+			m_removed_pairs += 2;
+			changed = true;
+		}
+
+		else if (prev.code == OpCode::LOAD_LOCAL && instr.code == OpCode::MOV && prev.val.operand() == instr.val.operand())
+		{
+			m_dead[i - 1] = m_dead[i] = true;
+			m_removed_pairs += 2;
+			changed = true;
+		}
+
+		// a branch on a constant either always falls through or always jumps
+		else if (prev.code == OpCode::LOAD_CONST && (instr.code == OpCode::JMP_ZERO || instr.code == OpCode::JMP_NONZERO))
+		{
+			if (prev.val.truthy() == (instr.code == OpCode::JMP_ZERO))
+			{
+				m_dead[i] = true;
+				m_removed_jumps++;
+			}
+			else
+				instr.code = OpCode::JMP;
+			m_dead[i - 1] = true;
+			m_removed_jumps++;
+			changed = true;
+		}
+	}
+	return changed;
+}
+
+// from the start of the program and every function address pushed by reachable code
+bool Peephole::remove_unreachable()
+{
+	std::vector<bool> reachable(m_bytecode.size(), false);
+	std::vector<size_t> worklist{ 0 };
+
+	while (!worklist.empty())
+	{
+		size_t pos = worklist.back();
+		worklist.pop_back();
+		for (; pos < m_bytecode.size() && !reachable[pos]; pos++)
+		{
+			reachable[pos] = true;
+			const Instr& instr = m_bytecode[pos];
+			if (m_dead[pos])
+				continue;
+
+			if (has_target(instr))
+				worklist.push_back(instr.val.operand());
+			if (ends_flow(instr.code))
+				break;
+		}
+	}
+
+	bool changed = false;
+	for (size_t i = 0; i < m_bytecode.size(); i++)
+	{
+		if (!reachable[i] && !m_dead[i])
+		{
+			m_dead[i] = true;
+			m_removed_unreachable++;
+			changed = true;
+		}
+	}
+	return changed;
+}
+
+// targets of removed instructions move to the next one that is kept
+void Peephole::compact()
+{
+	std::vector<size_t> new_idx(m_bytecode.size() + 1);
+	std::vector<Instr> kept;
+	for (size_t i = 0; i < m_bytecode.size(); i++)
+	{
+		new_idx[i] = kept.size();
+		if (!m_dead[i])
+			kept.push_back(m_bytecode[i]);
+	}
+	new_idx[m_bytecode.size()] = kept.size();
+
+	for (Instr& instr : kept)
+	{
+		if (has_target(instr))
+			instr.val.set_operand(new_idx[instr.val.operand()]);
+	}
+	m_bytecode = std::move(kept);
+}
\ No newline at end of file
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "Compiler.h"
+
+// Cleans up the bytecode before fusion: jumps to jumps go straight to the final target,
+// jumps to the next instruction and branches on constants disappear, values pushed only
+// to be popped again are never pushed, and code no jump or call can reach is dropped.
+// Runs until nothing changes and remaps every jump target and code address.
+class Peephole
+{
+public:
+	Peephole(std::vector<Instr>& bytecode);
+	std::vector<Instr> optimize();
+
+	// instructions removed, by reason
+	size_t removed_jumps() const; // jumps to the next instruction and branches on constants
+	size_t removed_pairs() const; // pushes popped right away and slots stored back where they were loaded from
+	size_t removed_unreachable() const;
+	size_t threaded() const; // jumps retargeted past a JMP
+
+private:
+	bool thread_jumps();
+	bool rewrite();
+	bool remove_unreachable();
+	void compact();
+
+private:
+	std::vector<Instr> m_bytecode;
+	std::vector<bool> m_dead;
+	size_t m_threaded = 0;
+	size_t m_removed_jumps = 0;
+	size_t m_removed_pairs = 0;
+	size_t m_removed_unreachable = 0;
+};
\ No newline at end of file
@@ -0,0 +1,542 @@
+#include "RegCompiler.h"
+
+#include <algorithm>
+#include <climits>
+
+std::string reg_opcode_to_string(RegOpCode code)
+{
+	switch (code)
+	{
+		case RegOpCode::MOV: return "MOV";
+		case RegOpCode::LOADK: return "LOADK";
+		case RegOpCode::LOADC: return "LOADC";
+		case RegOpCode::LOADF: return "LOADF";
+		case RegOpCode::LOADG: return "LOADG";
+		case RegOpCode::ADD: return "ADD";
+		case RegOpCode::SUB: return "SUB";
+		case RegOpCode::MUL: return "MUL";
+		case RegOpCode::DIV: return "DIV";
+		case RegOpCode::BW_OR: return "BW_OR";
+		case RegOpCode::BW_AND: return "BW_AND";
+		case RegOpCode::OR: return "OR";
+		case RegOpCode::AND: return "AND";
+		case RegOpCode::LT: return "LT";
+		case RegOpCode::GT: return "GT";
+		case RegOpCode::GTE: return "GTE";
+		case RegOpCode::LTE: return "LTE";
+		case RegOpCode::EQL: return "EQL";
+		case RegOpCode::ADDI: return "ADDI";
+		case RegOpCode::SUBI: return "SUBI";
+		case RegOpCode::MULI: return "MULI";
+		case RegOpCode::LTI: return "LTI";
+		case RegOpCode::GTI: return "GTI";
+		case RegOpCode::GTEI: return "GTEI";
+		case RegOpCode::LTEI: return "LTEI";
+		case RegOpCode::EQLI: return "EQLI";
+		case RegOpCode::JMP: return "JMP";
+		case RegOpCode::JMP_FALSE: return "JMP_FALSE";
+		case RegOpCode::JMP_TRUE: return "JMP_TRUE";
+		case RegOpCode::CALL: return "CALL";
+		case RegOpCode::CALLG: return "CALLG";
+		case RegOpCode::TAILCALL: return "TAILCALL";
+		case RegOpCode::TAILCALLG: return "TAILCALLG";
+		case RegOpCode::RET: return "RET";
+		case RegOpCode::RET_NIL: return "RET_NIL";
+		case RegOpCode::HLT: return "HLT";
+		default: return "UNKNOWN";
+	}
+}
+
+static RegOpCode binary_op(TokenTypes::Operator op)
+{
+	switch (op)
+	{
+		case TokenTypes::Operator::EQL: return RegOpCode::EQL;
+		case TokenTypes::Operator::ADD: return RegOpCode::ADD;
+		case TokenTypes::Operator::SUB: return RegOpCode::SUB;
+		case TokenTypes::Operator::DIV: return RegOpCode::DIV;
+		case TokenTypes::Operator::MUL: return RegOpCode::MUL;
+		case TokenTypes::Operator::OR: return RegOpCode::OR;
+		case TokenTypes::Operator::AND: return RegOpCode::AND;
+		case TokenTypes::Operator::BW_OR: return RegOpCode::BW_OR;
+		case TokenTypes::Operator::BW_AND: return RegOpCode::BW_AND;
+		case TokenTypes::Operator::LT: return RegOpCode::LT;
+		case TokenTypes::Operator::LTE: return RegOpCode::LTE;
+		case TokenTypes::Operator::GT: return RegOpCode::GT;
+		case TokenTypes::Operator::GTE: return RegOpCode::GTE;
+		default: ERR_EXIT("Operator not allowed");
+	}
+}
+
+// register-immediate form of an operator, if there is one
+static std::optional<RegOpCode> immediate_op(RegOpCode code)
+{
+	switch (code)
+	{
+		case RegOpCode::ADD: return RegOpCode::ADDI;
+		case RegOpCode::SUB: return RegOpCode::SUBI;
+		case RegOpCode::MUL: return RegOpCode::MULI;
+		case RegOpCode::LT: return RegOpCode::LTI;
+		case RegOpCode::GT: return RegOpCode::GTI;
+		case RegOpCode::GTE: return RegOpCode::GTEI;
+		case RegOpCode::LTE: return RegOpCode::LTEI;
+		case RegOpCode::EQL: return RegOpCode::EQLI;
+		default: return {};
+	}
+}
+
+RegCompiler::RegCompiler(const std::vector<Node::Node>& nodes)
+	: m_nodes(nodes), m_global{ {}, {}, 0, 0, 0, nullptr }, m_curr_scope(&m_global), m_max_frame_size(0) {}
+
+std::vector<RegInstr> RegCompiler::compile_prog()
+{
+	for (const Node::Node& node : m_nodes)
+		compile_node(node);
+
+	push_instr(RegOpCode::HLT);
+	m_max_frame_size = std::max(m_max_frame_size, m_global.frame_size);
+	return m_bytecode;
+}
+
+const std::unordered_map<std::string, int>& RegCompiler::globals() const
+{
+	return m_global.vars;
+}
+
+const std::vector<Value>& RegCompiler::constants() const
+{
+	return m_constants;
+}
+
+int RegCompiler::max_frame_size() const
+{
+	return m_max_frame_size;
+}
+
+void RegCompiler::compile_node(const Node::Node& node)
+{
+	struct Visitor
+	{
+		RegCompiler& compiler;
+		void operator()(const Node::Expr& expr)
+		{
+			compiler.compile_expr(expr);
+		}
+
+		void operator()(const Node::Stmt& stmt)
+		{
+			compiler.compile_stmt(stmt);
+		}
+
+		void operator()(const Node::Struct& strct)
+		{
+			compiler.compile_func(std::get<Node::StructFuncDecl>(strct.strct), compiler.alloc_temp());
+		}
+
+		void operator()(const Node::Scope& scope)
+		{
+			compiler.compile_scope(scope);
+		}
+	};
+	std::visit(Visitor{ *this }, node.node);
+	m_curr_scope->temp = m_curr_scope->locals; // temporaries never outlive a statement
+}
+
+void RegCompiler::compile_asgn(const Node::StmtAsgn& node)
+{
+	struct Visitor
+	{
+		RegCompiler& compiler;
+		const std::string& id;
+		void operator()(const Node::Expr& expr)
+		{
+			auto& vars = compiler.m_curr_scope->vars;
+			if (auto it = vars.find(id); it != vars.end())
+			{
+				compiler.compile_expr(expr, it->second);
+				return;
+			}
+
+			// the variable only comes into scope once its initializer is evaluated
+			int reg = compiler.alloc_local();
+			compiler.compile_expr(expr, reg);
+			vars[id] = reg;
+		}
+
+		void operator()(const Node::Struct& strct)
+		{
+			auto& funcs = compiler.m_curr_scope->funcs;
+			int reg;
+			if (auto it = funcs.find(id); it != funcs.end())
+				reg = it->second;
+			else
+				reg = funcs[id] = compiler.alloc_local();
+
+			compiler.compile_func(std::get<Node::StructFuncDecl>(strct.strct), reg);
+		}
+	};
+	std::visit(Visitor{ *this, Symbols::name(node.id.id) }, node.val);
+}
+
+void RegCompiler::compile_if(const Node::StmtIf& node)
+{
+	std::vector<size_t> false_jumps;
+	compile_cond(node.cond, false, false_jumps);
+	m_curr_scope->temp = m_curr_scope->locals;
+
+	compile_scope(*node.scope);
+
+	if (node.elif)
+	{
+		size_t end_idx = push_instr(RegOpCode::JMP, -1);
+		patch_jumps(false_jumps, m_bytecode.size());
+		compile_if(*node.elif);
+		m_bytecode[end_idx].a = static_cast<int>(m_bytecode.size());
+	}
+	else
+		patch_jumps(false_jumps, m_bytecode.size());
+}
+
+void RegCompiler::compile_loop(const Node::StmtLoop& node)
+{
+	if (node.init)
+		compile_asgn(*node.init);
+
+	int cond_start = static_cast<int>(m_bytecode.size());
+	std::vector<size_t> exit_jumps;
+	compile_cond(node.cond, false, exit_jumps);
+	m_curr_scope->temp = m_curr_scope->locals;
+
+	compile_scope(*node.scope);
+
+	if (node.adv)
+	{
+		compile_asgn(*node.adv);
+		m_curr_scope->temp = m_curr_scope->locals;
+	}
+
+	push_instr(RegOpCode::JMP, cond_start);
+	patch_jumps(exit_jumps, m_bytecode.size());
+}
+
+// jumps when the condition's truthiness is jump_if and falls through otherwise, the
+// jumps are appended to jumps for the caller to patch
+void RegCompiler::compile_cond(const Node::Expr& node, bool jump_if, std::vector<size_t>& jumps)
+{
+	const auto* bin_expr = std::get_if<Node::BinExpr>(&node.expr);
+	if (bin_expr && (bin_expr->op == TokenTypes::Operator::AND || bin_expr->op == TokenTypes::Operator::OR))
+	{
+		compile_short_circuit(*bin_expr, jump_if, jumps);
+		return;
+	}
+
+	int mark = m_curr_scope->temp;
+	int cond = compile_expr(node);
+	m_curr_scope->temp = mark;
+	jumps.push_back(push_instr(jump_if ? RegOpCode::JMP_TRUE : RegOpCode::JMP_FALSE, cond, -1));
+}
+
+// && and || only evaluate their right operand when the left one doesn't decide
+void RegCompiler::compile_short_circuit(const Node::BinExpr& node, bool jump_if, std::vector<size_t>& jumps)
+{
+	bool is_and = node.op == TokenTypes::Operator::AND;
+	if (is_and != jump_if)
+	{
+		compile_cond(*node.lhs, jump_if, jumps);
+		compile_cond(*node.rhs, jump_if, jumps);
+		return;
+	}
+
+	std::vector<size_t> decided;
+	compile_cond(*node.lhs, !jump_if, decided);
+	compile_cond(*node.rhs, jump_if, jumps);
+	patch_jumps(decided, m_bytecode.size());
+}
+
+void RegCompiler::patch_jumps(const std::vector<size_t>& jumps, size_t target)
+{
+	for (size_t idx : jumps)
+		m_bytecode[idx].b = static_cast<int>(target);
+}
+
+void RegCompiler::compile_ret(const Node::StmtRet& node)
+{
+	// (<- (@@ f (...))) inside a function reuses the current frame
+	const auto* call = node.ret_val.has_value() ? std::get_if<Node::Call>(&node.ret_val->expr) : nullptr;
+	if (call && !is_global_scope() && std::holds_alternative<Node::LitIdent>(call->fn))
+	{
+		const std::string& id = Symbols::name(std::get<Node::LitIdent>(call->fn).id);
+		int base = m_curr_scope->temp;
+		for (size_t i = 0; i < call->args.size(); i++)
+			alloc_temp();
+
+		for (size_t i = 0; i < call->args.size(); i++)
+			compile_expr(call->args[i], base + static_cast<int>(i));
+
+		int argc = static_cast<int>(call->args.size());
+		if (auto reg = find_local(&RegScope::funcs, id))
+			push_instr(RegOpCode::TAILCALL, base, reg.value(), argc);
+
+		else if (auto reg = find_global(&RegScope::funcs, id))
+			push_instr(RegOpCode::TAILCALLG, base, reg.value(), argc);
+
+		else
+			ERR_EXIT("Fatal: couldn't find func with name: ", id);
+		return;
+	}
+
+	if (node.ret_val.has_value())
+		push_instr(RegOpCode::RET, compile_expr(node.ret_val.value()));
+	else
+		push_instr(RegOpCode::RET_NIL);
+}
+
+void RegCompiler::compile_stmt(const Node::Stmt& node)
+{
+	struct Visitor
+	{
+		RegCompiler& compiler;
+		void operator()(const Node::StmtAsgn& asgn)
+		{
+			compiler.compile_asgn(asgn);
+		}
+
+		void operator()(const Node::StmtIf& if_stmt)
+		{
+			compiler.compile_if(if_stmt);
+		}
+
+		void operator()(const Node::StmtLoop& loop)
+		{
+			compiler.compile_loop(loop);
+		}
+
+		void operator()(const Node::StmtRet& ret)
+		{
+			compiler.compile_ret(ret);
+		}
+	};
+	std::visit(Visitor{ *this }, node.stmt);
+	m_curr_scope->temp = m_curr_scope->locals;
+}
+
+void RegCompiler::compile_scope(const Node::Scope& node)
+{
+	for (const Node::Stmt& stmt : node.stmts)
+		compile_stmt(stmt);
+}
+
+// loads the entry of the function into dest and emits its body behind a jump
+int RegCompiler::compile_func(const Node::StructFuncDecl& node, int dest)
+{
+	int entry = static_cast<int>(m_bytecode.size() + 2);
+	push_instr(RegOpCode::LOADF, dest, entry);
+	size_t jmp_idx = push_instr(RegOpCode::JMP, -1);
+
+	RegScope scope{ {}, {}, 0, 0, 0, m_curr_scope };
+	m_curr_scope = &scope;
+
+	for (const Node::LitIdent& param : node.params)
+		scope.vars[Symbols::name(param.id)] = alloc_local();
+
+	compile_scope(node.scope);
+	push_instr(RegOpCode::RET_NIL);
+
+	m_max_frame_size = std::max(m_max_frame_size, scope.frame_size);
+	m_curr_scope = scope.parent;
+
+	m_bytecode[jmp_idx].a = static_cast<int>(m_bytecode.size());
+	return dest;
+}
+
+int RegCompiler::compile_expr(const Node::Expr& node, int dest)
+{
+	struct Visitor
+	{
+		RegCompiler& compiler;
+		int dest;
+		int operator()(const Node::BinExpr& bin_expr)
+		{
+			int mark = compiler.m_curr_scope->temp;
+
+			// a plain value on the right is as cheap to evaluate as to skip, and can't fail
+			bool logical = bin_expr.op == TokenTypes::Operator::AND || bin_expr.op == TokenTypes::Operator::OR;
+			if (logical && !std::holds_alternative<Node::Lit>(bin_expr.rhs->expr))
+			{
+				std::vector<size_t> false_jumps;
+				compiler.compile_short_circuit(bin_expr, false, false_jumps);
+				compiler.m_curr_scope->temp = mark;
+				int out = dest >= 0 ? dest : compiler.alloc_temp();
+				compiler.push_instr(RegOpCode::LOADK, out, 1);
+				size_t end_idx = compiler.push_instr(RegOpCode::JMP, -1);
+				compiler.patch_jumps(false_jumps, compiler.m_bytecode.size());
+				compiler.push_instr(RegOpCode::LOADK, out, 0);
+				compiler.m_bytecode[end_idx].a = static_cast<int>(compiler.m_bytecode.size());
+				return out;
+			}
+
+			RegOpCode code = binary_op(bin_expr.op.value());
+
+			int lhs = compiler.compile_expr(*bin_expr.lhs);
+			const Node::Expr& rhs_expr = *bin_expr.rhs;
+
+			// 32-bit integer literal on the right: use the register-immediate form
+			auto imm_code = immediate_op(code);
+			const auto* lit = std::get_if<Node::Lit>(&rhs_expr.expr);
+			const auto* integer = lit ? std::get_if<Node::LitInt>(&lit->lit) : nullptr;
+			if (imm_code.has_value() && integer && integer->val >= INT_MIN && integer->val <= INT_MAX)
+			{
+				compiler.m_curr_scope->temp = mark;
+				int out = dest >= 0 ? dest : compiler.alloc_temp();
+				compiler.push_instr(imm_code.value(), out, lhs, static_cast<int>(integer->val));
+				return out;
+			}
+
+			int rhs = compiler.compile_expr(rhs_expr);
+			compiler.m_curr_scope->temp = mark;
+			int out = dest >= 0 ? dest : compiler.alloc_temp();
+			compiler.push_instr(code, out, lhs, rhs);
+			return out;
+		}
+
+		int operator()(const Node::Lit& lit)
+		{
+			if (const auto* integer = std::get_if<Node::LitInt>(&lit.lit))
+				return compiler.load_const(Value::from_int(integer->val), dest);
+
+			if (const auto* number = std::get_if<Node::LitFloat>(&lit.lit))
+				return compiler.load_const(Value::from_double(number->val), dest);
+
+			const std::string& id = Symbols::name(std::get<Node::LitIdent>(lit.lit).id);
+			if (auto reg = compiler.find_local(&RegScope::vars, id))
+				return compiler.into(reg.value(), dest);
+
+			if (auto reg = compiler.find_global(&RegScope::vars, id))
+			{
+				int out = dest >= 0 ? dest : compiler.alloc_temp();
+				compiler.push_instr(RegOpCode::LOADG, out, reg.value());
+				return out;
+			}
+			ERR_EXIT("Fatal: couldn't find variable with name: ", id);
+		}
+
+		int operator()(const Node::Call& call)
+		{
+			return compiler.compile_call(call, dest);
+		}
+	};
+	return std::visit(Visitor{ *this, dest }, node.expr);
+}
+
+int RegCompiler::compile_call(const Node::Call& node, int dest)
+{
+	// arguments go into consecutive registers at the top of the frame,
+	// which become the callee's first registers
+	int base = m_curr_scope->temp;
+	for (size_t i = 0; i < std::max<size_t>(node.args.size(), 1); i++)
+		alloc_temp();
+
+	for (size_t i = 0; i < node.args.size(); i++)
+		compile_expr(node.args[i], base + static_cast<int>(i));
+
+	int argc = static_cast<int>(node.args.size());
+	if (const auto* ident = std::get_if<Node::LitIdent>(&node.fn))
+	{
+		if (auto reg = find_local(&RegScope::funcs, Symbols::name(ident->id)))
+			push_instr(RegOpCode::CALL, base, reg.value(), argc);
+
+		else if (auto reg = find_global(&RegScope::funcs, Symbols::name(ident->id)))
+			push_instr(RegOpCode::CALLG, base, reg.value(), argc);
+
+		else
+			ERR_EXIT("Fatal: couldn't find func with name: ", Symbols::name(ident->id));
+	}
+	else
+	{
+		int fn = compile_func(*std::get<const Node::StructFuncDecl*>(node.fn), alloc_temp());
+		push_instr(RegOpCode::CALL, base, fn, argc);
+	}
+
+	m_curr_scope->temp = base + 1;
+	return into(base, dest);
+}
+
+size_t RegCompiler::push_instr(RegOpCode code, int a, int b, int c)
+{
+	m_bytecode.push_back({ code, a, b, c });
+	return m_bytecode.size() - 1;
+}
+
+int RegCompiler::alloc_temp()
+{
+	int reg = m_curr_scope->temp++;
+	m_curr_scope->frame_size = std::max(m_curr_scope->frame_size, m_curr_scope->temp);
+	return reg;
+}
+
+int RegCompiler::alloc_local()
+{
+	int reg = m_curr_scope->locals++;
+	m_curr_scope->temp = std::max(m_curr_scope->temp, m_curr_scope->locals);
+	m_curr_scope->frame_size = std::max(m_curr_scope->frame_size, m_curr_scope->locals);
+	return reg;
+}
+
+// small integers are encoded inline, everything else goes through the constant pool
+int RegCompiler::load_const(Value val, int dest)
+{
+	int out = dest >= 0 ? dest : alloc_temp();
+	if (val.is_int() && val.operand() >= INT_MIN && val.operand() <= INT_MAX)
+	{
+		push_instr(RegOpCode::LOADK, out, static_cast<int>(val.operand()));
+		return out;
+	}
+
+	auto it = std::find_if(m_constants.begin(), m_constants.end(), [val](Value other) { return other.bits() == val.bits(); });
+	if (it == m_constants.end())
+		it = m_constants.insert(m_constants.end(), val);
+	push_instr(RegOpCode::LOADC, out, static_cast<int>(it - m_constants.begin()));
+	return out;
+}
+
+// makes sure the value in reg ends up in dest when a destination was requested
+int RegCompiler::into(int reg, int dest)
+{
+	if (dest < 0 || dest == reg)
+		return reg;
+
+	push_instr(RegOpCode::MOV, dest, reg);
+	return dest;
+}
+
+bool RegCompiler::is_global_scope() const
+{
+	return m_curr_scope == &m_global;
+}
+
+std::optional<int> RegCompiler::find_local(const std::unordered_map<std::string, int> RegScope::* names, const std::string& name) const
+{
+	const auto& map = m_curr_scope->*names;
+	if (auto it = map.find(name); it != map.end())
+		return it->second;
+	return {};
+}
+
+// the global frame starts at register 0, so its registers are also absolute indices
+std::optional<int> RegCompiler::find_global(const std::unordered_map<std::string, int> RegScope::* names, const std::string& name) const
+{
+	if (is_global_scope())
+		return {};
+
+	const auto& map = m_global.*names;
+	if (auto it = map.find(name); it != map.end())
+	{
+		for (const RegScope* scope = m_curr_scope->parent; scope != &m_global; scope = scope->parent)
+		{
+			if ((scope->*names).contains(name))
+				ERR_EXIT("Fatal: \"", name, "\" refers to a local of an enclosing function, which the register backend does not support");
+		}
+		return it->second;
+	}
+	return {};
+}
\ No newline at end of file
@@ -0,0 +1,115 @@
+#pragma once
+
+#include "Compiler.h"
+
+// Three-address register bytecode. Registers are frame slots relative to the
+// current frame base; a, b and c are register indices unless noted otherwise.
+enum class RegOpCode
+{
+	MOV, // a = b
+	LOADK, // a = integer b
+	LOADC, // a = constant pool entry b (floats and integers wider than 32 bits)
+	LOADF, // a = function entry b
+	LOADG, // a = absolute register b (globals read from inside a function)
+
+	ADD, // a = b + c
+	SUB,
+	MUL,
+	DIV,
+	BW_OR,
+	BW_AND,
+	OR,
+	AND,
+	LT,
+	GT,
+	GTE,
+	LTE,
+	EQL,
+
+	ADDI, // a = b + integer c
+	SUBI,
+	MULI,
+	LTI,
+	GTI,
+	GTEI,
+	LTEI,
+	EQLI,
+
+	JMP, // jump to a
+	JMP_FALSE, // jump to b if a is falsy
+	JMP_TRUE, // jump to b if a is truthy
+
+	CALL, // call the function in register b with the c arguments in a.., result in a
+	CALLG, // same, function in absolute register b
+	TAILCALL, // move the c arguments in a.. to r0.. and jump to the function in register b
+	TAILCALLG, // same, function in absolute register b
+	RET, // return register a
+	RET_NIL,
+
+	HLT
+};
+
+std::string reg_opcode_to_string(RegOpCode code);
+
+struct RegInstr
+{
+	RegOpCode code;
+	int a = 0;
+	int b = 0;
+	int c = 0;
+};
+
+struct RegScope
+{
+	std::unordered_map<std::string, int> vars{};
+	std::unordered_map<std::string, int> funcs{};
+	int locals = 0; // registers taken by params and named locals
+	int temp = 0; // next free temporary register
+	int frame_size = 0;
+	RegScope* parent;
+};
+
+class RegCompiler
+{
+public:
+	RegCompiler(const std::vector<Node::Node>& nodes);
+	std::vector<RegInstr> compile_prog();
+	void compile_node(const Node::Node& node);
+	void compile_asgn(const Node::StmtAsgn& node);
+	void compile_if(const Node::StmtIf& node);
+	void compile_loop(const Node::StmtLoop& node);
+	void compile_ret(const Node::StmtRet& node);
+	void compile_stmt(const Node::Stmt& node);
+	void compile_scope(const Node::Scope& node);
+
+	int compile_func(const Node::StructFuncDecl& node, int dest);
+
+	int compile_expr(const Node::Expr& node, int dest = -1);
+	void compile_cond(const Node::Expr& node, bool jump_if, std::vector<size_t>& jumps);
+	void compile_short_circuit(const Node::BinExpr& node, bool jump_if, std::vector<size_t>& jumps);
+	int compile_call(const Node::Call& node, int dest = -1);
+
+	const std::unordered_map<std::string, int>& globals() const;
+	const std::vector<Value>& constants() const;
+	int max_frame_size() const;
+
+private:
+	size_t push_instr(RegOpCode code, int a = 0, int b = 0, int c = 0);
+	void patch_jumps(const std::vector<size_t>& jumps, size_t target);
+	int alloc_temp();
+	int alloc_local();
+	int load_const(Value val, int dest);
+	int into(int reg, int dest);
+	bool is_global_scope() const;
+
+	std::optional<int> find_local(const std::unordered_map<std::string, int> RegScope::* names, const std::string& name) const;
+	std::optional<int> find_global(const std::unordered_map<std::string, int> RegScope::* names, const std::string& name) const;
+
+private:
+	const std::vector<Node::Node>& m_nodes;
+	std::vector<RegInstr> m_bytecode;
+	std::vector<Value> m_constants;
+	RegScope m_global;
+	RegScope* m_curr_scope;
+	int m_max_frame_size;
+};
\ No newline at end of file
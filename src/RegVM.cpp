@@ -0,0 +1,232 @@
+#include "RegVM.h"
+
+// same dispatch scheme as VM.cpp
+#if defined(PISP_COMPUTED_GOTO) && (defined(__GNUC__) || defined(__clang__))
+#define REG_VM_THREADED
+#endif
+
+#ifdef PISP_VM_STATS
+#define REG_VM_COUNT() ++m_executed
+#else
+#define REG_VM_COUNT() (void)0
+#endif
+
+#ifdef REG_VM_THREADED
+#define REG_VM_CASE(op) op_##op
+#define REG_VM_DISPATCH() do { REG_VM_COUNT(); goto *dispatch_table[static_cast<size_t>(ip->code)]; } while (0)
+#else
+#define REG_VM_CASE(op) case RegOpCode::op
+#define REG_VM_DISPATCH() do { REG_VM_COUNT(); goto dispatch; } while (0)
+#endif
+
+#define REG_VM_NEXT() \
+	do { ++ip; REG_VM_DISPATCH(); } while (0)
+
+#define REG(idx) regs[idx]
+
+#define REG_VM_BINARY_OP(expr) \
+	do { \
+		Value lhs = REG(ip->b); \
+		Value rhs = REG(ip->c); \
+		REG(ip->a) = (expr); \
+		REG_VM_NEXT(); \
+	} while (0)
+
+#define REG_VM_IMMEDIATE_OP(expr) \
+	do { \
+		Value lhs = REG(ip->b); \
+		Value rhs = Value(ValueType::LIT, ip->c); \
+		REG(ip->a) = (expr); \
+		REG_VM_NEXT(); \
+	} while (0)
+
+// the callee's frame starts at the caller's argument base
+#define REG_VM_CALL(fn_expr) \
+	do { \
+		Value fn = (fn_expr); \
+		if (!fn.is(ValueType::ADDR)) [[unlikely]] \
+			ERR_EXIT("Called value is not a function"); \
+		size_t caller_base = regs - m_regs; \
+		size_t base = caller_base + ip->a; \
+		if (base + m_max_frame_size > m_reg_capacity || m_frame_count == m_frame_capacity) [[unlikely]] \
+			StackMemory::overflow(); \
+		m_frames[m_frame_count++] = { static_cast<size_t>(ip - code) + 1, caller_base }; \
+		regs = m_regs + base; \
+		ip = code + fn.operand(); \
+		REG_VM_DISPATCH(); \
+	} while (0)
+
+// the arguments become r0.. of the current frame, the frame record stays as is
+#define REG_VM_TAILCALL(fn_expr) \
+	do { \
+		Value fn = (fn_expr); \
+		if (!fn.is(ValueType::ADDR)) [[unlikely]] \
+			ERR_EXIT("Called value is not a function"); \
+		std::copy(regs + ip->a, regs + ip->a + ip->c, regs); \
+		ip = code + fn.operand(); \
+		REG_VM_DISPATCH(); \
+	} while (0)
+
+// the result goes into the callee's first register, which is where the caller expects it
+#define REG_VM_RET(val_expr) \
+	do { \
+		Value ret_val = (val_expr); \
+		if (m_frame_count == 0) \
+		{ \
+			m_ip = m_bytecode.size(); \
+			return; \
+		} \
+		REG(0) = ret_val; \
+		const Frame& frame = m_frames[--m_frame_count]; \
+		regs = m_regs + frame.base; \
+		ip = code + frame.ret_ip; \
+		REG_VM_DISPATCH(); \
+	} while (0)
+
+RegVM::RegVM(std::vector<RegInstr>& bytecode, const std::vector<Value>& constants, int max_frame_size, size_t stack_size)
+	: m_bytecode(std::move(bytecode)), m_constants(constants), m_max_frame_size(max_frame_size), m_reg_memory(stack_size),
+	m_frame_memory(stack_size), m_regs(m_reg_memory.as<Value>()), m_frames(m_frame_memory.as<Frame>()),
+	m_reg_capacity(m_reg_memory.size() / sizeof(Value)), m_frame_capacity(m_frame_memory.size() / sizeof(Frame)),
+	m_frame_count(0), m_base(0), m_ip(0)
+{
+	if (m_max_frame_size > m_reg_capacity)
+		StackMemory::overflow();
+	std::fill(m_regs, m_regs + m_max_frame_size, Value{ ValueType::NIL, -1 });
+}
+
+Value RegVM::reg(size_t idx) const
+{
+	return m_regs[idx];
+}
+
+size_t RegVM::executed() const
+{
+	return m_executed;
+}
+
+void RegVM::run()
+{
+	if (m_ip >= m_bytecode.size())
+		return;
+
+	const RegInstr* const code = m_bytecode.data();
+	const RegInstr* ip = code + m_ip;
+	Value* regs = m_regs + m_base;
+
+#ifdef REG_VM_THREADED
+	// must stay in the same order as RegOpCode
+	static const void* const dispatch_table[] = {
+		&&op_MOV, &&op_LOADK, &&op_LOADC, &&op_LOADF, &&op_LOADG,
+		&&op_ADD, &&op_SUB, &&op_MUL, &&op_DIV,
+		&&op_BW_OR, &&op_BW_AND, &&op_OR, &&op_AND,
+		&&op_LT, &&op_GT, &&op_GTE, &&op_LTE, &&op_EQL,
+		&&op_ADDI, &&op_SUBI, &&op_MULI,
+		&&op_LTI, &&op_GTI, &&op_GTEI, &&op_LTEI, &&op_EQLI,
+		&&op_JMP, &&op_JMP_FALSE, &&op_JMP_TRUE,
+		&&op_CALL, &&op_CALLG, &&op_TAILCALL, &&op_TAILCALLG, &&op_RET, &&op_RET_NIL,
+		&&op_HLT,
+	};
+	static_assert(std::size(dispatch_table) == static_cast<size_t>(RegOpCode::HLT) + 1, "dispatch table out of sync with RegOpCode");
+
+	REG_VM_DISPATCH();
+#else
+dispatch:
+	switch (ip->code)
+#endif
+	{
+		REG_VM_CASE(MOV):
+		{
+			REG(ip->a) = REG(ip->b);
+			REG_VM_NEXT();
+		}
+
+		REG_VM_CASE(LOADK):
+		{
+			REG(ip->a) = { ValueType::LIT, ip->b };
+			REG_VM_NEXT();
+		}
+
+		REG_VM_CASE(LOADC):
+		{
+			REG(ip->a) = m_constants[ip->b];
+			REG_VM_NEXT();
+		}
+
+		REG_VM_CASE(LOADF):
+		{
+			REG(ip->a) = { ValueType::ADDR, ip->b };
+			REG_VM_NEXT();
+		}
+
+		REG_VM_CASE(LOADG):
+		{
+			REG(ip->a) = m_regs[ip->b];
+			REG_VM_NEXT();
+		}
+
+		REG_VM_CASE(ADD): REG_VM_BINARY_OP(ValueOps::add(lhs, rhs));
+		REG_VM_CASE(SUB): REG_VM_BINARY_OP(ValueOps::sub(lhs, rhs));
+		REG_VM_CASE(MUL): REG_VM_BINARY_OP(ValueOps::mul(lhs, rhs));
+		REG_VM_CASE(DIV): REG_VM_BINARY_OP(ValueOps::div(lhs, rhs));
+
+		REG_VM_CASE(BW_OR): REG_VM_BINARY_OP(ValueOps::bw_or(lhs, rhs));
+		REG_VM_CASE(BW_AND): REG_VM_BINARY_OP(ValueOps::bw_and(lhs, rhs));
+		REG_VM_CASE(OR): REG_VM_BINARY_OP(ValueOps::logical_or(lhs, rhs));
+		REG_VM_CASE(AND): REG_VM_BINARY_OP(ValueOps::logical_and(lhs, rhs));
+
+		REG_VM_CASE(LT): REG_VM_BINARY_OP(Value::from_bool(ValueOps::lt(lhs, rhs)));
+		REG_VM_CASE(GT): REG_VM_BINARY_OP(Value::from_bool(ValueOps::gt(lhs, rhs)));
+		REG_VM_CASE(GTE): REG_VM_BINARY_OP(Value::from_bool(ValueOps::gte(lhs, rhs)));
+		REG_VM_CASE(LTE): REG_VM_BINARY_OP(Value::from_bool(ValueOps::lte(lhs, rhs)));
+		REG_VM_CASE(EQL): REG_VM_BINARY_OP(Value::from_bool(ValueOps::eql(lhs, rhs)));
+
+		REG_VM_CASE(ADDI): REG_VM_IMMEDIATE_OP(ValueOps::add(lhs, rhs));
+		REG_VM_CASE(SUBI): REG_VM_IMMEDIATE_OP(ValueOps::sub(lhs, rhs));
+		REG_VM_CASE(MULI): REG_VM_IMMEDIATE_OP(ValueOps::mul(lhs, rhs));
+		REG_VM_CASE(LTI): REG_VM_IMMEDIATE_OP(Value::from_bool(ValueOps::lt(lhs, rhs)));
+		REG_VM_CASE(GTI): REG_VM_IMMEDIATE_OP(Value::from_bool(ValueOps::gt(lhs, rhs)));
+		REG_VM_CASE(GTEI): REG_VM_IMMEDIATE_OP(Value::from_bool(ValueOps::gte(lhs, rhs)));
+		REG_VM_CASE(LTEI): REG_VM_IMMEDIATE_OP(Value::from_bool(ValueOps::lte(lhs, rhs)));
+		REG_VM_CASE(EQLI): REG_VM_IMMEDIATE_OP(Value::from_bool(ValueOps::eql(lhs, rhs)));
+
+		REG_VM_CASE(JMP):
+		{
+			ip = code + ip->a;
+			REG_VM_DISPATCH();
+		}
+
+		REG_VM_CASE(JMP_FALSE):
+		{
+			ip = REG(ip->a).truthy() ? ip + 1 : code + ip->b;
+			REG_VM_DISPATCH();
+		}
+
+		REG_VM_CASE(JMP_TRUE):
+		{
+			ip = REG(ip->a).truthy() ? code + ip->b : ip + 1;
+			REG_VM_DISPATCH();
+		}
+
+		REG_VM_CASE(CALL): REG_VM_CALL(REG(ip->b));
+		REG_VM_CASE(CALLG): REG_VM_CALL(m_regs[ip->b]);
+
+		REG_VM_CASE(TAILCALL): REG_VM_TAILCALL(REG(ip->b));
+		REG_VM_CASE(TAILCALLG): REG_VM_TAILCALL(m_regs[ip->b]);
+
+		REG_VM_CASE(RET): REG_VM_RET(REG(ip->a));
+		REG_VM_CASE(RET_NIL): REG_VM_RET((Value{ ValueType::NIL, -1 }));
+
+		REG_VM_CASE(HLT):
+		{
+			LOGGER << "*Program Finished..*" << std::endl;
+			std::cin.get();
+			m_base = regs - m_regs;
+			m_ip = ip - code + 1;
+			return;
+		}
+
+#ifndef REG_VM_THREADED
+		default: ERR_EXIT("Unknown opcode");
+#endif
+	}
+}
\ No newline at end of file
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "RegCompiler.h"
+#include "StackMemory.h"
+
+// Interpreter for the register bytecode produced by RegCompiler. Registers and frame
+// records live in fixed reservations like the stack VM's, and a call that would not
+// fit reports a stack overflow.
+class RegVM
+{
+public:
+	// stack_size bytes are reserved for registers and again for frames
+	RegVM(std::vector<RegInstr>& bytecode, const std::vector<Value>& constants, int max_frame_size, size_t stack_size);
+	void run();
+
+	Value reg(size_t idx) const;
+	size_t executed() const; // always 0 unless built with PISP_VM_STATS
+
+private:
+	struct Frame
+	{
+		size_t ret_ip;
+		size_t base;
+	};
+
+private:
+	const std::vector<RegInstr> m_bytecode;
+	const std::vector<Value> m_constants;
+	const size_t m_max_frame_size;
+	StackMemory m_reg_memory;
+	StackMemory m_frame_memory;
+	Value* const m_regs;
+	Frame* const m_frames; // the first m_frame_count frames are live
+	const size_t m_reg_capacity;
+	const size_t m_frame_capacity;
+	size_t m_frame_count;
+	size_t m_base;
+	size_t m_ip;
+	size_t m_executed = 0;
+};
\ No newline at end of file
@@ -2,35 +2,412 @@
 #include <fstream>
 #include <string>
 #include <sstream>
+#include <chrono>
+#include <algorithm>
+#include <optional>
+#include <bit>
+#include <sys/resource.h>
 #include "Tokenizer.h"
 #include "Parser.h"
 #include "Compiler.h"
 #include "VM.h"
+#include "Fuser.h"
+#include "Peephole.h"
+#include "Optimizer.h"
+#include "IRBuilder.h"
+#include "IRPasses.h"
+#include "IRLowering.h"
+#include "Encoder.h"
+#include "RegCompiler.h"
+#include "RegVM.h"
+#include "Jit.h"
 #include "Utils.h"
 
-int main(int argc, char* argv[])
+#define USAGE "Usage: ./lisp [--backend=stack|register] [--time] [--parse-only] [--lex-diff] [--dump] [--stats] [-O0|-O1|-O2] [--passes=a,b,...] [--print-ir] [--inline=N] [--no-fold] [--no-peephole] [--no-fuse] [--jit] [--jit-threshold=N] [--jit-diff] [--stack-size=MiB] <source.lisp>"
+
+enum class Backend
 {
-	if (argc != 2)
-		ERR_EXIT("Usage: ./lisp <source.lisp>");
+	STACK,
+	REGISTER,
+};
 
-	std::stringstream src;
-	std::ifstream file(argv[1]);
-	
-	if (!file || !file.is_open())
-		ERR_EXIT("Could not open file: ", argv[1]);
+struct Options
+{
+	const char* path = nullptr;
+	Backend backend = Backend::STACK;
+	bool time = false; // report how long each front end phase and the VM took
+	bool parse_only = false; // stop once the program is parsed
+	bool lex_diff = false; // tokenize with every scanner and compare, then stop
+	bool dump = false; // print every global variable once the program halted
+	bool stats = false; // print bytecode size and executed instruction count
+	int opt_level = 2; // 0: straight from the AST, 1: through the SSA IR, 2: also eliminate common subexpressions and optimize loops
+	std::optional<std::vector<std::string>> passes; // IR passes replacing those of the level
+	bool print_ir = false; // print the IR after every pass
+	size_t inline_threshold = PassManager::DEFAULT_INLINE_THRESHOLD; // largest function inlined, in IR instructions, 0 turns inlining off
+	bool fold = true; // fold constants and prune constant branches before compiling
+	bool peephole = true; // thread jumps and drop dead code from the bytecode
+	bool fuse = true; // rewrite common sequences into superinstructions
+	bool jit = false; // compile hot functions to native code (stack backend)
+	size_t jit_threshold = 100; // calls before a function gets compiled
+	bool jit_diff = false; // run with and without the JIT and compare every global
+	size_t stack_size = VM::DEFAULT_STACK_SIZE; // bytes reserved for the value stack (registers on the register backend)
+};
+
+static Options parse_args(int argc, char* argv[])
+{
+	Options opts;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if (arg == "--backend=stack")
+			opts.backend = Backend::STACK;
+
+		else if (arg == "--backend=register")
+			opts.backend = Backend::REGISTER;
+
+		else if (arg == "--time")
+			opts.time = true;
+
+		else if (arg == "--parse-only")
+			opts.parse_only = true;
+
+		else if (arg == "--lex-diff")
+			opts.lex_diff = true;
+
+		else if (arg == "--dump")
+			opts.dump = true;
+
+		else if (arg == "--stats")
+			opts.stats = true;
+
+		else if (arg == "-O0" || arg == "-O1" || arg == "-O2")
+			opts.opt_level = arg[2] - '0';
+
+		else if (arg.starts_with("--passes="))
+		{
+			opts.passes.emplace();
+			std::stringstream list(arg.substr(std::string("--passes=").size()));
+			for (std::string pass; std::getline(list, pass, ',');)
+				opts.passes->push_back(pass);
+		}
+
+		else if (arg == "--print-ir")
+			opts.print_ir = true;
+
+		else if (arg.starts_with("--inline="))
+			opts.inline_threshold = std::stoul(arg.substr(std::string("--inline=").size()));
+
+		else if (arg == "--no-fold")
+			opts.fold = false;
+
+		else if (arg == "--no-peephole")
+			opts.peephole = false;
+
+		else if (arg == "--no-fuse")
+			opts.fuse = false;
+
+		else if (arg == "--jit")
+			opts.jit = true;
+
+		else if (arg.starts_with("--jit-threshold="))
+			opts.jit_threshold = std::stoul(arg.substr(std::string("--jit-threshold=").size()));
+
+		else if (arg == "--jit-diff")
+			opts.jit_diff = true;
+
+		else if (arg.starts_with("--stack-size="))
+			opts.stack_size = std::stoul(arg.substr(std::string("--stack-size=").size())) * 1024 * 1024;
+
+		else if (!arg.starts_with("--") && !opts.path)
+			opts.path = argv[i];
+
+		else
+			ERR_EXIT(USAGE);
+	}
+
+	if (!opts.path)
+		ERR_EXIT(USAGE);
+
+	return opts;
+}
+
+static size_t peak_rss_mib()
+{
+	rusage usage{};
+	getrusage(RUSAGE_SELF, &usage);
+	return static_cast<size_t>(usage.ru_maxrss) / 1024; // KiB on Linux
+}
+
+static void report_phase(const Options& opts, const char* phase, std::chrono::steady_clock::time_point start, size_t count, const char* unit)
+{
+	if (!opts.time)
+		return;
+
+	double elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	std::cerr << phase << ": " << elapsed_ms << " ms, " << count << " " << unit << " ("
+		<< static_cast<size_t>(count / (elapsed_ms / 1000)) << " " << unit << "/s), peak RSS " << peak_rss_mib() << " MiB" << std::endl;
+}
+
+template<typename Globals, typename Read>
+static void report(const Options& opts, double elapsed_ms, size_t bytecode_size, [[maybe_unused]] size_t executed, const Globals& globals, Read read)
+{
+	if (opts.time)
+		std::cerr << "run: " << elapsed_ms << " ms" << std::endl;
+
+	if (opts.stats)
+	{
+		std::cerr << "bytecode: " << bytecode_size << " instructions" << std::endl;
+#ifdef PISP_VM_STATS
+		std::cerr << "executed: " << executed << " instructions" << std::endl;
+#else
+		std::cerr << "executed: n/a (build with PISP_VM_STATS)" << std::endl;
+#endif
+	}
+
+	if (opts.dump)
+	{
+		std::vector<std::pair<size_t, std::string>> sorted;
+		for (const auto& [name, idx] : globals)
+			sorted.emplace_back(idx, name);
+
+		std::sort(sorted.begin(), sorted.end());
+		for (const auto& [idx, name] : sorted)
+			std::cout << name << " = " << format_value(read(idx)) << std::endl;
+	}
+}
+
+static bool same_token(const Token& lhs, const Token& rhs)
+{
+	if (lhs.type != rhs.type || lhs.offset != rhs.offset || lhs.length != rhs.length)
+		return false;
+	if (lhs == TokenTypes::Literal::INT)
+		return lhs.int_val == rhs.int_val;
+	if (lhs == TokenTypes::Literal::FLOAT)
+		return std::bit_cast<uint64_t>(lhs.float_val) == std::bit_cast<uint64_t>(rhs.float_val);
+	if (lhs == TokenTypes::Literal::IDENT)
+		return lhs.symbol == rhs.symbol;
+	return true;
+}
+
+// differential check of the lexer: every vector scanner the CPU has must produce the
+// tokens of the scalar one (bench/fuzz_lexer.py feeds it random input)
+static void lex_diff(std::string_view source)
+{
+	std::vector<Token> expected = Tokenizer(source, Scan::SCALAR).tokenize();
+	size_t mismatches = 0;
+	for (Scan scan : { Scan::SSE2, Scan::AVX2 })
+	{
+		if (!Tokenizer::supported(scan))
+		{
+			std::cerr << "lex-diff: " << Tokenizer::scan_to_string(scan) << " not available, skipped" << std::endl;
+			continue;
+		}
+
+		std::vector<Token> actual = Tokenizer(source, scan).tokenize();
+		size_t common = std::min(expected.size(), actual.size());
+		size_t first = std::mismatch(expected.begin(), expected.begin() + common, actual.begin(), same_token).first - expected.begin();
+		if (first == common && expected.size() == actual.size())
+			continue;
+
+		std::cerr << "lex-diff: " << Tokenizer::scan_to_string(scan) << " differs from token " << first << " on ("
+			<< actual.size() << " tokens, scalar has " << expected.size() << ")" << std::endl;
+		mismatches++;
+	}
+
+	if (mismatches)
+		ERR_EXIT("lex-diff: ", mismatches, " scanners differ");
+	std::cerr << "lex-diff: " << expected.size() << " tokens match" << std::endl;
+}
+
+// differential check of the JIT: the same program interpreted and with native code
+// must leave every global bit-identical
+template<typename Globals>
+static void jit_diff(const std::vector<uint8_t>& code, const Globals& globals, const Options& opts)
+{
+	if (!Jit::supported())
+		ERR_EXIT("--jit-diff: the JIT is not available on this platform");
+
+	std::vector<uint8_t> interp_code = code;
+	VM interp(interp_code, opts.stack_size);
+	interp.run();
+
+	std::vector<uint8_t> jit_code = code;
+	VM jit(jit_code, opts.stack_size);
+	jit.enable_jit(opts.jit_threshold);
+	jit.run();
+
+	size_t mismatches = 0;
+	for (const auto& [name, idx] : globals)
+	{
+		Value expected = interp.slot(idx);
+		Value actual = jit.slot(idx);
+		if (expected.bits() != actual.bits())
+		{
+			std::cerr << "jit-diff: " << name << " = " << format_value(actual) << ", interpreter has " << format_value(expected) << std::endl;
+			mismatches++;
+		}
+	}
 
-	std::string line;
-	while (std::getline(file, line))
+	if (mismatches)
+		ERR_EXIT("jit-diff: ", mismatches, " globals differ");
+	std::cerr << "jit-diff: " << globals.size() << " globals match" << std::endl;
+}
+
+// the bytecode through the IR, or nothing if the program uses something the IR doesn't model
+static std::optional<std::vector<Instr>> compile_ir(const std::vector<Node::Node>& nodes, const Options& opts, std::unordered_map<std::string, size_t>& globals)
+{
+	IRBuilder builder(nodes);
+	std::optional<IR::Module> module = builder.build();
+	if (!module.has_value())
+	{
+		if (opts.stats)
+			std::cerr << "ir: unsupported program, compiled from the AST" << std::endl;
+		return {};
+	}
+
+	PassManager passes(opts.print_ir ? &std::cerr : nullptr, opts.inline_threshold);
+	for (const std::string& pass : opts.passes.value_or(PassManager::passes_for_level(opts.opt_level)))
+		passes.add(pass);
+	passes.run(module.value());
+	if (opts.stats)
+		passes.report(std::cerr);
+
+	globals = module->globals;
+	IRLowering lowering(module.value());
+	std::vector<Instr> bytecode = lowering.lower();
+	if (opts.stats)
+		std::cerr << "frames: " << lowering.frame_slots() << " local slots, " << lowering.shared_slots() << " shared by disjoint live ranges" << std::endl;
+	return bytecode;
+}
+
+static void run_stack(std::vector<Node::Node>& nodes, Arena& arena, const Options& opts)
+{
+	std::unordered_map<std::string, size_t> globals;
+	std::optional<std::vector<Instr>> compiled;
+	if (opts.opt_level > 0)
+		compiled = compile_ir(nodes, opts, globals);
+
+	if (!compiled.has_value())
+	{
+		Compiler compiler(nodes);
+		compiled = compiler.compile_prog();
+		globals = compiler.globals();
+	}
+	std::vector<Instr> vec = std::move(compiled.value());
+	nodes.clear();
+	arena.release();
+
+	LOGGER << "Compilation completed\n" << std::endl;
+
+	if (opts.peephole)
+	{
+		Peephole peephole(vec);
+		vec = peephole.optimize();
+		if (opts.stats)
+			std::cerr << "peephole: " << peephole.removed_jumps() + peephole.removed_pairs() + peephole.removed_unreachable()
+				<< " instructions removed (" << peephole.removed_jumps() << " jumps, " << peephole.removed_pairs() << " push/pop, "
+				<< peephole.removed_unreachable() << " unreachable), " << peephole.threaded() << " jumps threaded" << std::endl;
+	}
+
+	if (opts.fuse)
+	{
+		Fuser fuser(vec);
+		vec = fuser.fuse();
+	}
+	size_t bytecode_size = vec.size();
+
+	Encoder encoder(vec);
+	auto code = encoder.encode();
+	if (opts.stats)
+		std::cerr << "encoded: " << code.size() << " bytes (" << bytecode_size * sizeof(Instr) << " as Instr)" << std::endl;
+
+	for (size_t pos = 0; pos < code.size();) // debug: bytecode
+	{
+		size_t offset = pos;
+		std::string instr_str = format_instr(code, pos);
+		std::string padding = std::string(32 - instr_str.size(), ' ');
+		LOGGER << instr_str << padding << "(" << offset << ")" << "\n";
+	}
+	LOGGER << std::endl;
+
+	if (opts.jit_diff)
+	{
+		jit_diff(code, globals, opts);
+		return;
+	}
+
+	VM vm(code, opts.stack_size);
+	if (opts.jit)
+		vm.enable_jit(opts.jit_threshold);
+
+	auto start = std::chrono::steady_clock::now();
+	vm.run();
+	auto end = std::chrono::steady_clock::now();
+
+	report(opts, std::chrono::duration<double, std::milli>(end - start).count(), bytecode_size, vm.executed(),
+		globals, [&](size_t idx) { return vm.slot(idx); });
+	if (opts.stats && vm.quickened() > 0)
+		std::cerr << "quickened: " << vm.quickened() << " instructions, " << vm.deoptimized() << " deoptimized" << std::endl;
+	if (opts.stats && vm.memo_hits() + vm.memo_misses() > 0)
+		std::cerr << "memo cache: " << vm.memo_hits() << " hits, " << vm.memo_misses() << " misses" << std::endl;
+}
+
+static void run_register(std::vector<Node::Node>& nodes, Arena& arena, const Options& opts)
+{
+	RegCompiler compiler(nodes);
+	auto vec = compiler.compile_prog();
+	nodes.clear();
+	arena.release();
+
+	LOGGER << "Compilation completed\n" << std::endl;
+
+	size_t bytecode_size = vec.size();
+	for (size_t i = 0; i < vec.size(); i++) // debug: bytecode
 	{
-		src << line;
+		std::string instr_str = format_instr(vec[i]);
+		std::string padding = std::string(32 - instr_str.size(), ' ');
+		LOGGER << instr_str << padding << "(" << i << ")" << "\n";
 	}
+	LOGGER << std::endl;
 
-	LOGGER << "Source: " << src.str() << std::endl;
+	RegVM vm(vec, compiler.constants(), compiler.max_frame_size(), opts.stack_size);
+	auto start = std::chrono::steady_clock::now();
+	vm.run();
+	auto end = std::chrono::steady_clock::now();
+
+	report(opts, std::chrono::duration<double, std::milli>(end - start).count(), bytecode_size, vm.executed(),
+		compiler.globals(), [&](size_t idx) { return vm.reg(idx); });
+}
+
+int main(int argc, char* argv[])
+{
+	Options opts = parse_args(argc, argv);
+
+	auto start = std::chrono::steady_clock::now();
+	std::ifstream file(opts.path, std::ios::binary | std::ios::ate);
+	
+	if (!file || !file.is_open())
+		ERR_EXIT("Could not open file: ", opts.path);
+
+	std::string source(static_cast<size_t>(file.tellg()), '\0'); // the tokens point into it
+	file.seekg(0);
+	file.read(source.data(), source.size());
+	std::erase(source, '\n'); // lines are joined as they are
+	LOGGER << "Source: " << source << std::endl;
 
 	file.close();
+	report_phase(opts, "read", start, source.size(), "bytes");
+
+	if (opts.lex_diff)
+	{
+		lex_diff(source);
+		return EXIT_SUCCESS;
+	}
 
-	Tokenizer tokenizer(src.str());
+	start = std::chrono::steady_clock::now();
+	Tokenizer tokenizer(source);
 	std::vector<Token> tokens = tokenizer.tokenize();
+	report_phase(opts, "tokenize", start, tokens.size(), "tokens");
 	LOGGER << "TOKENS:" << std::endl;
 	for (int i = 0; i < tokens.size(); i++) // debug: tokens
 	{
@@ -44,8 +421,11 @@ int main(int argc, char* argv[])
 	LOGGER << std::endl;
 	LOGGER << "Parsing..." << std::endl;
 
-	Parser parser(tokens);
+	start = std::chrono::steady_clock::now();
+	Arena arena; // every AST node, freed in one go once the program is compiled
+	Parser parser(tokens, arena);
 	std::vector<Node::Node> nodes = parser.parse_prog();
+	report_phase(opts, "parse", start, parser.nodes(), "nodes");
 
 	LOGGER << "Statements :" << std::endl;
 
@@ -58,23 +438,24 @@ int main(int argc, char* argv[])
 
 	LOGGER << "Parsing completed" << std::endl;
 
-	LOGGER << "Compiling..." << std::endl;
-
-	Compiler compiler(nodes);
-	auto vec = compiler.compile_prog();
-
-	LOGGER << "Compilation completed\n" << std::endl;
+	if (opts.parse_only)
+		return EXIT_SUCCESS;
 
-	for (int i = 0; i < vec.size(); i++) // debug: bytecode
+	if (opts.fold && opts.opt_level > 0)
 	{
-		std::string instr_str = format_instr(vec[i]);
-		std::string padding = std::string(32 - instr_str.size(), ' ');
-		LOGGER << instr_str << padding << "(" << i << ")" << "\n";
+		Optimizer optimizer(nodes, arena);
+		nodes = optimizer.optimize();
+		if (opts.stats)
+			std::cerr << "optimizer: " << optimizer.folded() << " folded, " << optimizer.propagated() << " propagated, "
+				<< optimizer.pruned() << " branches pruned" << std::endl;
 	}
-	LOGGER << std::endl;
 
-	VM vm(vec);
-	vm.run();
+	LOGGER << "Compiling..." << std::endl;
+
+	if (opts.backend == Backend::REGISTER)
+		run_register(nodes, arena, opts);
+	else
+		run_stack(nodes, arena, opts);
 
 	return EXIT_SUCCESS;
 }
\ No newline at end of file
@@ -0,0 +1,106 @@
+#include "StackMemory.h"
+#include "Utils.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#ifndef MAP_NORESERVE
+#define MAP_NORESERVE 0
+#endif
+
+static constexpr int MAX_GUARDS = 16;
+static constexpr size_t ALT_STACK_SIZE = 64 * 1024;
+
+// guard page ranges of every live StackMemory, read from the fault handler
+static std::atomic<uintptr_t> g_guard_begin[MAX_GUARDS];
+static std::atomic<uintptr_t> g_guard_end[MAX_GUARDS];
+
+static void on_fault(int sig, siginfo_t* info, void*)
+{
+	uintptr_t addr = reinterpret_cast<uintptr_t>(info->si_addr);
+	for (int i = 0; i < MAX_GUARDS; i++)
+	{
+		if (addr >= g_guard_begin[i].load(std::memory_order_relaxed) && addr < g_guard_end[i].load(std::memory_order_relaxed))
+			StackMemory::overflow();
+	}
+
+	// not ours, crash as if there was no handler
+	signal(sig, SIG_DFL);
+}
+
+// the handler runs on its own stack, so it still works when the fault came from the
+// native stack itself
+static void install_fault_handler()
+{
+	static bool installed = false;
+	if (installed)
+		return;
+	installed = true;
+
+	stack_t alt{};
+	alt.ss_sp = std::malloc(ALT_STACK_SIZE);
+	alt.ss_size = ALT_STACK_SIZE;
+	if (!alt.ss_sp || sigaltstack(&alt, nullptr) != 0)
+		ERR_EXIT("Could not set up the signal stack");
+
+	struct sigaction action{};
+	action.sa_sigaction = on_fault;
+	action.sa_flags = SA_SIGINFO | SA_ONSTACK;
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGSEGV, &action, nullptr);
+	sigaction(SIGBUS, &action, nullptr);
+}
+
+StackMemory::StackMemory(size_t size)
+{
+	size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+	m_size = (std::max(size, page) + page - 1) / page * page;
+
+	void* mem = mmap(nullptr, m_size + page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (mem == MAP_FAILED)
+		ERR_EXIT("Could not reserve ", m_size, " bytes of stack: ", std::strerror(errno));
+
+	m_base = mem;
+	uintptr_t guard = reinterpret_cast<uintptr_t>(m_base) + m_size;
+	if (mprotect(reinterpret_cast<void*>(guard), page, PROT_NONE) != 0)
+		ERR_EXIT("Could not protect the stack guard page: ", std::strerror(errno));
+
+	install_fault_handler();
+
+	m_guard_slot = -1;
+	for (int i = 0; i < MAX_GUARDS && m_guard_slot < 0; i++)
+	{
+		if (g_guard_end[i].load() == 0)
+			m_guard_slot = i;
+	}
+	if (m_guard_slot < 0)
+		ERR_EXIT("Too many stacks alive");
+
+	g_guard_begin[m_guard_slot].store(guard);
+	g_guard_end[m_guard_slot].store(guard + page);
+}
+
+StackMemory::~StackMemory()
+{
+	g_guard_begin[m_guard_slot].store(0);
+	g_guard_end[m_guard_slot].store(0);
+	munmap(m_base, m_size + static_cast<size_t>(sysconf(_SC_PAGESIZE)));
+}
+
+size_t StackMemory::size() const
+{
+	return m_size;
+}
+
+void StackMemory::overflow()
+{
+	static const char msg[] = "[ERROR] -> Stack overflow\n";
+	[[maybe_unused]] ssize_t written = write(STDERR_FILENO, msg, sizeof(msg) - 1);
+	_exit(EXIT_FAILURE);
+}
\ No newline at end of file
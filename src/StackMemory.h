@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+
+// A fixed reservation of address space for a stack that only grows upwards, followed
+// by an inaccessible guard page. Pages are committed by the OS on first touch, so a
+// large reservation costs nothing until it is used, and pushes never have to check
+// for room: running into the guard page reports a stack overflow and exits.
+class StackMemory
+{
+public:
+	StackMemory(size_t size); // usable bytes, rounded up to whole pages
+	~StackMemory();
+
+	StackMemory(const StackMemory&) = delete;
+	StackMemory& operator=(const StackMemory&) = delete;
+
+	template<typename T>
+	T* as() const
+	{
+		return static_cast<T*>(m_base);
+	}
+
+	size_t size() const;
+
+	// prints the same message as running into the guard page and exits, for stacks that
+	// check their bounds instead; async-signal-safe, the fault handler uses it too
+	[[noreturn]] static void overflow();
+
+private:
+	void* m_base;
+	size_t m_size;
+	int m_guard_slot; // index into the table the fault handler checks
+};
\ No newline at end of file
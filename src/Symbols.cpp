@@ -0,0 +1,41 @@
+#include "Symbols.h"
+
+#include <deque>
+#include <unordered_map>
+
+struct SymbolTable
+{
+	std::deque<std::string> names; // stable, ids keeps views into them
+	std::unordered_map<std::string_view, Symbol> ids;
+};
+
+static SymbolTable& table()
+{
+	static SymbolTable res;
+	return res;
+}
+
+namespace Symbols
+{
+	Symbol intern(std::string_view name)
+	{
+		SymbolTable& symbols = table();
+		if (auto it = symbols.ids.find(name); it != symbols.ids.end())
+			return it->second;
+
+		Symbol sym = static_cast<Symbol>(symbols.names.size());
+		symbols.names.emplace_back(name);
+		symbols.ids.emplace(symbols.names.back(), sym);
+		return sym;
+	}
+
+	const std::string& name(Symbol sym)
+	{
+		return table().names[sym];
+	}
+
+	size_t count()
+	{
+		return table().names.size();
+	}
+}
\ No newline at end of file
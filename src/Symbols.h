@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Identifiers are interned by the Tokenizer, everything after it works with their id.
+// Ids are dense (0, 1, 2, ... in order of first appearance), so tables keyed by name can
+// be plain arrays indexed by symbol.
+using Symbol = uint32_t;
+
+namespace Symbols
+{
+	Symbol intern(std::string_view name);
+	const std::string& name(Symbol sym);
+	size_t count(); // every symbol interned so far is below this
+}
\ No newline at end of file
@@ -1,4 +1,14 @@
 #include "Tokenizer.h"
+#include "Value.h"
+
+#include <array>
+#include <bit>
+#include <charconv>
+
+#if defined(__x86_64__)
+#define PISP_SCAN_X64
+#include <immintrin.h>
+#endif
 
 std::ostream& operator<<(std::ostream& os, const Token& token)
 {
@@ -6,254 +16,297 @@ std::ostream& operator<<(std::ostream& os, const Token& token)
 	return os;
 }
 
-Tokenizer::Tokenizer(const std::string& src) : m_src(src), m_index(0) {}
+// character classes, a character can be in several
+enum : uint8_t
+{
+	BLANK = 1 << 0, // skipped between tokens
+	DIGIT = 1 << 1,
+	ALPHA = 1 << 2, // starts an identifier
+	ALNUM = DIGIT | ALPHA, // continues one
+};
+
+static constexpr std::array<uint8_t, 256> CLASSES = [] {
+	std::array<uint8_t, 256> classes{};
+	classes[' '] = classes['\t'] = classes['\n'] = BLANK;
+	for (char c = '0'; c <= '9'; c++)
+		classes[static_cast<uint8_t>(c)] = DIGIT;
+	for (char c = 'a'; c <= 'z'; c++)
+		classes[static_cast<uint8_t>(c)] = classes[static_cast<uint8_t>(c - 'a' + 'A')] = ALPHA;
+	return classes;
+}();
+
+static constexpr size_t SCALAR_PROBE = 8; // characters Tokenizer::skip looks at before a vector kernel
+
+static const char* skip_scalar(const char* pos, const char* end, uint8_t cls)
+{
+	while (pos != end && (CLASSES[static_cast<uint8_t>(*pos)] & cls))
+		pos++;
+	return pos;
+}
+
+#ifdef PISP_SCAN_X64
+// a mask with 0xff in every byte of chunk that is in cls, cls being BLANK, DIGIT or ALNUM.
+// Bytes from 0x80 are negative, so the signed range compares keep them out of every class.
+static __m128i match_sse2(__m128i chunk, uint8_t cls)
+{
+	if (cls == BLANK)
+		return _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8(' ')),
+			_mm_cmpeq_epi8(chunk, _mm_set1_epi8('\t'))), _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\n')));
+
+	__m128i digit = _mm_and_si128(_mm_cmpgt_epi8(chunk, _mm_set1_epi8('0' - 1)), _mm_cmpgt_epi8(_mm_set1_epi8('9' + 1), chunk));
+	if (cls == DIGIT)
+		return digit;
+
+	__m128i lower = _mm_or_si128(chunk, _mm_set1_epi8(0x20)); // folds upper case onto lower case
+	__m128i alpha = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)), _mm_cmpgt_epi8(_mm_set1_epi8('z' + 1), lower));
+	return _mm_or_si128(digit, alpha);
+}
+
+static const char* skip_sse2(const char* pos, const char* end, uint8_t cls)
+{
+	for (; end - pos >= 16; pos += 16)
+	{
+		__m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pos));
+		uint32_t outside = ~static_cast<uint32_t>(_mm_movemask_epi8(match_sse2(chunk, cls))) & 0xffff;
+		if (outside)
+			return pos + std::countr_zero(outside);
+	}
+	return skip_scalar(pos, end, cls);
+}
+
+__attribute__((target("avx2")))
+static __m256i match_avx2(__m256i chunk, uint8_t cls)
+{
+	if (cls == BLANK)
+		return _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(chunk, _mm256_set1_epi8(' ')),
+			_mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('\t'))), _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('\n')));
+
+	__m256i digit = _mm256_and_si256(_mm256_cmpgt_epi8(chunk, _mm256_set1_epi8('0' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), chunk));
+	if (cls == DIGIT)
+		return digit;
+
+	__m256i lower = _mm256_or_si256(chunk, _mm256_set1_epi8(0x20));
+	__m256i alpha = _mm256_and_si256(_mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), lower));
+	return _mm256_or_si256(digit, alpha);
+}
+
+__attribute__((target("avx2")))
+static const char* skip_avx2(const char* pos, const char* end, uint8_t cls)
+{
+	for (; end - pos >= 32; pos += 32)
+	{
+		__m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pos));
+		uint32_t outside = ~static_cast<uint32_t>(_mm256_movemask_epi8(match_avx2(chunk, cls)));
+		if (outside)
+			return pos + std::countr_zero(outside);
+	}
+	return skip_sse2(pos, end, cls);
+}
+#endif
+
+Tokenizer::Tokenizer(std::string_view src, Scan scan) : m_src(src), m_scan(scan), m_index(0)
+{
+	if (src.size() > UINT32_MAX)
+		ERR_EXIT("Source larger than 4 GiB"); // token offsets are 32 bits
+	if (!supported(scan))
+		ERR_EXIT("The ", scan_to_string(scan), " scanner is not available on this CPU");
+}
+
+Scan Tokenizer::best_scan()
+{
+	static const Scan best = supported(Scan::AVX2) ? Scan::AVX2 : supported(Scan::SSE2) ? Scan::SSE2 : Scan::SCALAR;
+	return best;
+}
+
+bool Tokenizer::supported(Scan scan)
+{
+	switch (scan)
+	{
+		case Scan::SCALAR:
+			return true;
+#ifdef PISP_SCAN_X64
+		case Scan::SSE2:
+			return true; // part of x86-64
+		case Scan::AVX2:
+			return __builtin_cpu_supports("avx2");
+#endif
+		default:
+			return false;
+	}
+}
+
+const char* Tokenizer::scan_to_string(Scan scan)
+{
+	switch (scan)
+	{
+		case Scan::SCALAR:
+			return "scalar";
+		case Scan::SSE2:
+			return "SSE2";
+		case Scan::AVX2:
+			return "AVX2";
+	}
+	return "unknown";
+}
 
 std::vector<Token> Tokenizer::tokenize()
 {
 	std::vector<Token> tokens;
-	std::string buffer;
-	while (peek().has_value())
+	tokens.reserve(m_src.size() / 2); // dense code has a token every two characters, capacity never written to costs no memory
+	while (m_index < m_src.size())
 	{
-		if (std::isdigit(peek().value()))
-		{
-			while (peek().has_value() && std::isdigit(peek().value()))
-			{
-				LOGGER << "digit index: " << m_index << std::endl;
-				buffer += m_src[m_index];
-				consume();
-			}
-			Token token{};
-			token.type = TokenTypes::Literal::INT;
-			token.value = buffer;
-			tokens.push_back(token);
-
-			buffer.clear();
-		}
-		else if (std::isalpha(peek().value()))
-		{
-			buffer += peek().value();
-			consume();
-			while (peek().has_value() && std::isalnum(peek().value()))
-			{
-				buffer += m_src[m_index];
-				consume();
-			}
-			Token token{};
-			token.type = TokenTypes::Literal::IDENT;
-			token.value = buffer;
-			tokens.push_back(token);
-			buffer.clear();
-		}
-		else if (peek().value() == '=')
-		{
-			consume();
-			if (peek().has_value() && peek().value() == '=')
-			{
-				Token token{};
-				token.type = TokenTypes::Operator::EQL;
-				tokens.push_back(token);
-				consume();
-			}
-			else
-			{
-				Token token{};
-				token.type = TokenTypes::Operator::ASGN;
-				tokens.push_back(token);
-			}
-		}
-		else if (peek().value() == '(')
+		size_t start = m_index;
+		char c = m_src[m_index];
+		uint8_t cls = CLASSES[static_cast<uint8_t>(c)];
+		if (cls & BLANK)
 		{
-			Token token{};
-			token.type = TokenTypes::Symbol::OPEN_PAREN;
-			tokens.push_back(token);
-			consume();
+			m_index = skip(m_index, BLANK);
 		}
-		else if (peek().value() == ')')
+		else if (cls & DIGIT)
 		{
-			Token token{};
-			token.type = TokenTypes::Symbol::CLOSE_PAREN;
-			tokens.push_back(token);
-			consume();
-		}
-		else if (peek().value() == '+')
-		{
-			Token token{};
-			token.type = TokenTypes::Operator::ADD;
-			tokens.push_back(token);
-			consume();
-		}
-		else if (peek().value() == '-')
-		{
-			Token token{};
-			token.type = TokenTypes::Operator::SUB;
-			tokens.push_back(token);
-			consume();
-		}
-		else if (peek().value() == '*')
-		{
-			Token token{};
-			token.type = TokenTypes::Operator::MUL;
-			tokens.push_back(token);
-			consume();
-		}
-		else if (peek().value() == '/')
-		{
-			consume();
-			if (peek().has_value() && peek().value() == '/')
-			{
-				while (peek().has_value() && peek().value() != '/n')
-					consume();
-			}
-			else
-			{
-				Token token{};
-				token.type = TokenTypes::Operator::DIV;
-				tokens.push_back(token);
-			}
-		}
-		else if (peek().value() == '>')
-		{
-			consume();
-			if (peek().has_value() && peek().value() == '=')
-			{
-				Token token{};
-				token.type = TokenTypes::Operator::GTE;
-				tokens.push_back(token);
-				consume();
-			}
-			else
-			{
-				Token token{};
-				token.type = TokenTypes::Operator::GT;
-				tokens.push_back(token);
-			}
-		}
-		else if (peek().value() == '<')
-		{
-			consume();
-			if (peek().has_value() && peek().value() == '-')
-			{
-				consume();
-				Token token{};
-				token.type = TokenTypes::Statement::RET;
-				tokens.push_back(token);
-			}
-			else if (peek().has_value() && peek().value() == '=')
-			{
-				Token token{};
-				token.type = TokenTypes::Operator::LTE;
-				tokens.push_back(token);
-				consume();
-			}
-			else
-			{
-				Token token{};
-				token.type = TokenTypes::Operator::LT;
-				tokens.push_back(token);
-			}
-		}
-		else if (peek().value() == '&')
-		{
-			consume();
-			if (peek().has_value() && peek().value() == '&')
-			{
-				Token token{};
-				token.type = TokenTypes::Operator::AND;
-				tokens.push_back(token);
-				consume();
-			}
-			else
-			{
-				Token token{};
-				token.type = TokenTypes::Operator::BW_AND;
-				tokens.push_back(token);
-			}
-		}
-		else if (peek().value() == '|')
-		{
-			consume();
-			if (peek().has_value() && peek().value() == '|')
-			{
-				Token token{};
-				token.type = TokenTypes::Operator::OR;
-				tokens.push_back(token);
-				consume();
-			}
-			else
+			m_index = skip(m_index, DIGIT);
+			bool is_float = next_is('.');
+			if (is_float)
+				m_index = skip(m_index + 1, DIGIT);
+			push_token(tokens, is_float ? TokenTypes::Literal::FLOAT : TokenTypes::Literal::INT, start);
+
+			Token& token = tokens.back();
+			const char* first = m_src.data() + start;
+			const char* last = m_src.data() + m_index;
+			if (is_float)
 			{
-				Token token{};
-				token.type = TokenTypes::Operator::BW_OR;
-				tokens.push_back(token);
+				// from_chars refuses what doesn't fit, strtod rounds it to inf or zero
+				if (std::from_chars(first, last, token.float_val).ec != std::errc())
+					token.float_val = std::strtod(std::string(first, last).c_str(), nullptr);
 			}
+			// a Value holds 48-bit integers, a wider literal would silently turn into a double
+			else if (std::from_chars(first, last, token.int_val).ec != std::errc() || token.int_val > Value::INT_MAX_VAL)
+				ERR_EXIT("[INDEX: ", std::to_string(start), "] ", "Integer literal out of range: ", std::string(first, last));
 		}
-		else if (peek().value() == '?')
+		else if (cls & ALPHA)
 		{
-			Token token{};
-			token.type = TokenTypes::Statement::IF;
-			tokens.push_back(token);
-			consume();
+			m_index = skip(m_index + 1, ALNUM);
+			push_token(tokens, TokenTypes::Literal::IDENT, start);
+			tokens.back().symbol = Symbols::intern(m_src.substr(start, m_index - start));
 		}
-		else if (peek().value() == '!')
+		else
 		{
-			Token token{};
-			token.type = TokenTypes::Statement::ELSE;
-			tokens.push_back(token);
-			consume();
-		}
-		else if (peek().value() == ':')
-		{
-			consume();
-			if (peek().has_value() && peek().value() == ':')
+			m_index++;
+			switch (c)
 			{
-				Token token{};
-				token.type = TokenTypes::Statement::LOOP;
-				tokens.push_back(token);
-				consume();
+				case '(':
+					push_token(tokens, TokenTypes::Symbol::OPEN_PAREN, start);
+					break;
+				case ')':
+					push_token(tokens, TokenTypes::Symbol::CLOSE_PAREN, start);
+					break;
+				case '=':
+					push_token(tokens, next_is('=') ? (m_index++, TokenTypes::Operator::EQL) : TokenTypes::Operator::ASGN, start);
+					break;
+				case '+':
+					push_token(tokens, TokenTypes::Operator::ADD, start);
+					break;
+				case '-':
+					push_token(tokens, TokenTypes::Operator::SUB, start);
+					break;
+				case '*':
+					push_token(tokens, TokenTypes::Operator::MUL, start);
+					break;
+				case '/':
+					// lines are joined before tokenizing, so a comment runs to the end of the input
+					if (next_is('/'))
+						m_index = m_src.size();
+					else
+						push_token(tokens, TokenTypes::Operator::DIV, start);
+					break;
+				case '>':
+					push_token(tokens, next_is('=') ? (m_index++, TokenTypes::Operator::GTE) : TokenTypes::Operator::GT, start);
+					break;
+				case '<':
+					if (next_is('-'))
+					{
+						m_index++;
+						push_token(tokens, TokenTypes::Statement::RET, start);
+					}
+					else
+						push_token(tokens, next_is('=') ? (m_index++, TokenTypes::Operator::LTE) : TokenTypes::Operator::LT, start);
+					break;
+				case '&':
+					push_token(tokens, next_is('&') ? (m_index++, TokenTypes::Operator::AND) : TokenTypes::Operator::BW_AND, start);
+					break;
+				case '|':
+					push_token(tokens, next_is('|') ? (m_index++, TokenTypes::Operator::OR) : TokenTypes::Operator::BW_OR, start);
+					break;
+				case '?':
+					push_token(tokens, TokenTypes::Statement::IF, start);
+					break;
+				case '!':
+					push_token(tokens, TokenTypes::Statement::ELSE, start);
+					break;
+				case ':':
+					if (!next_is(':'))
+						ERR_EXIT("[INDEX: ", std::to_string(m_index), "] ", "Error tokenizing");
+					m_index++;
+					push_token(tokens, TokenTypes::Statement::LOOP, start);
+					break;
+				case '@':
+					if (next_is('@'))
+					{
+						m_index++;
+						push_token(tokens, TokenTypes::Statement::CALL, start);
+					}
+					else if (next_is('$'))
+					{
+						m_index++;
+						push_token(tokens, TokenTypes::Struct::MEMO_FUNC, start);
+					}
+					else
+						push_token(tokens, TokenTypes::Struct::FUNC, start);
+					break;
+				default:
+					ERR_EXIT("[INDEX: ", std::to_string(start), "] ", "Unexpected character: ", std::to_string(static_cast<uint8_t>(c)));
 			}
-			else
-				ERR_EXIT("[INDEX: ", std::to_string(m_index), "] ", "Error tokenizing");
-
 		}
-		else if (peek().value() == '@')
-		{
-			consume();
-			if (peek().has_value() && peek().value() == '@')
-			{
-				Token token{};
-				token.type = TokenTypes::Statement::CALL;
-				tokens.push_back(token);
-				consume();
-			}
-			else
-			{
-				Token token{};
-				token.type = TokenTypes::Struct::FUNC;
-				tokens.push_back(token);
-			}
-		}
-		else if (peek().value() == ' ' || peek().value() == '\n' || peek().value() == '\t')
-		{
-			consume();
-		}
-
 	}
 	return tokens;
 }
 
-[[nodiscard]] std::optional<char> Tokenizer::peek(int offset)
+void Tokenizer::push_token(std::vector<Token>& tokens, TokenType type, size_t start)
+{
+	Token& token = tokens.emplace_back();
+	token.type = type;
+	token.offset = static_cast<uint32_t>(start);
+	token.length = static_cast<uint32_t>(m_index - start);
+}
+
+[[nodiscard]] bool Tokenizer::next_is(char c) const
 {
-	if (m_index + offset < m_src.size())
-		return m_src[m_index + offset];
-	return {};
+	return m_index < m_src.size() && m_src[m_index] == c;
 }
 
-char Tokenizer::consume(unsigned int amount)
+size_t Tokenizer::skip(size_t index, uint8_t cls) const
 {
-	if (amount == 0) [[unlikely]]
-		ERR_EXIT("[INDEX: ", std::to_string(m_index), "] ", "Consume called with a value of 0");
+	const char* pos = m_src.data() + index;
+	const char* end = m_src.data() + m_src.size();
+
+	// most runs are a few characters long, too short for a vector compare to pay off
+	for (const char* probe_end = pos + std::min<size_t>(SCALAR_PROBE, end - pos); pos != probe_end; pos++)
+	{
+		if (!(CLASSES[static_cast<uint8_t>(*pos)] & cls))
+			return pos - m_src.data();
+	}
 
-	m_index += amount;
-	return peek(-1).value(); // return last consumed token
+	switch (m_scan)
+	{
+#ifdef PISP_SCAN_X64
+		case Scan::AVX2:
+			return skip_avx2(pos, end, cls) - m_src.data();
+		case Scan::SSE2:
+			return skip_sse2(pos, end, cls) - m_src.data();
+#endif
+		default:
+			return skip_scalar(pos, end, cls) - m_src.data();
+	}
 }
 
 std::string Tokenizer::tokentype_to_string(TokenType type)
@@ -279,6 +332,8 @@ std::string Tokenizer::tokentype_to_string(TokenType type)
 			{
 				case TokenTypes::Literal::INT:
 					return "int";
+				case TokenTypes::Literal::FLOAT:
+					return "float";
 				case TokenTypes::Literal::IDENT:
 					return "identifier";
 				case TokenTypes::Literal::NONE:
@@ -292,6 +347,8 @@ std::string Tokenizer::tokentype_to_string(TokenType type)
 			{
 				case TokenTypes::Operator::ASGN:
 					return "=";
+				case TokenTypes::Operator::EQL:
+					return "==";
 				case TokenTypes::Operator::MUL:
 					return "*";
 				case TokenTypes::Operator::DIV:
@@ -304,6 +361,10 @@ std::string Tokenizer::tokentype_to_string(TokenType type)
 					return ">";
 				case TokenTypes::Operator::LT:
 					return "<";
+				case TokenTypes::Operator::GTE:
+					return ">=";
+				case TokenTypes::Operator::LTE:
+					return "<=";
 				case TokenTypes::Operator::BW_AND:
 					return "&";
 				case TokenTypes::Operator::BW_OR:
@@ -333,4 +394,4 @@ std::string Tokenizer::tokentype_to_string(TokenType type)
 		return "Unknown";
 		}, type
 	);
-}
+}
\ No newline at end of file
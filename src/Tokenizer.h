@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <cstdint>
 #include <vector>
 #include <sstream>
@@ -9,6 +10,7 @@
 #include <iostream>
 
 #include "Utils.h"
+#include "Symbols.h"
 
 namespace TokenTypes
 {
@@ -42,6 +44,7 @@ namespace TokenTypes
 	enum class Literal
 	{
 		INT, // 123
+		FLOAT, // 1.5
 		IDENT, // x
 		NONE, // temporary place holder
 	};
@@ -59,19 +62,29 @@ namespace TokenTypes
 	enum class Struct
 	{
 		FUNC, // function
+		MEMO_FUNC, // function whose results are cached by argument values
 	};
 }
 
 using TokenType = std::variant<TokenTypes::Symbol, TokenTypes::Operator, TokenTypes::Literal,
 	TokenTypes::Statement, TokenTypes::Struct>;
 
+// Tokens own no text: offset and length locate the lexeme in the source given to the
+// Tokenizer, and literals carry their value already parsed
 struct Token
 {
 	TokenType type;
-	std::optional<std::string> value{};
+	uint32_t offset = 0;
+	uint32_t length = 0;
+	union
+	{
+		int64_t int_val = 0; // INT literals
+		double float_val; // FLOAT literals
+		Symbol symbol; // identifiers
+	};
 
 	template<typename T>
-	bool operator==(const T& type_enum)
+	bool operator==(const T& type_enum) const
 	{
 		if (auto* op = std::get_if<T>(&type))
 			return *op == type_enum;
@@ -81,19 +94,34 @@ struct Token
 	friend std::ostream& operator<<(std::ostream& os, const Token& token);
 };
 
+// How runs of blanks, digits and identifier characters are skipped. The vector kernels
+// look at 16 (SSE2) or 32 (AVX2) bytes at a time and exist on x86-64 only, every kernel
+// produces the same tokens.
+enum class Scan
+{
+	SCALAR,
+	SSE2,
+	AVX2,
+};
+
 class Tokenizer
 {
 public:
-	Tokenizer(const std::string& src);
+	Tokenizer(std::string_view src, Scan scan = best_scan()); // src has to outlive the tokens
 	std::vector<Token> tokenize();
 	static std::string tokentype_to_string(TokenType type);
 
+	static Scan best_scan(); // the widest kernel this CPU runs
+	static bool supported(Scan scan);
+	static const char* scan_to_string(Scan scan);
+
 private:
-	[[nodiscard]] std::optional<char> peek(int offset = 0);
-	char consume(unsigned int amount = 1);
+	[[nodiscard]] bool next_is(char c) const;
+	size_t skip(size_t index, uint8_t cls) const; // the first index at or after index whose character isn't in cls
+	void push_token(std::vector<Token>& tokens, TokenType type, size_t start);
 
 private:
-	const std::string m_src;
-	uint16_t m_index;
+	const std::string_view m_src;
+	const Scan m_scan;
+	size_t m_index;
 };
-
@@ -1,20 +1,109 @@
 #include "Utils.h"
 #include "Compiler.h"
+#include "RegCompiler.h"
+#include "Encoder.h"
 
+#include <charconv>
+
+#ifndef _DEBUG
 Logger& Logger::operator<<(std::ostream& (*)(std::ostream&)) { return *this; }
 Logger& Logger::operator<<(std::ios& (*)(std::ios&)) { return *this; }
 
 Logger g_logger;
+#endif
+
+// doubles print in their shortest round-trip form and always keep a fraction or exponent
+std::string format_value(const Value& val)
+{
+	std::stringstream ss;
+	switch (val.type())
+	{
+		case ValueType::LIT: ss << val.operand(); break;
+		case ValueType::FLOAT:
+		{
+			char buf[32];
+			auto [end, ec] = std::to_chars(buf, buf + sizeof(buf), val.as_double());
+			std::string str(buf, end);
+			if (str.find_first_of(".eni") == std::string::npos)
+				str += ".0";
+			ss << str;
+			break;
+		}
+		case ValueType::VAR: ss << "[" << val.operand() << "]"; break;
+		case ValueType::ABS_VAR: ss << "(" << val.operand() << ")"; break;
+		case ValueType::ADDR: ss << "<" << val.operand() << ">"; break;
+		case ValueType::NIL: ss << "NIL"; break;
+		case ValueType::NOT_REQUIRED: break;
+	}
+	return ss.str();
+}
+
 std::string format_instr(const Instr& instr)
 {
 	std::stringstream ss;
-	switch (instr.val.v_type)
+	ss << opcode_to_string(instr.code);
+	if (!instr.val.is(ValueType::NOT_REQUIRED))
+		ss << " " << format_value(instr.val);
+
+	switch (instr.code)
+	{
+		case OpCode::ADD_LOCAL_IMM:
+		case OpCode::INC_LOCAL:
+		case OpCode::CALL:
+		case OpCode::TAILCALL:
+		case OpCode::MEMO:
+		case OpCode::MEMO_RET:
+			ss << ", " << instr.imm;
+			break;
+
+		default:
+			break;
+	}
+	return ss.str();
+}
+
+std::string format_instr(const std::vector<uint8_t>& code, size_t& pos)
+{
+	return format_instr(decode_instr(code, pos));
+}
+
+std::string format_instr(const RegInstr& instr)
+{
+	std::stringstream ss;
+	ss << reg_opcode_to_string(instr.code);
+	switch (instr.code)
 	{
-		case ValueType::NIL: ss << opcode_to_string(instr.code) << " NIL"; break;
-		case ValueType::LIT: ss << opcode_to_string(instr.code) << " " << instr.val.operand; break;
-		case ValueType::VAR: ss << opcode_to_string(instr.code) << " [" << instr.val.operand << "]"; break;
-		case ValueType::ABS_VAR: ss << opcode_to_string(instr.code) << " (" << instr.val.operand << ")"; break;
-		case ValueType::NOT_REQUIRED: ss << opcode_to_string(instr.code); break;
+		case RegOpCode::MOV: ss << " r" << instr.a << ", r" << instr.b; break;
+		case RegOpCode::LOADK: ss << " r" << instr.a << ", " << instr.b; break;
+		case RegOpCode::LOADC: ss << " r" << instr.a << ", k" << instr.b; break;
+		case RegOpCode::LOADF: ss << " r" << instr.a << ", <" << instr.b << ">"; break;
+		case RegOpCode::LOADG: ss << " r" << instr.a << ", (" << instr.b << ")"; break;
+		case RegOpCode::JMP: ss << " " << instr.a; break;
+		case RegOpCode::JMP_FALSE:
+		case RegOpCode::JMP_TRUE: ss << " r" << instr.a << ", " << instr.b; break;
+		case RegOpCode::CALL: ss << " r" << instr.a << ", r" << instr.b << ", " << instr.c; break;
+		case RegOpCode::CALLG: ss << " r" << instr.a << ", (" << instr.b << "), " << instr.c; break;
+		case RegOpCode::TAILCALL: ss << " r" << instr.a << ", r" << instr.b << ", " << instr.c; break;
+		case RegOpCode::TAILCALLG: ss << " r" << instr.a << ", (" << instr.b << "), " << instr.c; break;
+		case RegOpCode::RET: ss << " r" << instr.a; break;
+		case RegOpCode::RET_NIL:
+		case RegOpCode::HLT:
+			break;
+
+		case RegOpCode::ADDI:
+		case RegOpCode::SUBI:
+		case RegOpCode::MULI:
+		case RegOpCode::LTI:
+		case RegOpCode::GTI:
+		case RegOpCode::GTEI:
+		case RegOpCode::LTEI:
+		case RegOpCode::EQLI:
+			ss << " r" << instr.a << ", r" << instr.b << ", " << instr.c;
+			break;
+
+		default:
+			ss << " r" << instr.a << ", r" << instr.b << ", r" << instr.c;
+			break;
 	}
 	return ss.str();
 }
\ No newline at end of file
@@ -1,6 +1,8 @@
 #pragma once
 #include <iostream>
 #include <sstream>
+#include <vector>
+#include <cstdint>
 
 #ifdef _DEBUG
 #define LOGGER std::cout
@@ -21,14 +23,16 @@ public:
 
 extern Logger g_logger;
 
-#define LOGGER g_logger
+// release builds log nothing, and the else keeps the arguments from being evaluated
+// (node_to_string alone is quadratic in nesting)
+#define LOGGER if (true) {} else g_logger
 #endif
 
 #define ERR_EXIT(...) \
 	err_exit(__FILE__, __LINE__, __func__, __VA_ARGS__);
 
 template<typename ...Args>
-void err_exit(const char* file, int line, const char* func, Args&&... args)
+[[noreturn]] void err_exit(const char* file, int line, const char* func, Args&&... args)
 {
 	std::ostringstream oss;
 	(oss << ... << std::forward<Args>(args));
@@ -41,5 +45,14 @@ void err_exit(const char* file, int line, const char* func, Args&&... args)
 	std::exit(EXIT_FAILURE);
 }
 
+class Value;
+std::string format_value(const Value& val);
+
 struct Instr;
-std::string format_instr(const Instr& instr);
\ No newline at end of file
+std::string format_instr(const Instr& instr);
+
+// disassembles the encoded instruction at pos and advances pos past it
+std::string format_instr(const std::vector<uint8_t>& code, size_t& pos);
+
+struct RegInstr;
+std::string format_instr(const RegInstr& instr);
\ No newline at end of file
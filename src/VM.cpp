@@ -1,327 +1,472 @@
 #include "VM.h"
-
-VM::VM(std::vector<Instr>& bytecode) : m_bytecode(std::move(bytecode)), m_bp(0), m_ip(0) {}
-
-void VM::run()
-{
-	while (m_ip < m_bytecode.size())
-	{
-		exec_next();
-	}
-}
-
-void VM::exec_next()
-{
-	const auto& instr = m_bytecode[m_ip];
-	switch (instr.code)
-	{
-		case (OpCode::PUSH): push(instr.val); break;
-		case (OpCode::POP): pop(); break;
-		case (OpCode::MOV): move(instr.val); break;
-
-		case (OpCode::PUSH_SF): push_sf(); break;
-		case (OpCode::POP_SF): pop_sf(); break;
-
-		case (OpCode::ADD): add(); break;
-		case (OpCode::SUB): sub(); break;
-		case (OpCode::MUL): mul(); break;
-		case (OpCode::DIV): div(); break;
-
-		case (OpCode::BW_OR): bw_or(); break;
-		case (OpCode::BW_AND): bw_and(); break;
-		case (OpCode::OR): or_(); break;
-		case (OpCode::AND): and_(); break;
-
-		case (OpCode::LT): lt(); break;
-		case (OpCode::GT): gt(); break;
-		case (OpCode::GTE): gte(); break;
-		case (OpCode::LTE): lte(); break;
-		case (OpCode::EQL): eql(); break;
-
-		case (OpCode::JMP): jmp(instr.val); break;
-		case (OpCode::JMP_ZERO): jmp_zero(instr.val); break;
-
-		case (OpCode::HLT): hlt(); break;
-
-		default: ERR_EXIT("Unknown opcode");
-	}
-}
-
-void VM::move(Value val)
-{
-	Value stack_top = m_stack.back();
-	m_stack.pop_back();
-	m_stack[val.operand + m_bp] = stack_top;
-	m_ip++;
-}
-
-void VM::push_sf()
-{
-
-	m_stack.push_back({ ValueType::LIT, static_cast<int>(m_bp) });
-	size_t move_to = m_stack.size();
-
-	m_ip++;
-	while (m_ip < m_bytecode.size() && m_bytecode[m_ip].code != OpCode::JMP)
-	{
-		exec_next();
-	}
-	exec_next();
-	m_bp = move_to;
-}
-
-void VM::pop_sf()
+#include "Encoder.h"
+#include "Jit.h"
+
+// PISP_COMPUTED_GOTO selects direct-threaded dispatch: every handler ends by jumping
+// straight to the handler of the next instruction through a label table, so each
+// opcode gets its own indirect branch. Compilers without the labels-as-values
+// extension fall back to a portable switch inside a loop.
+#if defined(PISP_COMPUTED_GOTO) && (defined(__GNUC__) || defined(__clang__))
+#define VM_THREADED
+#endif
+
+// PISP_VM_STATS counts every dispatched instruction
+#ifdef PISP_VM_STATS
+#define VM_COUNT() ++m_executed
+#else
+#define VM_COUNT() (void)0
+#endif
+
+// ip points at an opcode byte when dispatching; handlers start right after it and
+// decode their own operands, which leaves ip at the next instruction
+#ifdef VM_THREADED
+#define VM_CASE(op) op_##op
+#define VM_DISPATCH() do { VM_COUNT(); goto *dispatch_table[*ip++]; } while (0)
+#else
+#define VM_CASE(op) case OpCode::op
+#define VM_DISPATCH() do { VM_COUNT(); goto dispatch; } while (0)
+#endif
+
+#define VM_NEXT() VM_DISPATCH()
+
+// the stack lives in registers while running: sp is the next free slot and bp the
+// first slot of the current frame
+#define VM_SAVE() \
+	do { m_sp = sp - m_stack; m_bp = bp - m_stack; } while (0)
+
+#define VM_LOAD() \
+	do { sp = m_stack + m_sp; bp = m_stack + m_bp; } while (0)
+
+// no room check: running off the reservation hits the guard page of m_stack_memory
+#define VM_PUSH(expr) \
+	do { *sp++ = (expr); } while (0)
+
+// hands control to native code and continues wherever it stopped
+#define VM_RUN_NATIVE(native) \
+	do { \
+		VM_SAVE(); \
+		ip = code + enter_jit(native); \
+		VM_LOAD(); \
+	} while (0)
+
+// a conditional branch going backwards is the bottom test of a loop, its back edge
+// counts towards compiling the loop just like one taken by JMP
+#define VM_BRANCH_TO(target) \
+	do { \
+		const uint8_t* from = ip; \
+		ip = code + (target); \
+		if (m_jit && ip < from) \
+		{ \
+			if (const void* native = m_jit->on_entry(ip - code)) \
+				VM_RUN_NATIVE(native); \
+		} \
+	} while (0)
+
+// operands are always plain values, loads resolve slots before anything is pushed
+#define VM_BRANCH_IF(cond) \
+	do { \
+		Value rhs = sp[-1]; \
+		Value lhs = sp[-2]; \
+		sp -= 2; \
+		uint32_t target = read_u32(ip); \
+		if (cond) \
+			VM_BRANCH_TO(target); \
+		VM_DISPATCH(); \
+	} while (0)
+
+// drops the frame and hands the value to the caller
+#define VM_RETURN(expr) \
+	do { \
+		Value ret_val = (expr); \
+		if (m_frame_count == 0) /* returning from the top level ends the program */ \
+		{ \
+			VM_SAVE(); \
+			m_ip = m_code.size(); \
+			return; \
+		} \
+		*bp = ret_val; \
+		sp = bp + 1; \
+		const Frame& frame = m_frames[--m_frame_count]; \
+		bp = m_stack + frame.bp; \
+		ip = code + frame.ret_ip; \
+		if (m_jit) \
+		{ \
+			if (const void* native = m_jit->resume_point(frame.ret_ip)) \
+				VM_RUN_NATIVE(native); \
+		} \
+		VM_DISPATCH(); \
+	} while (0)
+
+#define VM_BINARY_OP(expr) \
+	do { \
+		Value rhs = sp[-1]; \
+		Value lhs = sp[-2]; \
+		sp[-2] = (expr); \
+		--sp; \
+		VM_NEXT(); \
+	} while (0)
+
+// Quickening: the generic arithmetic handlers rewrite their own opcode byte into the
+// double form once they see two doubles, and the double form rewrites it back for good
+// as soon as it sees anything else. Only the opcode changes, so no offset ever moves.
+// Ints never quicken: the generic handlers already try them first, so an int form would
+// repeat the same tag check and measured no faster. Native code reads the rewritten
+// opcodes as type feedback when it compiles a function.
+#define VM_QUICKEN(op) \
+	do { code[ip - 1 - code] = static_cast<uint8_t>(OpCode::op); } while (0)
+
+#define VM_GENERIC_OP(fn, quick) \
+	do { \
+		Value rhs = sp[-1]; \
+		Value lhs = sp[-2]; \
+		if (!Value::both_int(lhs, rhs) && Value::both_double(lhs, rhs) && !m_unstable[ip - 1 - code]) [[unlikely]] \
+		{ \
+			VM_QUICKEN(quick); \
+			++m_quickened; \
+		} \
+		sp[-2] = ValueOps::fn(lhs, rhs); \
+		--sp; \
+		VM_NEXT(); \
+	} while (0)
+
+// a miss goes back to the generic form and runs the instruction again from its opcode
+#define VM_DOUBLE_OP(generic, op) \
+	do { \
+		Value rhs = sp[-1]; \
+		Value lhs = sp[-2]; \
+		if (!Value::both_double(lhs, rhs)) [[unlikely]] \
+		{ \
+			VM_QUICKEN(generic); \
+			m_unstable[ip - 1 - code] = true; \
+			++m_deoptimized; \
+			--ip; \
+			VM_DISPATCH(); \
+		} \
+		sp[-2] = Value::from_double(lhs.as_double() op rhs.as_double()); \
+		--sp; \
+		VM_NEXT(); \
+	} while (0)
+
+VM::VM(std::vector<uint8_t>& code, size_t stack_size)
+	: m_code(std::move(code)), m_unstable(m_code.size()), m_stack_memory(stack_size), m_frame_memory(stack_size),
+	m_stack(m_stack_memory.as<Value>()), m_frames(m_frame_memory.as<Frame>()), m_sp(0), m_frame_count(0), m_bp(0), m_ip(0) {}
+
+VM::~VM() = default;
+
+void VM::enable_jit(size_t threshold)
 {
-	Value old_bp = m_stack.back();
-	m_stack.pop_back();
-
-	Value ret_addr = m_stack.back();
-	m_stack.pop_back();
-
-	m_bp = old_bp.operand;
-	m_ip = ret_addr.operand;
+	m_jit = std::make_unique<Jit>(m_code, threshold);
 }
 
-void VM::add()
+Value VM::slot(size_t idx) const
 {
-	Value v1 = m_stack.back();
-	m_stack.pop_back();
-
-	Value v2 = m_stack.back();
-	m_stack.pop_back();
-
-	int val1 = v1.v_type == ValueType::LIT ? v1.operand : m_stack[v1.operand + m_bp].operand;
-	int val2 = v2.v_type == ValueType::LIT ? v2.operand : m_stack[v2.operand + m_bp].operand;
-
-	m_stack.push_back({ ValueType::LIT, val2 + val1 });
-	m_ip++;
+	return m_stack[idx];
 }
 
-void VM::sub()
+size_t VM::executed() const
 {
-	Value v1 = m_stack.back();
-	m_stack.pop_back();
-
-	Value v2 = m_stack.back();
-	m_stack.pop_back();
-
-	int val1 = v1.v_type == ValueType::LIT ? v1.operand : m_stack[v1.operand + m_bp].operand;
-	int val2 = v2.v_type == ValueType::LIT ? v2.operand : m_stack[v2.operand + m_bp].operand;
-
-	m_stack.push_back({ ValueType::LIT, val2 - val1 });
-	m_ip++;
+	return m_executed;
 }
 
-void VM::mul()
+size_t VM::quickened() const
 {
-	Value v1 = m_stack.back();
-	m_stack.pop_back();
-
-	Value v2 = m_stack.back();
-	m_stack.pop_back();
-
-	int val1 = v1.v_type == ValueType::LIT ? v1.operand : m_stack[v1.operand + m_bp].operand;
-	int val2 = v2.v_type == ValueType::LIT ? v2.operand : m_stack[v2.operand + m_bp].operand;
-
-	m_stack.push_back({ ValueType::LIT, val2 * val1 });
-	m_ip++;
+	return m_quickened;
 }
 
-void VM::div()
+size_t VM::deoptimized() const
 {
-	Value v1 = m_stack.back();
-	m_stack.pop_back();
-
-	Value v2 = m_stack.back();
-	m_stack.pop_back();
-
-	int val1 = v1.v_type == ValueType::LIT ? v1.operand : m_stack[v1.operand + m_bp].operand;
-	int val2 = v2.v_type == ValueType::LIT ? v2.operand : m_stack[v2.operand + m_bp].operand;
-
-	m_stack.push_back({ ValueType::LIT, val2 / val1 });
-	m_ip++;
-}
-
-void VM::bw_or()
-{
-	Value v1 = m_stack.back();
-	m_stack.pop_back();
-
-	Value v2 = m_stack.back();
-	m_stack.pop_back();
-
-	int val1 = v1.v_type == ValueType::LIT ? v1.operand : m_stack[v1.operand + m_bp].operand;
-	int val2 = v2.v_type == ValueType::LIT ? v2.operand : m_stack[v2.operand + m_bp].operand;
-
-	m_stack.push_back({ ValueType::LIT, val2 | val1 });
-	m_ip++;
+	return m_deoptimized;
 }
 
-void VM::bw_and()
+size_t VM::memo_hits() const
 {
-	Value v1 = m_stack.back();
-	m_stack.pop_back();
-
-	Value v2 = m_stack.back();
-	m_stack.pop_back();
-
-	int val1 = v1.v_type == ValueType::LIT ? v1.operand : m_stack[v1.operand + m_bp].operand;
-	int val2 = v2.v_type == ValueType::LIT ? v2.operand : m_stack[v2.operand + m_bp].operand;
-
-	m_stack.push_back({ ValueType::LIT, val2 & val1 });
-	m_ip++;
+	size_t hits = 0;
+	for (const std::optional<MemoCache>& cache : m_memo)
+		hits += cache.has_value() ? cache->hits() : 0;
+	return hits;
 }
 
-void VM::or_()
+size_t VM::memo_misses() const
 {
-	Value v1 = m_stack.back();
-	m_stack.pop_back();
-
-	Value v2 = m_stack.back();
-	m_stack.pop_back();
-
-	int val1 = v1.v_type == ValueType::LIT ? v1.operand : m_stack[v1.operand + m_bp].operand;
-	int val2 = v2.v_type == ValueType::LIT ? v2.operand : m_stack[v2.operand + m_bp].operand;
-
-	m_stack.push_back({ ValueType::LIT, val2 || val1 });
-	m_ip++;
+	size_t misses = 0;
+	for (const std::optional<MemoCache>& cache : m_memo)
+		misses += cache.has_value() ? cache->misses() : 0;
+	return misses;
 }
 
-void VM::and_()
+// native code returns whenever it reaches something it leaves to the interpreter;
+// a call into a function that has no native code yet still gets counted here
+size_t VM::enter_jit(const void* native)
 {
-	Value v1 = m_stack.back();
-	m_stack.pop_back();
-
-	Value v2 = m_stack.back();
-	m_stack.pop_back();
-
-	int val1 = v1.v_type == ValueType::LIT ? v1.operand : m_stack[v1.operand + m_bp].operand;
-	int val2 = v2.v_type == ValueType::LIT ? v2.operand : m_stack[v2.operand + m_bp].operand;
-
-	m_stack.push_back({ ValueType::LIT, val2 && val1 });
-	m_ip++;
-}
-
-void VM::lt()
-{
-	Value v1 = m_stack.back();
-	m_stack.pop_back();
-
-	Value v2 = m_stack.back();
-	m_stack.pop_back();
-
-	int val1 = v1.v_type == ValueType::LIT ? v1.operand : m_stack[v1.operand + m_bp].operand;
-	int val2 = v2.v_type == ValueType::LIT ? v2.operand : m_stack[v2.operand + m_bp].operand;
-
-	m_stack.push_back({ ValueType::LIT, val2 < val1 });
-	m_ip++;
-}
-
-void VM::gt()
-{
-	Value v1 = m_stack.back();
-	m_stack.pop_back();
-
-	Value v2 = m_stack.back();
-	m_stack.pop_back();
-
-	int val1 = v1.v_type == ValueType::LIT ? v1.operand : m_stack[v1.operand + m_bp].operand;
-	int val2 = v2.v_type == ValueType::LIT ? v2.operand : m_stack[v2.operand + m_bp].operand;
-
-	m_stack.push_back({ ValueType::LIT, val2 > val1 });
-	m_ip++;
-}
-
-void VM::gte()
-{
-	Value v1 = m_stack.back();
-	m_stack.pop_back();
-
-	Value v2 = m_stack.back();
-	m_stack.pop_back();
-
-	int val1 = v1.v_type == ValueType::LIT ? v1.operand : m_stack[v1.operand + m_bp].operand;
-	int val2 = v2.v_type == ValueType::LIT ? v2.operand : m_stack[v2.operand + m_bp].operand;
-
-	m_stack.push_back({ ValueType::LIT, val2 >= val1 });
-	m_ip++;
-}
-
-void VM::lte()
-{
-	Value v1 = m_stack.back();
-	m_stack.pop_back();
-
-	Value v2 = m_stack.back();
-	m_stack.pop_back();
-
-	int val1 = v1.v_type == ValueType::LIT ? v1.operand : m_stack[v1.operand + m_bp].operand;
-	int val2 = v2.v_type == ValueType::LIT ? v2.operand : m_stack[v2.operand + m_bp].operand;
-
-	m_stack.push_back({ ValueType::LIT, val2 <= val1 });
-	m_ip++;
-}
-
-void VM::eql()
-{
-	Value v1 = m_stack.back();
-	m_stack.pop_back();
-
-	Value v2 = m_stack.back();
-	m_stack.pop_back();
-
-	int val1 = v1.v_type == ValueType::LIT ? v1.operand : m_stack[v1.operand + m_bp].operand;
-	int val2 = v2.v_type == ValueType::LIT ? v2.operand : m_stack[v2.operand + m_bp].operand;
-
-	m_stack.push_back({ ValueType::LIT, val2 == val1 });
-	m_ip++;
-}
-
-void VM::jmp(Value val)
-{
-	if (val.v_type == ValueType::LIT)
-	{
-		m_ip = val.operand;
-	}
-
-	else if (val.v_type == ValueType::VAR)
+	while (true)
 	{
-		m_ip = m_stack[val.operand + m_bp].operand;
+		JitState state{ m_stack, m_stack + m_sp, m_stack + m_bp, m_frames, m_frame_count, m_jit->native_table(), 0, 0 };
+		m_jit->run(native, state);
+
+		m_sp = state.sp - m_stack;
+		m_bp = state.bp - m_stack;
+		m_frame_count = state.frame_count;
+		if (!state.called)
+			return state.ip;
+
+		native = m_jit->on_entry(state.ip);
+		if (!native)
+			return state.ip;
 	}
-
-	else if (val.v_type == ValueType::ABS_VAR)
-	{
-		m_ip = m_stack[val.operand].operand;
-	}
-}
-
-void VM::jmp_zero(Value val)
-{
-	Value cond = m_stack.back();
-	m_stack.pop_back();
-
-	if (cond.operand == 0)
-		m_ip = val.operand;
-	else
-		m_ip++;
-}
-
-void VM::hlt()
-{
-	LOGGER << "*Program Finished..*" << std::endl;
-	std::cin.get();
-	m_ip++;
-}
-
-void VM::push(Value val)
-{
-	m_stack.push_back(val);
-	m_ip++;
 }
 
-void VM::pop()
+void VM::run()
 {
-	m_stack.pop_back();
-	m_ip++;
-}
-
+	if (m_ip >= m_code.size())
+		return;
+
+	uint8_t* const code = m_code.data();
+	const uint8_t* ip = code + m_ip;
+	Value* sp;
+	Value* bp;
+	VM_LOAD();
+
+#ifdef VM_THREADED
+	// must stay in the same order as OpCode
+	static const void* const dispatch_table[] = {
+		&&op_MOV,
+		&&op_PUSH, &&op_POP, &&op_RESERVE,
+		&&op_LOAD_LOCAL, &&op_LOAD_GLOBAL, &&op_LOAD_CONST,
+		&&op_ADD, &&op_SUB, &&op_MUL, &&op_DIV,
+		&&op_BW_OR, &&op_BW_AND, &&op_OR, &&op_AND,
+		&&op_LT, &&op_GT, &&op_GTE, &&op_LTE, &&op_EQL,
+		&&op_JMP, &&op_JMP_ZERO, &&op_JMP_NONZERO,
+		&&op_CALL, &&op_RET, &&op_TAILCALL, &&op_MEMO, &&op_MEMO_RET,
+		&&op_ADD_IMM, &&op_ADD_LOCAL_IMM, &&op_INC_LOCAL,
+		&&op_JLT, &&op_JGT, &&op_JLTE, &&op_JGTE, &&op_JEQ, &&op_JNE,
+		&&op_JNLT, &&op_JNGT, &&op_JNLTE, &&op_JNGTE,
+		&&op_ADD_DBL, &&op_SUB_DBL, &&op_MUL_DBL, &&op_DIV_DBL,
+		&&op_HLT,
+	};
+	static_assert(std::size(dispatch_table) == static_cast<size_t>(OpCode::HLT) + 1, "dispatch table out of sync with OpCode");
+
+	VM_DISPATCH();
+#else
+dispatch:
+	switch (static_cast<OpCode>(*ip++))
+#endif
+	{
+		VM_CASE(PUSH):
+		{
+			VM_PUSH(read_value(ip));
+			VM_NEXT();
+		}
+
+		VM_CASE(POP):
+		{
+			--sp;
+			VM_NEXT();
+		}
+
+		VM_CASE(RESERVE):
+		{
+			size_t count = read_uleb(ip);
+			std::fill(sp, sp + count, Value(ValueType::NIL, -1));
+			sp += count;
+			VM_NEXT();
+		}
+
+		VM_CASE(LOAD_LOCAL):
+		{
+			VM_PUSH(bp[read_sleb(ip)]);
+			VM_NEXT();
+		}
+
+		VM_CASE(LOAD_GLOBAL):
+		{
+			VM_PUSH(m_stack[read_uleb(ip)]);
+			VM_NEXT();
+		}
+
+		VM_CASE(LOAD_CONST):
+		{
+			VM_PUSH(Value(ValueType::LIT, read_sleb(ip)));
+			VM_NEXT();
+		}
+
+		VM_CASE(MOV):
+		{
+			bp[read_sleb(ip)] = *--sp;
+			VM_NEXT();
+		}
+
+		VM_CASE(ADD): VM_GENERIC_OP(add, ADD_DBL);
+		VM_CASE(SUB): VM_GENERIC_OP(sub, SUB_DBL);
+		VM_CASE(MUL): VM_GENERIC_OP(mul, MUL_DBL);
+		VM_CASE(DIV): VM_GENERIC_OP(div, DIV_DBL);
+
+		VM_CASE(BW_OR): VM_BINARY_OP(ValueOps::bw_or(lhs, rhs));
+		VM_CASE(BW_AND): VM_BINARY_OP(ValueOps::bw_and(lhs, rhs));
+		VM_CASE(OR): VM_BINARY_OP(ValueOps::logical_or(lhs, rhs));
+		VM_CASE(AND): VM_BINARY_OP(ValueOps::logical_and(lhs, rhs));
+
+		VM_CASE(LT): VM_BINARY_OP(Value::from_bool(ValueOps::lt(lhs, rhs)));
+		VM_CASE(GT): VM_BINARY_OP(Value::from_bool(ValueOps::gt(lhs, rhs)));
+		VM_CASE(GTE): VM_BINARY_OP(Value::from_bool(ValueOps::gte(lhs, rhs)));
+		VM_CASE(LTE): VM_BINARY_OP(Value::from_bool(ValueOps::lte(lhs, rhs)));
+		VM_CASE(EQL): VM_BINARY_OP(Value::from_bool(ValueOps::eql(lhs, rhs)));
+
+		VM_CASE(JMP):
+		{
+			const uint8_t* from = ip;
+			ip = code + read_u32(ip);
+			if (m_jit) // back edges count towards compiling the loop, and re-enter it after a bailout
+			{
+				const void* native = ip < from ? m_jit->on_entry(ip - code) : m_jit->resume_point(ip - code);
+				if (native)
+					VM_RUN_NATIVE(native);
+			}
+			VM_DISPATCH();
+		}
+
+		VM_CASE(JMP_ZERO):
+		{
+			Value cond = *--sp;
+			uint32_t target = read_u32(ip);
+			if (!cond.truthy())
+				VM_BRANCH_TO(target);
+			VM_DISPATCH();
+		}
+
+		VM_CASE(JMP_NONZERO):
+		{
+			Value cond = *--sp;
+			uint32_t target = read_u32(ip);
+			if (cond.truthy())
+				VM_BRANCH_TO(target);
+			VM_DISPATCH();
+		}
+
+		VM_CASE(CALL):
+		{
+			int64_t callee = read_sleb(ip);
+			size_t argc = read_uleb(ip);
+			const Value& fn = callee & 1 ? m_stack[callee >> 1] : bp[callee >> 1];
+			if (!fn.is(ValueType::ADDR)) [[unlikely]]
+				ERR_EXIT("Called value is not a function");
+
+			m_frames[m_frame_count++] = { static_cast<size_t>(ip - code), static_cast<size_t>(bp - m_stack) };
+			bp = sp - argc;
+			ip = code + fn.operand();
+
+			if (m_jit)
+			{
+				if (const void* native = m_jit->on_entry(ip - code))
+					VM_RUN_NATIVE(native);
+			}
+			VM_DISPATCH();
+		}
+
+		VM_CASE(RET):
+		{
+			VM_RETURN(sp[-1]);
+		}
+
+		VM_CASE(TAILCALL):
+		{
+			int64_t callee = read_sleb(ip);
+			size_t argc = read_uleb(ip);
+			Value fn = callee & 1 ? m_stack[callee >> 1] : bp[callee >> 1];
+			if (!fn.is(ValueType::ADDR)) [[unlikely]]
+				ERR_EXIT("Called value is not a function");
+
+			// slide the new arguments down over the current frame, the frame record stays as is
+			std::copy(sp - argc, sp, bp);
+			sp = bp + argc;
+			ip = code + fn.operand();
+
+			if (m_jit)
+			{
+				if (const void* native = m_jit->on_entry(ip - code))
+					VM_RUN_NATIVE(native);
+			}
+			VM_DISPATCH();
+		}
+
+		VM_CASE(MEMO):
+		{
+			size_t entry = ip - 1 - code;
+			size_t cache = read_uleb(ip);
+			size_t argc = read_uleb(ip);
+			if (cache >= m_memo.size())
+				m_memo.resize(cache + 1);
+			if (!m_memo[cache].has_value())
+				m_memo[cache].emplace(argc);
+
+			MemoCache& memo = m_memo[cache].value();
+			if (!memo.active())
+				VM_NEXT();
+
+			if (const Value* result = memo.find(bp))
+				VM_RETURN(*result);
+			if (!memo.active() && m_jit)
+				m_jit->memo_off(entry);
+			VM_NEXT();
+		}
+
+		VM_CASE(MEMO_RET):
+		{
+			size_t cache = read_uleb(ip);
+			read_uleb(ip); // argc, the cache knows it
+			if (m_memo[cache]->active())
+				m_memo[cache]->store(bp, sp[-1]);
+			VM_RETURN(sp[-1]);
+		}
+
+		VM_CASE(ADD_IMM):
+		{
+			sp[-1] = ValueOps::add(sp[-1], Value(ValueType::LIT, read_sleb(ip)));
+			VM_NEXT();
+		}
+
+		VM_CASE(ADD_LOCAL_IMM):
+		{
+			int64_t slot = read_sleb(ip);
+			VM_PUSH(ValueOps::add(bp[slot], Value(ValueType::LIT, read_sleb(ip))));
+			VM_NEXT();
+		}
+
+		VM_CASE(INC_LOCAL):
+		{
+			Value& local = bp[read_sleb(ip)];
+			local = ValueOps::add(local, Value(ValueType::LIT, read_sleb(ip)));
+			VM_NEXT();
+		}
+
+		VM_CASE(JLT): VM_BRANCH_IF(ValueOps::lt(lhs, rhs));
+		VM_CASE(JGT): VM_BRANCH_IF(ValueOps::gt(lhs, rhs));
+		VM_CASE(JLTE): VM_BRANCH_IF(ValueOps::lte(lhs, rhs));
+		VM_CASE(JGTE): VM_BRANCH_IF(ValueOps::gte(lhs, rhs));
+		VM_CASE(JEQ): VM_BRANCH_IF(ValueOps::eql(lhs, rhs));
+		VM_CASE(JNE): VM_BRANCH_IF(!ValueOps::eql(lhs, rhs));
+
+		// the negation of the comparison they were fused from, so NaN takes the same path
+		VM_CASE(JNLT): VM_BRANCH_IF(!ValueOps::lt(lhs, rhs));
+		VM_CASE(JNGT): VM_BRANCH_IF(!ValueOps::gt(lhs, rhs));
+		VM_CASE(JNLTE): VM_BRANCH_IF(!ValueOps::lte(lhs, rhs));
+		VM_CASE(JNGTE): VM_BRANCH_IF(!ValueOps::gte(lhs, rhs));
+
+		VM_CASE(ADD_DBL): VM_DOUBLE_OP(ADD, +);
+		VM_CASE(SUB_DBL): VM_DOUBLE_OP(SUB, -);
+		VM_CASE(MUL_DBL): VM_DOUBLE_OP(MUL, *);
+		VM_CASE(DIV_DBL): VM_DOUBLE_OP(DIV, /);
+
+		VM_CASE(HLT):
+		{
+			LOGGER << "*Program Finished..*" << std::endl;
+			std::cin.get();
+			VM_SAVE();
+			m_ip = ip - code;
+			return;
+		}
+
+#ifndef VM_THREADED
+		default: ERR_EXIT("Unknown opcode");
+#endif
+	}
+}
\ No newline at end of file
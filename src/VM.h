@@ -1,47 +1,58 @@
 #pragma once
 
+#include <memory>
+#include <optional>
+
 #include "Compiler.h"
+#include "StackMemory.h"
+#include "MemoCache.h"
+
+class Jit;
 
 class VM
 {
 public:
-	VM(std::vector<Instr>& bytecode);
-	void run();
-
-private:
-	void exec_next();
+	struct Frame
+	{
+		size_t ret_ip; // byte offset
+		size_t bp;
+	};
 
-	void push(Value val);
-	void pop();
-	void move(Value val);
-
-	void push_sf();
-	void pop_sf();
-
-	void add();
-	void sub();
-	void mul();
-	void div();
+public:
+	static constexpr size_t DEFAULT_STACK_SIZE = 64 * 1024 * 1024;
 
-	void bw_or();
-	void bw_and();
-	void or_();
-	void and_();
+	// code is encoded by Encoder; stack_size bytes are reserved for values and again for frames
+	VM(std::vector<uint8_t>& code, size_t stack_size = DEFAULT_STACK_SIZE);
+	~VM();
+	void run();
 
-	void lt();
-	void gt();
-	void gte();
-	void lte();
-	void eql();
+	// compile functions to native code once they were called threshold times
+	void enable_jit(size_t threshold);
 
-	void jmp(Value val);
-	void jmp_zero(Value val);
+	Value slot(size_t idx) const;
+	size_t executed() const; // always 0 unless built with PISP_VM_STATS, native code isn't counted
+	size_t quickened() const; // instructions rewritten into a form specialized for their operand types
+	size_t deoptimized() const; // specialized instructions that met other types and went back
+	size_t memo_hits() const; // calls of memoized functions answered from their cache
+	size_t memo_misses() const;
 
-	void hlt();
+private:
+	size_t enter_jit(const void* native);
 
 private:
-	const std::vector<Instr> m_bytecode;
-	std::vector<Value> m_stack;
+	std::vector<uint8_t> m_code; // patched in place while running, see VM_QUICKEN
+	std::vector<bool> m_unstable; // by byte offset: instructions that deoptimized once and stay generic
+	StackMemory m_stack_memory;
+	StackMemory m_frame_memory;
+	Value* const m_stack; // the first m_sp values are live
+	Frame* const m_frames; // the first m_frame_count frames are live
+	size_t m_sp;
+	size_t m_frame_count;
 	size_t m_bp;
 	size_t m_ip;
+	size_t m_executed = 0;
+	size_t m_quickened = 0;
+	size_t m_deoptimized = 0;
+	std::vector<std::optional<MemoCache>> m_memo; // memoized function -> its cache, made on its first call
+	std::unique_ptr<Jit> m_jit;
 };
\ No newline at end of file
@@ -0,0 +1,6 @@
+#include "Value.h"
+
+void ValueOps::type_error(const char* msg)
+{
+	ERR_EXIT(msg);
+}
\ No newline at end of file
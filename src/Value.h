@@ -0,0 +1,273 @@
+#pragma once
+
+#include <bit>
+#include <cstdint>
+#include <utility>
+
+#include "Utils.h"
+
+enum class ValueType
+{
+	LIT, // integer
+	VAR,
+	ABS_VAR,
+	ADDR, // code address (function entry or return address)
+	NIL,
+	NOT_REQUIRED,
+	FLOAT // untagged, must stay last
+};
+
+// A NaN-boxed 64-bit value. Doubles are stored as their own bit pattern; every
+// other type lives in the negative quiet-NaN space that no arithmetic result
+// produces: the top 16 bits hold 0xFFF9 + type and the low 48 bits the payload.
+// Integers are 48-bit two's complement. The tokenizer rejects wider literals, results
+// of arithmetic that overflow turn into doubles.
+class Value
+{
+public:
+	static constexpr int PAYLOAD_BITS = 48;
+	static constexpr uint64_t PAYLOAD_MASK = (uint64_t{ 1 } << PAYLOAD_BITS) - 1;
+	static constexpr uint64_t TAG_MASK = ~PAYLOAD_MASK;
+	static constexpr uint64_t TAG_BASE = uint64_t{ 0xFFF9 } << PAYLOAD_BITS; // everything below is a double
+	static constexpr uint64_t CANONICAL_NAN = 0x7FF8000000000000;
+	static constexpr int64_t INT_MAX_VAL = (int64_t{ 1 } << (PAYLOAD_BITS - 1)) - 1;
+	static constexpr int64_t INT_MIN_VAL = -INT_MAX_VAL - 1;
+
+	Value() = default;
+
+	// any type but FLOAT, integer operands must already fit in 48 bits
+	constexpr Value(ValueType type, int64_t operand)
+		: m_bits(tag_of(type) | (static_cast<uint64_t>(operand) & PAYLOAD_MASK)) {}
+
+	static Value from_int(int64_t val)
+	{
+		if (val < INT_MIN_VAL || val > INT_MAX_VAL) [[unlikely]]
+			return from_double(static_cast<double>(val));
+		return Value(ValueType::LIT, val);
+	}
+
+	static Value from_double(double val)
+	{
+		Value res;
+		res.m_bits = val != val ? CANONICAL_NAN : std::bit_cast<uint64_t>(val);
+		return res;
+	}
+
+	static Value from_bits(uint64_t bits)
+	{
+		Value res;
+		res.m_bits = bits;
+		return res;
+	}
+
+	static Value from_bool(bool val)
+	{
+		return Value(ValueType::LIT, val);
+	}
+
+	bool is_int() const { return (m_bits & TAG_MASK) == tag_of(ValueType::LIT); }
+	bool is_double() const { return m_bits < TAG_BASE; }
+	bool is_number() const { return is_int() || is_double(); }
+	bool is(ValueType type) const { return type == ValueType::FLOAT ? is_double() : (m_bits & TAG_MASK) == tag_of(type); }
+
+	static bool both_int(Value lhs, Value rhs)
+	{
+		return ((lhs.m_bits & TAG_MASK) == tag_of(ValueType::LIT)) & ((rhs.m_bits & TAG_MASK) == tag_of(ValueType::LIT));
+	}
+
+	static bool both_double(Value lhs, Value rhs)
+	{
+		return (lhs.m_bits < TAG_BASE) & (rhs.m_bits < TAG_BASE);
+	}
+
+	ValueType type() const
+	{
+		if (is_double())
+			return ValueType::FLOAT;
+		return static_cast<ValueType>((m_bits - TAG_BASE) >> PAYLOAD_BITS);
+	}
+
+	// sign-extended payload: the integer value, slot index or code address
+	int64_t operand() const
+	{
+		return static_cast<int64_t>(m_bits << (64 - PAYLOAD_BITS)) >> (64 - PAYLOAD_BITS);
+	}
+
+	// an integer payload moved up into the top 48 bits, where a plain int64 add, sub or
+	// mul overflows exactly when the 48-bit result would
+	int64_t shifted() const
+	{
+		return static_cast<int64_t>(m_bits << (64 - PAYLOAD_BITS));
+	}
+
+	static Value from_shifted(int64_t val)
+	{
+		return from_bits(tag_of(ValueType::LIT) | static_cast<uint64_t>(val) >> (64 - PAYLOAD_BITS));
+	}
+
+	void set_operand(int64_t operand)
+	{
+		m_bits = (m_bits & TAG_MASK) | (static_cast<uint64_t>(operand) & PAYLOAD_MASK);
+	}
+
+	double as_double() const
+	{
+		return std::bit_cast<double>(m_bits);
+	}
+
+	double to_double() const
+	{
+		return is_double() ? as_double() : static_cast<double>(operand());
+	}
+
+	bool truthy() const
+	{
+		if (is_int()) [[likely]]
+			return (m_bits & PAYLOAD_MASK) != 0;
+		if (is_double())
+			return as_double() != 0.0;
+		return !is(ValueType::NIL);
+	}
+
+	constexpr uint64_t bits() const { return m_bits; }
+
+private:
+	static constexpr uint64_t tag_of(ValueType type)
+	{
+		return TAG_BASE + (static_cast<uint64_t>(type) << PAYLOAD_BITS);
+	}
+
+private:
+	uint64_t m_bits;
+};
+
+static_assert(sizeof(Value) == sizeof(uint64_t), "Value must stay a single machine word");
+
+// Operators shared by both VMs. Each one tries int op int first, then
+// double op double, and only then converts a mixed pair.
+namespace ValueOps
+{
+	// kept out of line so the error reporting doesn't bloat the inlined fast paths
+	[[noreturn]] void type_error(const char* msg);
+
+	inline std::pair<double, double> mixed(Value lhs, Value rhs)
+	{
+		if (!lhs.is_number() || !rhs.is_number()) [[unlikely]]
+			type_error("Arithmetic on a value that is not a number");
+		return { lhs.to_double(), rhs.to_double() };
+	}
+
+	template<typename IntOp, typename DoubleOp>
+	inline Value arith(Value lhs, Value rhs, IntOp int_op, DoubleOp double_op)
+	{
+		if (Value::both_int(lhs, rhs)) [[likely]]
+			return int_op(lhs.operand(), rhs.operand());
+		if (Value::both_double(lhs, rhs))
+			return double_op(lhs.as_double(), rhs.as_double());
+		auto [lhs_d, rhs_d] = mixed(lhs, rhs);
+		return double_op(lhs_d, rhs_d);
+	}
+
+	// the int fast paths work on shifted payloads and fall back to arith on overflow, where
+	// 48-bit operands can't overflow an int64 and from_int turns the result into a double
+	inline Value add(Value lhs, Value rhs)
+	{
+		int64_t res;
+		if (Value::both_int(lhs, rhs) && !__builtin_add_overflow(lhs.shifted(), rhs.shifted(), &res)) [[likely]]
+			return Value::from_shifted(res);
+		return arith(lhs, rhs,
+			[](int64_t a, int64_t b) { return Value::from_int(a + b); },
+			[](double a, double b) { return Value::from_double(a + b); });
+	}
+
+	inline Value sub(Value lhs, Value rhs)
+	{
+		int64_t res;
+		if (Value::both_int(lhs, rhs) && !__builtin_sub_overflow(lhs.shifted(), rhs.shifted(), &res)) [[likely]]
+			return Value::from_shifted(res);
+		return arith(lhs, rhs,
+			[](int64_t a, int64_t b) { return Value::from_int(a - b); },
+			[](double a, double b) { return Value::from_double(a - b); });
+	}
+
+	inline Value mul(Value lhs, Value rhs)
+	{
+		int64_t res;
+		if (Value::both_int(lhs, rhs) && !__builtin_mul_overflow(lhs.shifted(), rhs.operand(), &res)) [[likely]]
+			return Value::from_shifted(res);
+		return arith(lhs, rhs,
+			[](int64_t a, int64_t b) {
+				int64_t res;
+				if (__builtin_mul_overflow(a, b, &res)) [[unlikely]]
+					return Value::from_double(static_cast<double>(a) * static_cast<double>(b));
+				return Value::from_int(res);
+			},
+			[](double a, double b) { return Value::from_double(a * b); });
+	}
+
+	// integer division truncates like C, dividing by a double follows IEEE 754
+	inline Value div(Value lhs, Value rhs)
+	{
+		return arith(lhs, rhs,
+			[](int64_t a, int64_t b) {
+				if (b == 0) [[unlikely]]
+					type_error("Integer division by zero");
+				return Value::from_int(a / b);
+			},
+			[](double a, double b) { return Value::from_double(a / b); });
+	}
+
+	inline Value bw_or(Value lhs, Value rhs)
+	{
+		if (!Value::both_int(lhs, rhs)) [[unlikely]]
+			type_error("Bitwise operands must be integers");
+		return Value::from_bits(lhs.bits() | rhs.bits()); // same tag on both sides
+	}
+
+	inline Value bw_and(Value lhs, Value rhs)
+	{
+		if (!Value::both_int(lhs, rhs)) [[unlikely]]
+			type_error("Bitwise operands must be integers");
+		return Value::from_bits(lhs.bits() & rhs.bits());
+	}
+
+	inline Value logical_or(Value lhs, Value rhs)
+	{
+		return Value::from_bool(lhs.truthy() || rhs.truthy());
+	}
+
+	inline Value logical_and(Value lhs, Value rhs)
+	{
+		return Value::from_bool(lhs.truthy() && rhs.truthy());
+	}
+
+	inline bool lt(Value lhs, Value rhs)
+	{
+		if (Value::both_int(lhs, rhs)) [[likely]]
+			return lhs.shifted() < rhs.shifted();
+		auto [lhs_d, rhs_d] = mixed(lhs, rhs);
+		return lhs_d < rhs_d;
+	}
+
+	inline bool gt(Value lhs, Value rhs) { return lt(rhs, lhs); }
+
+	inline bool lte(Value lhs, Value rhs)
+	{
+		if (Value::both_int(lhs, rhs)) [[likely]]
+			return lhs.shifted() <= rhs.shifted();
+		auto [lhs_d, rhs_d] = mixed(lhs, rhs);
+		return lhs_d <= rhs_d;
+	}
+
+	inline bool gte(Value lhs, Value rhs) { return lte(rhs, lhs); }
+
+	// non-numbers (functions, nil) are only equal to themselves
+	inline bool eql(Value lhs, Value rhs)
+	{
+		if (Value::both_int(lhs, rhs)) [[likely]]
+			return lhs.bits() == rhs.bits();
+		if (lhs.is_number() && rhs.is_number())
+			return lhs.to_double() == rhs.to_double();
+		return lhs.bits() == rhs.bits();
+	}
+}
\ No newline at end of file